@@ -4,22 +4,27 @@ include $(CLEAR_VARS)
 
 LOCAL_ARM_MODE := arm
 
-ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
-  LOCAL_CFLAGS := -DJDCT_DEFAULT=JDCT_FLOAT
-else
-  LOCAL_CFLAGS:= -DJDCT_DEFAULT=JDCT_IFAST
-endif
-
 LOCAL_MODULE    := jpeg
 LOCAL_SRC_FILES := jaricom.c jcapimin.c jcapistd.c jcarith.c jccoefct.c jccolor.c \
         jcdctmgr.c jchuff.c jcinit.c jcmainct.c jcmarker.c jcmaster.c \
         jcomapi.c jcparam.c jcprepct.c jcsample.c jctrans.c jdapimin.c \
-        jdapistd.c jdarith.c jdatadst.c jdatasrc.c jdcoefct.c jdcolor.c \
-        jddctmgr.c jdhuff.c jdinput.c jdmainct.c jdmarker.c jdmaster.c \
-        jdmerge.c jdpostct.c jdsample.c jdtrans.c jerror.c jfdctflt.c \
+        jdapistd.c jdarith.c jdatadst.c jdatasrc.c jdcoefct.c apv_jdcolor.c \
+        apv_jddctmgr.c jdhuff.c jdinput.c jdmainct.c jdmarker.c jdmaster.c \
+        jdmerge.c jdpostct.c apv_jdsample.c jdtrans.c jerror.c jfdctflt.c \
         jfdctfst.c jfdctint.c jidctflt.c jidctfst.c jidctint.c jquant1.c \
         jquant2.c jutils.c jmemmgr.c \
 	jmemnobs.c
 
+# NEON is optional on ARMv7, NEON routines are chosen at runtime (see apv_jsimd.h)
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+  LOCAL_CFLAGS := -DJDCT_DEFAULT=JDCT_FLOAT -DAPV_JSIMD_NEON
+  LOCAL_SRC_FILES += apv_jsimd.c apv_jsimd_neon.c.neon
+  LOCAL_STATIC_LIBRARIES := cpufeatures
+else
+  LOCAL_CFLAGS:= -DJDCT_DEFAULT=JDCT_IFAST
+endif
+
 
 include $(BUILD_STATIC_LIBRARY)
+
+$(call import-module,android/cpufeatures)
@@ -0,0 +1,55 @@
+/*
+ * apv_jsimd.c
+ *
+ * Runtime selection of NEON decoder routines, see apv_jsimd.h.
+ * Built only for armeabi-v7a, where NEON is optional.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "apv_jsimd.h"
+
+#include <cpu-features.h>
+
+
+static int neon_support = -1;
+
+LOCAL(int)
+have_neon (void)
+{
+  if (neon_support < 0)
+    neon_support =
+      (android_getCpuFamily() == ANDROID_CPU_FAMILY_ARM &&
+       (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON) != 0);
+  return neon_support;
+}
+
+
+GLOBAL(int)
+apv_jsimd_can_idct_float (void)
+{
+  /* NEON code assumes default sample and coefficient types */
+  if (BITS_IN_JSAMPLE != 8 || sizeof(JCOEF) != 2 || sizeof(FAST_FLOAT) != 4)
+    return 0;
+  return have_neon();
+}
+
+
+GLOBAL(int)
+apv_jsimd_can_ycc_rgb (void)
+{
+  if (BITS_IN_JSAMPLE != 8 || RGB_PIXELSIZE != 3 ||
+      RGB_RED != 0 || RGB_GREEN != 1 || RGB_BLUE != 2)
+    return 0;
+  return have_neon();
+}
+
+
+GLOBAL(int)
+apv_jsimd_can_upsample (void)
+{
+  if (BITS_IN_JSAMPLE != 8)
+    return 0;
+  return have_neon();
+}
@@ -0,0 +1,30 @@
+/*
+ * apv_jsimd.h
+ *
+ * NEON versions of the hottest decoder routines: float IDCT, YCbCr->RGB
+ * conversion and 2:1 upsampling. They are used by APV's modified copies of
+ * jddctmgr.c, jdcolor.c and jdsample.c when APV_JSIMD_NEON is defined and
+ * the CPU has NEON (not all ARMv7 CPUs do, so it is checked at runtime).
+ *
+ * Color conversion and upsampling produce exactly the same output as the
+ * scalar code. The float IDCT does the same float operations in the same
+ * order, so it differs only where scalar code would wrap out of range
+ * values instead of saturating them.
+ */
+
+EXTERN(int) apv_jsimd_can_idct_float JPP((void));
+EXTERN(int) apv_jsimd_can_ycc_rgb JPP((void));
+EXTERN(int) apv_jsimd_can_upsample JPP((void));
+
+EXTERN(void) apv_jsimd_idct_float
+	JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	     JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col));
+EXTERN(void) apv_jsimd_ycc_rgb_convert
+	JPP((j_decompress_ptr cinfo, JSAMPIMAGE input_buf, JDIMENSION input_row,
+	     JSAMPARRAY output_buf, int num_rows));
+EXTERN(void) apv_jsimd_h2v1_upsample
+	JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	     JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr));
+EXTERN(void) apv_jsimd_h2v2_upsample
+	JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	     JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr));
@@ -0,0 +1,315 @@
+/*
+ * apv_jsimd_neon.c
+ *
+ * NEON decoder routines, see apv_jsimd.h.
+ * Each routine mirrors the arithmetic of its scalar counterpart, so results
+ * match the scalar code; comments name the routine being mirrored.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "apv_jsimd.h"
+
+#include <arm_neon.h>
+
+
+/*
+ * Float IDCT, mirrors jpeg_idct_float in jidctflt.c.
+ * Block is kept as two halves of 4 columns each, so that one vector
+ * operation does the 1-D IDCT step of 4 columns at once. Rows pass is done
+ * by transposing the block and running the same columns pass again.
+ */
+
+#define FIX_1_414213562  ((FAST_FLOAT) 1.414213562)
+#define FIX_1_847759065  ((FAST_FLOAT) 1.847759065)
+#define FIX_1_082392200  ((FAST_FLOAT) 1.082392200)
+#define FIX_2_613125930  ((FAST_FLOAT) 2.613125930)
+
+/* 1-D IDCT of 4 columns, in and out may be the same array */
+LOCAL(void)
+idct_float_pass (float32x4_t * in, float32x4_t * out)
+{
+  float32x4_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  float32x4_t tmp10, tmp11, tmp12, tmp13;
+  float32x4_t z5, z10, z11, z12, z13;
+
+  /* Even part */
+
+  tmp10 = vaddq_f32(in[0], in[4]);
+  tmp11 = vsubq_f32(in[0], in[4]);
+
+  tmp13 = vaddq_f32(in[2], in[6]);
+  tmp12 = vsubq_f32(vmulq_f32(vsubq_f32(in[2], in[6]),
+			      vdupq_n_f32(FIX_1_414213562)), tmp13);
+
+  tmp0 = vaddq_f32(tmp10, tmp13);
+  tmp3 = vsubq_f32(tmp10, tmp13);
+  tmp1 = vaddq_f32(tmp11, tmp12);
+  tmp2 = vsubq_f32(tmp11, tmp12);
+
+  /* Odd part */
+
+  z13 = vaddq_f32(in[5], in[3]);
+  z10 = vsubq_f32(in[5], in[3]);
+  z11 = vaddq_f32(in[1], in[7]);
+  z12 = vsubq_f32(in[1], in[7]);
+
+  tmp7 = vaddq_f32(z11, z13);
+  tmp11 = vmulq_f32(vsubq_f32(z11, z13), vdupq_n_f32(FIX_1_414213562));
+
+  /* products are not fused with adds, to round the same as scalar code */
+  z5 = vmulq_f32(vaddq_f32(z10, z12), vdupq_n_f32(FIX_1_847759065));
+  tmp10 = vsubq_f32(z5, vmulq_f32(z12, vdupq_n_f32(FIX_1_082392200)));
+  tmp12 = vsubq_f32(z5, vmulq_f32(z10, vdupq_n_f32(FIX_2_613125930)));
+
+  tmp6 = vsubq_f32(tmp12, tmp7);
+  tmp5 = vsubq_f32(tmp11, tmp6);
+  tmp4 = vsubq_f32(tmp10, tmp5);
+
+  out[0] = vaddq_f32(tmp0, tmp7);
+  out[7] = vsubq_f32(tmp0, tmp7);
+  out[1] = vaddq_f32(tmp1, tmp6);
+  out[6] = vsubq_f32(tmp1, tmp6);
+  out[2] = vaddq_f32(tmp2, tmp5);
+  out[5] = vsubq_f32(tmp2, tmp5);
+  out[3] = vaddq_f32(tmp3, tmp4);
+  out[4] = vsubq_f32(tmp3, tmp4);
+}
+
+LOCAL(void)
+transpose_4x4 (float32x4_t * a, float32x4_t * b, float32x4_t * c, float32x4_t * d)
+{
+  float32x4x2_t ab = vtrnq_f32(*a, *b);
+  float32x4x2_t cd = vtrnq_f32(*c, *d);
+
+  *a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+  *b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+  *c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+  *d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+
+/* transpose 8x8 block given as left and right halves of rows */
+LOCAL(void)
+transpose_8x8 (float32x4_t * left, float32x4_t * right)
+{
+  float32x4_t t;
+  int i;
+
+  transpose_4x4(&left[0], &left[1], &left[2], &left[3]);
+  transpose_4x4(&left[4], &left[5], &left[6], &left[7]);
+  transpose_4x4(&right[0], &right[1], &right[2], &right[3]);
+  transpose_4x4(&right[4], &right[5], &right[6], &right[7]);
+  /* swap top right and bottom left quarters */
+  for (i = 0; i < 4; i++) {
+    t = right[i];
+    right[i] = left[i + 4];
+    left[i + 4] = t;
+  }
+}
+
+GLOBAL(void)
+apv_jsimd_idct_float (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		      JCOEFPTR coef_block,
+		      JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  FLOAT_MULT_TYPE * quantptr = (FLOAT_MULT_TYPE *) compptr->dct_table;
+  float32x4_t left[DCTSIZE], right[DCTSIZE];
+  int16x8_t coefs;
+  uint16x8_t samples;
+  int row;
+
+  /* Pass 1: process columns, dequantizing input */
+
+  for (row = 0; row < DCTSIZE; row++) {
+    coefs = vld1q_s16(coef_block + row * DCTSIZE);
+    left[row] = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(coefs))),
+			  vld1q_f32(quantptr + row * DCTSIZE));
+    right[row] = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(coefs))),
+			   vld1q_f32(quantptr + row * DCTSIZE + 4));
+  }
+  idct_float_pass(left, left);
+  idct_float_pass(right, right);
+
+  /* Pass 2: process rows */
+
+  transpose_8x8(left, right);
+  /* Apply signed->unsigned and prepare float->int conversion */
+  left[0] = vaddq_f32(left[0],
+		      vdupq_n_f32((FAST_FLOAT) CENTERJSAMPLE + (FAST_FLOAT) 0.5));
+  right[0] = vaddq_f32(right[0],
+		       vdupq_n_f32((FAST_FLOAT) CENTERJSAMPLE + (FAST_FLOAT) 0.5));
+  idct_float_pass(left, left);
+  idct_float_pass(right, right);
+  transpose_8x8(left, right);
+
+  /* Final output stage: float->int conversion, truncating like a C cast,
+   * and saturation, which is what range limit table does to sane values.
+   */
+  for (row = 0; row < DCTSIZE; row++) {
+    samples = vcombine_u16(vqmovun_s32(vcvtq_s32_f32(left[row])),
+			   vqmovun_s32(vcvtq_s32_f32(right[row])));
+    vst1_u8(output_buf[row] + output_col, vqmovn_u16(samples));
+  }
+}
+
+
+/*
+ * YCbCr->RGB conversion, mirrors ycc_rgb_convert in jdcolor.c.
+ * The scalar code looks up tables built with the same fixed point
+ * arithmetic that is done here directly, 8 pixels at a time.
+ */
+
+/* same fixed point as jdcolor.c, jdct.h defines FIX with other scale */
+#undef FIX
+#define SCALEBITS	16
+#define ONE_HALF	((INT32) 1 << (SCALEBITS-1))
+#define FIX(x)		((INT32) ((x) * (1L<<SCALEBITS) + 0.5))
+
+/* y + (product >> SCALEBITS), for 4 pixels */
+#define DESCALE_ADD(y, product) \
+  vaddq_s32(y, vshrq_n_s32(product, SCALEBITS))
+
+LOCAL(uint8x8_t)
+ycc_component (int32x4_t y_lo, int32x4_t y_hi, int32x4_t off_lo, int32x4_t off_hi)
+{
+  /* range limit table clamps y + offset to 0..MAXJSAMPLE */
+  return vqmovn_u16(vcombine_u16(vqmovun_s32(DESCALE_ADD(y_lo, off_lo)),
+				 vqmovun_s32(DESCALE_ADD(y_hi, off_hi))));
+}
+
+GLOBAL(void)
+apv_jsimd_ycc_rgb_convert (j_decompress_ptr cinfo,
+			   JSAMPIMAGE input_buf, JDIMENSION input_row,
+			   JSAMPARRAY output_buf, int num_rows)
+{
+  JSAMPROW outptr;
+  JSAMPROW inptr0, inptr1, inptr2;
+  JDIMENSION col;
+  JDIMENSION num_cols = cinfo->output_width;
+  JSAMPLE * range_limit = cinfo->sample_range_limit;
+  int16x8_t center = vdupq_n_s16(CENTERJSAMPLE);
+  int32x4_t half = vdupq_n_s32(ONE_HALF);
+  int32x4_t y_lo, y_hi, cb_lo, cb_hi, cr_lo, cr_hi;
+  int16x8_t y, cb, cr;
+  uint8x8x3_t rgb;
+  int ycol, cbcol, crcol;
+  SHIFT_TEMPS
+
+  while (--num_rows >= 0) {
+    inptr0 = input_buf[0][input_row];
+    inptr1 = input_buf[1][input_row];
+    inptr2 = input_buf[2][input_row];
+    input_row++;
+    outptr = *output_buf++;
+    for (col = 0; col + 8 <= num_cols; col += 8) {
+      y = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(inptr0 + col)));
+      cb = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(inptr1 + col))), center);
+      cr = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(inptr2 + col))), center);
+      y_lo = vmovl_s16(vget_low_s16(y));
+      y_hi = vmovl_s16(vget_high_s16(y));
+      cb_lo = vmovl_s16(vget_low_s16(cb));
+      cb_hi = vmovl_s16(vget_high_s16(cb));
+      cr_lo = vmovl_s16(vget_low_s16(cr));
+      cr_hi = vmovl_s16(vget_high_s16(cr));
+
+      /* Cr=>R value is nearest int to 1.40200 * x */
+      rgb.val[RGB_RED] = ycc_component(y_lo, y_hi,
+	vaddq_s32(vmulq_n_s32(cr_lo, FIX(1.40200)), half),
+	vaddq_s32(vmulq_n_s32(cr_hi, FIX(1.40200)), half));
+      /* Cb=>G and Cr=>G values are scaled-up -0.34414 * x and -0.71414 * x */
+      rgb.val[RGB_GREEN] = ycc_component(y_lo, y_hi,
+	vaddq_s32(vaddq_s32(vmulq_n_s32(cb_lo, - FIX(0.34414)), half),
+		  vmulq_n_s32(cr_lo, - FIX(0.71414))),
+	vaddq_s32(vaddq_s32(vmulq_n_s32(cb_hi, - FIX(0.34414)), half),
+		  vmulq_n_s32(cr_hi, - FIX(0.71414))));
+      /* Cb=>B value is nearest int to 1.77200 * x */
+      rgb.val[RGB_BLUE] = ycc_component(y_lo, y_hi,
+	vaddq_s32(vmulq_n_s32(cb_lo, FIX(1.77200)), half),
+	vaddq_s32(vmulq_n_s32(cb_hi, FIX(1.77200)), half));
+
+      vst3_u8(outptr, rgb);
+      outptr += 8 * RGB_PIXELSIZE;
+    }
+    for (; col < num_cols; col++) {
+      ycol = GETJSAMPLE(inptr0[col]);
+      cbcol = GETJSAMPLE(inptr1[col]) - CENTERJSAMPLE;
+      crcol = GETJSAMPLE(inptr2[col]) - CENTERJSAMPLE;
+      outptr[RGB_RED] = range_limit[ycol +
+	(int) RIGHT_SHIFT(FIX(1.40200) * crcol + ONE_HALF, SCALEBITS)];
+      outptr[RGB_GREEN] = range_limit[ycol +
+	(int) RIGHT_SHIFT(- FIX(0.34414) * cbcol + ONE_HALF
+			  - FIX(0.71414) * crcol, SCALEBITS)];
+      outptr[RGB_BLUE] = range_limit[ycol +
+	(int) RIGHT_SHIFT(FIX(1.77200) * cbcol + ONE_HALF, SCALEBITS)];
+      outptr += RGB_PIXELSIZE;
+    }
+  }
+}
+
+
+/*
+ * 2:1 horizontal box filter upsampling, mirrors h2v1_upsample and
+ * h2v2_upsample in jdsample.c. Vectors are not stored past the end of
+ * output row, the last pixels are done one at a time.
+ */
+
+LOCAL(void)
+upsample_row_h2 (JSAMPROW inptr, JSAMPROW outptr, JSAMPROW outptr2,
+		 JDIMENSION output_width)
+{
+  JSAMPROW outend = outptr + output_width;
+  uint8x16x2_t pairs;
+  JSAMPLE invalue;
+
+  while (outend - outptr >= 32) {
+    pairs.val[0] = vld1q_u8(inptr);
+    pairs.val[1] = pairs.val[0];
+    vst2q_u8(outptr, pairs);
+    if (outptr2) {
+      vst2q_u8(outptr2, pairs);
+      outptr2 += 32;
+    }
+    inptr += 16;
+    outptr += 32;
+  }
+  while (outptr < outend) {
+    invalue = *inptr++;
+    *outptr++ = invalue;
+    *outptr++ = invalue;
+    if (outptr2) {
+      *outptr2++ = invalue;
+      *outptr2++ = invalue;
+    }
+  }
+}
+
+GLOBAL(void)
+apv_jsimd_h2v1_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+			 JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
+{
+  JSAMPARRAY output_data = *output_data_ptr;
+  int outrow;
+
+  for (outrow = 0; outrow < cinfo->max_v_samp_factor; outrow++)
+    upsample_row_h2(input_data[outrow], output_data[outrow], NULL,
+		    cinfo->output_width);
+}
+
+GLOBAL(void)
+apv_jsimd_h2v2_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+			 JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
+{
+  JSAMPARRAY output_data = *output_data_ptr;
+  int inrow, outrow;
+
+  inrow = outrow = 0;
+  while (outrow < cinfo->max_v_samp_factor) {
+    /* both output rows are written at once, instead of copying first one */
+    upsample_row_h2(input_data[inrow], output_data[outrow],
+		    output_data[outrow + 1], cinfo->output_width);
+    inrow++;
+    outrow += 2;
+  }
+}
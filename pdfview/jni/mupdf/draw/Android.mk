@@ -10,14 +10,23 @@ LOCAL_MODULE    := fitzdraw
 LOCAL_SRC_FILES := \
 	draw_device.c \
 	arch_port.c \
-        draw_blend.c \
-        draw_glyph.c \
-        draw_affine.c \
+        apv_draw_blend.c \
+        apv_draw_glyph.c \
+        apv_draw_affine.c \
         draw_scale.c \
         draw_unpack.c \
         draw_mesh.c \
 	draw_path.c \
-        draw_paint.c \
-	draw_edge.c
+        apv_draw_paint.c \
+	apv_draw_edge.c
+
+# NEON is optional on ARMv7, NEON span painters are chosen at runtime (see apv_draw_simd.c)
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+  LOCAL_CFLAGS += -DHAVE_CPUDEP
+  LOCAL_SRC_FILES += apv_draw_simd.c apv_draw_neon.c.neon
+  LOCAL_STATIC_LIBRARIES := cpufeatures
+endif
 
 include $(BUILD_STATIC_LIBRARY)
+
+$(call import-module,android/cpufeatures)
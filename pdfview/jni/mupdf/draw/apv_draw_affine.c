@@ -0,0 +1,1000 @@
+
+/*
+ * This is a modified version of draw_affine.c file which is part of MuPDF
+ * by Artifex Software, Inc.
+ * Paints axis-aligned images a row at a time, see fz_paint_image_rows.
+ */
+
+#include "fitz.h"
+
+typedef unsigned char byte;
+
+static inline float roundup(float x)
+{
+	return (x < 0) ? floorf(x) : ceilf(x);
+}
+
+static inline int lerp(int a, int b, int t)
+{
+	return a + (((b - a) * t) >> 16);
+}
+
+static inline int bilerp(int a, int b, int c, int d, int u, int v)
+{
+	return lerp(lerp(a, b, u), lerp(c, d, u), v);
+}
+
+static inline byte *sample_nearest(byte *s, int w, int h, int n, int u, int v)
+{
+	if (u < 0) u = 0;
+	if (v < 0) v = 0;
+	if (u >= w) u = w - 1;
+	if (v >= h) v = h - 1;
+	return s + (v * w + u) * n;
+}
+
+/* Blend premultiplied source image in constant alpha over destination */
+
+static inline void
+fz_paint_affine_alpha_N_lerp(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, int alpha, byte *hp)
+{
+	int k;
+	int n1 = n-1;
+
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			int uf = u & 0xffff;
+			int vf = v & 0xffff;
+			byte *a = sample_nearest(sp, sw, sh, n, ui, vi);
+			byte *b = sample_nearest(sp, sw, sh, n, ui+1, vi);
+			byte *c = sample_nearest(sp, sw, sh, n, ui, vi+1);
+			byte *d = sample_nearest(sp, sw, sh, n, ui+1, vi+1);
+			int xa = bilerp(a[n1], b[n1], c[n1], d[n1], uf, vf);
+			int t;
+			xa = fz_mul255(xa, alpha);
+			t = 255 - xa;
+			for (k = 0; k < n1; k++)
+			{
+				int x = bilerp(a[k], b[k], c[k], d[k], uf, vf);
+				dp[k] = fz_mul255(x, alpha) + fz_mul255(dp[k], t);
+			}
+			dp[n1] = xa + fz_mul255(dp[n1], t);
+			if (hp)
+				hp[0] = xa + fz_mul255(hp[n1], t);
+		}
+		dp += n;
+		if (hp)
+			hp++;
+		u += fa;
+		v += fb;
+	}
+}
+
+/* Special case code for gray -> rgb */
+static inline void
+fz_paint_affine_alpha_g2rgb_lerp(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int alpha, byte *hp)
+{
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			int uf = u & 0xffff;
+			int vf = v & 0xffff;
+			byte *a = sample_nearest(sp, sw, sh, 2, ui, vi);
+			byte *b = sample_nearest(sp, sw, sh, 2, ui+1, vi);
+			byte *c = sample_nearest(sp, sw, sh, 2, ui, vi+1);
+			byte *d = sample_nearest(sp, sw, sh, 2, ui+1, vi+1);
+			int y = bilerp(a[1], b[1], c[1], d[1], uf, vf);
+			int x = bilerp(a[0], b[0], c[0], d[0], uf, vf);
+			int t;
+			x = fz_mul255(x, alpha);
+			y = fz_mul255(y, alpha);
+			t = 255 - y;
+			dp[0] = x + fz_mul255(dp[0], t);
+			dp[1] = x + fz_mul255(dp[1], t);
+			dp[2] = x + fz_mul255(dp[2], t);
+			dp[3] = y + fz_mul255(dp[3], t);
+			if (hp)
+				hp[0] = y + fz_mul255(hp[0], t);
+		}
+		dp += 4;
+		if (hp)
+			hp++;
+		u += fa;
+		v += fb;
+	}
+}
+
+static inline void
+fz_paint_affine_alpha_N_near(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, int alpha, byte *hp)
+{
+	int k;
+	int n1 = n-1;
+
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			byte *sample = sp + ((vi * sw + ui) * n);
+			int a = fz_mul255(sample[n-1], alpha);
+			int t = 255 - a;
+			for (k = 0; k < n1; k++)
+				dp[k] = fz_mul255(sample[k], alpha) + fz_mul255(dp[k], t);
+			dp[n1] = a + fz_mul255(dp[n1], t);
+			if (hp)
+				hp[0] = a + fz_mul255(hp[n1], t);
+		}
+		dp += n;
+		if (hp)
+			hp++;
+		u += fa;
+		v += fb;
+	}
+}
+
+static inline void
+fz_paint_affine_alpha_g2rgb_near(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int alpha, byte *hp)
+{
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			byte *sample = sp + ((vi * sw + ui) * 2);
+			int x = fz_mul255(sample[0], alpha);
+			int a = fz_mul255(sample[1], alpha);
+			int t = 255 - a;
+			dp[0] = x + fz_mul255(dp[0], t);
+			dp[1] = x + fz_mul255(dp[1], t);
+			dp[2] = x + fz_mul255(dp[2], t);
+			dp[3] = a + fz_mul255(dp[3], t);
+			if (hp)
+				hp[0] = a + fz_mul255(hp[0], t);
+		}
+		dp += 4;
+		if (hp)
+			hp++;
+		u += fa;
+		v += fb;
+	}
+}
+
+/* Blend premultiplied source image over destination */
+
+static inline void
+fz_paint_affine_N_lerp(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, byte *hp)
+{
+	int k;
+	int n1 = n-1;
+
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			int uf = u & 0xffff;
+			int vf = v & 0xffff;
+			byte *a = sample_nearest(sp, sw, sh, n, ui, vi);
+			byte *b = sample_nearest(sp, sw, sh, n, ui+1, vi);
+			byte *c = sample_nearest(sp, sw, sh, n, ui, vi+1);
+			byte *d = sample_nearest(sp, sw, sh, n, ui+1, vi+1);
+			int y = bilerp(a[n1], b[n1], c[n1], d[n1], uf, vf);
+			int t = 255 - y;
+			for (k = 0; k < n1; k++)
+			{
+				int x = bilerp(a[k], b[k], c[k], d[k], uf, vf);
+				dp[k] = x + fz_mul255(dp[k], t);
+			}
+			dp[n1] = y + fz_mul255(dp[n1], t);
+			if (hp)
+				hp[0] = y + fz_mul255(hp[0], t);
+		}
+		dp += n;
+		if (hp)
+			hp++;
+		u += fa;
+		v += fb;
+	}
+}
+
+static inline void
+fz_paint_affine_solid_g2rgb_lerp(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, byte *hp)
+{
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			int uf = u & 0xffff;
+			int vf = v & 0xffff;
+			byte *a = sample_nearest(sp, sw, sh, 2, ui, vi);
+			byte *b = sample_nearest(sp, sw, sh, 2, ui+1, vi);
+			byte *c = sample_nearest(sp, sw, sh, 2, ui, vi+1);
+			byte *d = sample_nearest(sp, sw, sh, 2, ui+1, vi+1);
+			int y = bilerp(a[1], b[1], c[1], d[1], uf, vf);
+			int t = 255 - y;
+			int x = bilerp(a[0], b[0], c[0], d[0], uf, vf);
+			dp[0] = x + fz_mul255(dp[0], t);
+			dp[1] = x + fz_mul255(dp[1], t);
+			dp[2] = x + fz_mul255(dp[2], t);
+			dp[3] = y + fz_mul255(dp[3], t);
+			if (hp)
+				hp[0] = y + fz_mul255(hp[0], t);
+		}
+		dp += 4;
+		if (hp)
+			hp++;
+		u += fa;
+		v += fb;
+	}
+}
+
+static inline void
+fz_paint_affine_N_near(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, byte *hp)
+{
+	int k;
+	int n1 = n-1;
+
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			byte *sample = sp + ((vi * sw + ui) * n);
+			int a = sample[n1];
+			int t = 255 - a;
+			for (k = 0; k < n1; k++)
+				dp[k] = sample[k] + fz_mul255(dp[k], t);
+			dp[n1] = a + fz_mul255(dp[n1], t);
+			if (hp)
+				hp[0] = a + fz_mul255(hp[0], t);
+		}
+		dp += n;
+		if (hp)
+			hp++;
+		u += fa;
+		v += fb;
+	}
+}
+
+static inline void
+fz_paint_affine_solid_g2rgb_near(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, byte *hp)
+{
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			byte *sample = sp + ((vi * sw + ui) * 2);
+			int x = sample[0];
+			int a = sample[1];
+			int t = 255 - a;
+			dp[0] = x + fz_mul255(dp[0], t);
+			dp[1] = x + fz_mul255(dp[1], t);
+			dp[2] = x + fz_mul255(dp[2], t);
+			dp[3] = a + fz_mul255(dp[3], t);
+			if (hp)
+				hp[0] = a + fz_mul255(hp[0], t);
+		}
+		dp += 4;
+		if (hp)
+			hp++;
+		u += fa;
+		v += fb;
+	}
+}
+
+/* Blend non-premultiplied color in source image mask over destination */
+
+static inline void
+fz_paint_affine_color_N_lerp(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, byte *color, byte *hp)
+{
+	int n1 = n - 1;
+	int sa = color[n1];
+	int k;
+
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			int uf = u & 0xffff;
+			int vf = v & 0xffff;
+			byte *a = sample_nearest(sp, sw, sh, 1, ui, vi);
+			byte *b = sample_nearest(sp, sw, sh, 1, ui+1, vi);
+			byte *c = sample_nearest(sp, sw, sh, 1, ui, vi+1);
+			byte *d = sample_nearest(sp, sw, sh, 1, ui+1, vi+1);
+			int ma = bilerp(a[0], b[0], c[0], d[0], uf, vf);
+			int masa = FZ_COMBINE(FZ_EXPAND(ma), sa);
+			for (k = 0; k < n1; k++)
+				dp[k] = FZ_BLEND(color[k], dp[k], masa);
+			dp[n1] = FZ_BLEND(255, dp[n1], masa);
+			if (hp)
+				hp[0] = FZ_BLEND(255, hp[0], masa);
+		}
+		dp += n;
+		if (hp)
+			hp++;
+		u += fa;
+		v += fb;
+	}
+}
+
+static inline void
+fz_paint_affine_color_N_near(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, byte *color, byte *hp)
+{
+	int n1 = n-1;
+	int sa = color[n1];
+	int k;
+
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			int ma = sp[vi * sw + ui];
+			int masa = FZ_COMBINE(FZ_EXPAND(ma), sa);
+			for (k = 0; k < n1; k++)
+				dp[k] = FZ_BLEND(color[k], dp[k], masa);
+			dp[n1] = FZ_BLEND(255, dp[n1], masa);
+			if (hp)
+				hp[n1] = FZ_BLEND(255, hp[n1], masa);
+		}
+		dp += n;
+		if (hp)
+			hp++;
+		u += fa;
+		v += fb;
+	}
+}
+
+static void
+fz_paint_affine_lerp(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, int alpha, byte *color/*unused*/, byte *hp)
+{
+	if (alpha == 255)
+	{
+		switch (n)
+		{
+		case 1: fz_paint_affine_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 1, hp); break;
+		case 2: fz_paint_affine_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 2, hp); break;
+		case 4: fz_paint_affine_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 4, hp); break;
+		default: fz_paint_affine_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, n, hp); break;
+		}
+	}
+	else if (alpha > 0)
+	{
+		switch (n)
+		{
+		case 1: fz_paint_affine_alpha_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 1, alpha, hp); break;
+		case 2: fz_paint_affine_alpha_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 2, alpha, hp); break;
+		case 4: fz_paint_affine_alpha_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 4, alpha, hp); break;
+		default: fz_paint_affine_alpha_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, n, alpha, hp); break;
+		}
+	}
+}
+
+static void
+fz_paint_affine_g2rgb_lerp(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, int alpha, byte *color/*unused*/, byte *hp)
+{
+	if (alpha == 255)
+	{
+		fz_paint_affine_solid_g2rgb_lerp(dp, sp, sw, sh, u, v, fa, fb, w, hp);
+	}
+	else if (alpha > 0)
+	{
+		fz_paint_affine_alpha_g2rgb_lerp(dp, sp, sw, sh, u, v, fa, fb, w, alpha, hp);
+	}
+}
+
+static void
+fz_paint_affine_near(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, int alpha, byte *color/*unused */, byte *hp)
+{
+	if (alpha == 255)
+	{
+		switch (n)
+		{
+		case 1: fz_paint_affine_N_near(dp, sp, sw, sh, u, v, fa, fb, w, 1, hp); break;
+		case 2: fz_paint_affine_N_near(dp, sp, sw, sh, u, v, fa, fb, w, 2, hp); break;
+		case 4: fz_paint_affine_N_near(dp, sp, sw, sh, u, v, fa, fb, w, 4, hp); break;
+		default: fz_paint_affine_N_near(dp, sp, sw, sh, u, v, fa, fb, w, n, hp); break;
+		}
+	}
+	else if (alpha > 0)
+	{
+		switch (n)
+		{
+		case 1: fz_paint_affine_alpha_N_near(dp, sp, sw, sh, u, v, fa, fb, w, 1, alpha, hp); break;
+		case 2: fz_paint_affine_alpha_N_near(dp, sp, sw, sh, u, v, fa, fb, w, 2, alpha, hp); break;
+		case 4: fz_paint_affine_alpha_N_near(dp, sp, sw, sh, u, v, fa, fb, w, 4, alpha, hp); break;
+		default: fz_paint_affine_alpha_N_near(dp, sp, sw, sh, u, v, fa, fb, w, n, alpha, hp); break;
+		}
+	}
+}
+
+static void
+fz_paint_affine_g2rgb_near(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, int alpha, byte *color/*unused*/, byte *hp)
+{
+	if (alpha == 255)
+	{
+		fz_paint_affine_solid_g2rgb_near(dp, sp, sw, sh, u, v, fa, fb, w, hp);
+	}
+	else if (alpha > 0)
+	{
+		fz_paint_affine_alpha_g2rgb_near(dp, sp, sw, sh, u, v, fa, fb, w, alpha, hp);
+	}
+}
+
+static void
+fz_paint_affine_color_lerp(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, int alpha/*unused*/, byte *color, byte *hp)
+{
+	switch (n)
+	{
+	case 2: fz_paint_affine_color_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 2, color, hp); break;
+	case 4: fz_paint_affine_color_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 4, color, hp); break;
+	default: fz_paint_affine_color_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, n, color, hp); break;
+	}
+}
+
+static void
+fz_paint_affine_color_near(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, int alpha/*unused*/, byte *color, byte *hp)
+{
+	switch (n)
+	{
+	case 2: fz_paint_affine_color_N_near(dp, sp, sw, sh, u, v, fa, fb, w, 2, color, hp); break;
+	case 4: fz_paint_affine_color_N_near(dp, sp, sw, sh, u, v, fa, fb, w, 4, color, hp); break;
+	default: fz_paint_affine_color_N_near(dp, sp, sw, sh, u, v, fa, fb, w, n, color, hp); break;
+	}
+}
+
+/* RJW: The following code was originally written to be sensitive to
+ * FLT_EPSILON. Given the way the 'minimum representable difference'
+ * between 2 floats changes size as we scale, we now pick a larger
+ * value to ensure idempotency even with rounding problems. The
+ * value we pick is still far smaller than would ever show up with
+ * antialiasing.
+ */
+#define MY_EPSILON 0.001
+
+void
+fz_gridfit_matrix(fz_matrix *m)
+{
+	if (fabsf(m->b) < FLT_EPSILON && fabsf(m->c) < FLT_EPSILON)
+	{
+		if (m->a > 0)
+		{
+			float f;
+			/* Adjust left hand side onto pixel boundary */
+			f = (float)(int)(m->e);
+			if (f - m->e > MY_EPSILON)
+				f -= 1.0; /* Ensure it moves left */
+			m->a += m->e - f; /* width gets wider as f <= m->e */
+			m->e = f;
+			/* Adjust right hand side onto pixel boundary */
+			f = (float)(int)(m->a);
+			if (m->a - f > MY_EPSILON)
+				f += 1.0; /* Ensure it moves right */
+			m->a = f;
+		}
+		else if (m->a < 0)
+		{
+			float f;
+			/* Adjust right hand side onto pixel boundary */
+			f = (float)(int)(m->e);
+			if (m->e - f > MY_EPSILON)
+				f += 1.0; /* Ensure it moves right */
+			m->a += m->e - f; /* width gets wider (more -ve) */
+			m->e = f;
+			/* Adjust left hand side onto pixel boundary */
+			f = (float)(int)(m->a);
+			if (f - m->a > MY_EPSILON)
+				f -= 1.0; /* Ensure it moves left */
+			m->a = f;
+		}
+		if (m->d > 0)
+		{
+			float f;
+			/* Adjust top onto pixel boundary */
+			f = (float)(int)(m->f);
+			if (f - m->f > MY_EPSILON)
+				f -= 1.0; /* Ensure it moves upwards */
+			m->d += m->f - f; /* width gets wider as f <= m->f */
+			m->f = f;
+			/* Adjust bottom onto pixel boundary */
+			f = (float)(int)(m->d);
+			if (m->d - f > MY_EPSILON)
+				f += 1.0; /* Ensure it moves down */
+			m->d = f;
+		}
+		else if (m->d < 0)
+		{
+			float f;
+			/* Adjust bottom onto pixel boundary */
+			f = (float)(int)(m->f);
+			if (m->f - f > MY_EPSILON)
+				f += 1.0; /* Ensure it moves down */
+			m->d += m->f - f; /* width gets wider (more -ve) */
+			m->f = f;
+			/* Adjust top onto pixel boundary */
+			f = (float)(int)(m->d);
+			if (f - m->d > MY_EPSILON)
+				f -= 1.0; /* Ensure it moves up */
+			m->d = f;
+		}
+	}
+	else if (fabsf(m->a) < FLT_EPSILON && fabsf(m->d) < FLT_EPSILON)
+	{
+		if (m->b > 0)
+		{
+			float f;
+			/* Adjust left hand side onto pixel boundary */
+			f = (float)(int)(m->f);
+			if (f - m->f > MY_EPSILON)
+				f -= 1.0; /* Ensure it moves left */
+			m->b += m->f - f; /* width gets wider as f <= m->f */
+			m->f = f;
+			/* Adjust right hand side onto pixel boundary */
+			f = (float)(int)(m->b);
+			if (m->b - f > MY_EPSILON)
+				f += 1.0; /* Ensure it moves right */
+			m->b = f;
+		}
+		else if (m->b < 0)
+		{
+			float f;
+			/* Adjust right hand side onto pixel boundary */
+			f = (float)(int)(m->f);
+			if (m->f - f > MY_EPSILON)
+				f += 1.0; /* Ensure it moves right */
+			m->b += m->f - f; /* width gets wider (more -ve) */
+			m->f = f;
+			/* Adjust left hand side onto pixel boundary */
+			f = (float)(int)(m->b);
+			if (f - m->b > MY_EPSILON)
+				f -= 1.0; /* Ensure it moves left */
+			m->b = f;
+		}
+		if (m->c > 0)
+		{
+			float f;
+			/* Adjust top onto pixel boundary */
+			f = (float)(int)(m->e);
+			if (f - m->e > MY_EPSILON)
+				f -= 1.0; /* Ensure it moves upwards */
+			m->c += m->e - f; /* width gets wider as f <= m->e */
+			m->e = f;
+			/* Adjust bottom onto pixel boundary */
+			f = (float)(int)(m->c);
+			if (m->c - f > MY_EPSILON)
+				f += 1.0; /* Ensure it moves down */
+			m->c = f;
+		}
+		else if (m->c < 0)
+		{
+			float f;
+			/* Adjust bottom onto pixel boundary */
+			f = (float)(int)(m->e);
+			if (m->e - f > MY_EPSILON)
+				f += 1.0; /* Ensure it moves down */
+			m->c += m->e - f; /* width gets wider (more -ve) */
+			m->e = f;
+			/* Adjust top onto pixel boundary */
+			f = (float)(int)(m->c);
+			if (f - m->c > MY_EPSILON)
+				f -= 1.0; /* Ensure it moves up */
+			m->c = f;
+		}
+	}
+}
+
+/*
+ * Axis-aligned images (fb == 0 and fc == 0, which is nearly every image)
+ * are painted a row at a time. The source columns are found once for the
+ * whole image, each row is sampled into a scratch buffer (or, for 1:1
+ * blits, used in place) and then composited with a row painter. The
+ * arithmetic is the same as in the per-pixel painters above, so the
+ * results are identical.
+ *
+ * The row painters have SIMD versions for 1, 2 and 4 components, installed
+ * by fz_accelerate_arch() (see apv_draw_simd.c).
+ */
+
+void (*fz_paint_affine_row_simd)(byte * restrict dp, byte * restrict sp, int n, int w, int alpha) = NULL;
+void (*fz_paint_affine_color_row_simd)(byte * restrict dp, byte * restrict mp, int n, int w, byte *color) = NULL;
+
+#define FZ_SIMD_N(n) ((n) == 1 || (n) == 2 || (n) == 4)
+
+/* Blend premultiplied samples in constant alpha over destination */
+static inline void
+fz_paint_affine_row_N(byte * restrict dp, byte * restrict sp, int n, int w, int alpha)
+{
+	int k;
+	int n1 = n - 1;
+
+	if (alpha == 255)
+	{
+		while (w--)
+		{
+			int t = 255 - sp[n1];
+			for (k = 0; k < n; k++)
+				dp[k] = sp[k] + fz_mul255(dp[k], t);
+			dp += n;
+			sp += n;
+		}
+	}
+	else
+	{
+		while (w--)
+		{
+			int t = 255 - fz_mul255(sp[n1], alpha);
+			for (k = 0; k < n; k++)
+				dp[k] = fz_mul255(sp[k], alpha) + fz_mul255(dp[k], t);
+			dp += n;
+			sp += n;
+		}
+	}
+}
+
+static void
+fz_paint_affine_row(byte * restrict dp, byte * restrict sp, int n, int w, int alpha)
+{
+	if (fz_paint_affine_row_simd && FZ_SIMD_N(n))
+	{
+		fz_paint_affine_row_simd(dp, sp, n, w, alpha);
+		return;
+	}
+
+	switch (n)
+	{
+	case 1: fz_paint_affine_row_N(dp, sp, 1, w, alpha); break;
+	case 2: fz_paint_affine_row_N(dp, sp, 2, w, alpha); break;
+	case 4: fz_paint_affine_row_N(dp, sp, 4, w, alpha); break;
+	default: fz_paint_affine_row_N(dp, sp, n, w, alpha); break;
+	}
+}
+
+/* Gather the samples of one image row at the given offsets */
+static inline void
+fz_sample_row_N(byte * restrict bp, byte * restrict row, int *x0, int w, int n)
+{
+	int k;
+	while (w--)
+	{
+		byte *s = row + *x0++;
+		for (k = 0; k < n; k++)
+			*bp++ = s[k];
+	}
+}
+
+/* Same, with a constant step between offsets */
+static inline void
+fz_sample_row_step_N(byte * restrict bp, byte * restrict s, int step, int w, int n)
+{
+	int k;
+	while (w--)
+	{
+		for (k = 0; k < n; k++)
+			*bp++ = s[k];
+		s += step;
+	}
+}
+
+static void
+fz_sample_row(byte * restrict bp, byte * restrict row, int *x0, int w, int n, int g2rgb)
+{
+	if (g2rgb)
+	{
+		while (w--)
+		{
+			byte *s = row + *x0++;
+			*bp++ = s[0];
+			*bp++ = s[0];
+			*bp++ = s[0];
+			*bp++ = s[1];
+		}
+		return;
+	}
+
+	switch (n)
+	{
+	case 1: fz_sample_row_N(bp, row, x0, w, 1); break;
+	case 2: fz_sample_row_N(bp, row, x0, w, 2); break;
+	case 4: fz_sample_row_N(bp, row, x0, w, 4); break;
+	default: fz_sample_row_N(bp, row, x0, w, n); break;
+	}
+}
+
+static void
+fz_sample_row_step(byte * restrict bp, byte * restrict s, int step, int w, int n)
+{
+	switch (n)
+	{
+	case 1: fz_sample_row_step_N(bp, s, step, w, 1); break;
+	case 2: fz_sample_row_step_N(bp, s, step, w, 2); break;
+	case 4: fz_sample_row_step_N(bp, s, step, w, 4); break;
+	default: fz_sample_row_step_N(bp, s, step, w, n); break;
+	}
+}
+
+/* Bilinear samples of one image row, between rows a and b */
+static void
+fz_sample_row_lerp(byte * restrict bp, byte *a, byte *b, int *x0, int *x1, int *uf, int vf, int w, int n, int g2rgb)
+{
+	int i, k, x;
+	for (i = 0; i < w; i++)
+	{
+		for (k = 0; k < n; k++)
+		{
+			x = bilerp(a[x0[i] + k], a[x1[i] + k], b[x0[i] + k], b[x1[i] + k], uf[i], vf);
+			if (k == 0 && g2rgb)
+			{
+				*bp++ = x;
+				*bp++ = x;
+			}
+			*bp++ = x;
+		}
+	}
+}
+
+/* Blend non-premultiplied color in mask samples over destination */
+static void
+fz_paint_affine_color_row(byte * restrict dp, byte * restrict mp, int n, int w, byte *color)
+{
+	int n1 = n - 1;
+	int sa = color[n1];
+	int k;
+
+	if (fz_paint_affine_color_row_simd && FZ_SIMD_N(n))
+	{
+		fz_paint_affine_color_row_simd(dp, mp, n, w, color);
+		return;
+	}
+
+	while (w--)
+	{
+		int ma = *mp++;
+		int masa = FZ_COMBINE(FZ_EXPAND(ma), sa);
+		for (k = 0; k < n1; k++)
+			dp[k] = FZ_BLEND(color[k], dp[k], masa);
+		dp[n1] = FZ_BLEND(255, dp[n1], masa);
+		dp += n;
+	}
+}
+
+static void
+fz_paint_image_rows(byte *dp, int dw, int n, fz_pixmap *img, int u, int v, int fa, int fd, int w, int h, int dolerp, int alpha, byte *color)
+{
+	int sw = img->w;
+	int sh = img->h;
+	int sn = img->n;
+	int bn = (sn == 2 && n == 4) ? 4 : sn; /* gray is expanded to rgb */
+	int step = (fa >> 16) * sn;
+	int *x0, *x1, *uf;
+	byte *buf;
+	int i, i0, i1;
+
+	if (w <= 0 || h <= 0 || (!color && alpha == 0))
+		return;
+
+	/* The source column only depends on the destination column. The
+	 * columns inside the image are [i0, i1), as u moves monotonically. */
+	x0 = fz_calloc(w * 3, sizeof(int));
+	x1 = x0 + w;
+	uf = x1 + w;
+	i0 = i1 = 0;
+	for (i = 0; i < w; i++, u += fa)
+	{
+		int ui = u >> 16;
+		if (ui < 0 || ui >= sw)
+			continue;
+		if (i1 == 0)
+			i0 = i;
+		i1 = i + 1;
+		x0[i] = ui * sn;
+		x1[i] = MIN(ui + 1, sw - 1) * sn;
+		uf[i] = u & 0xffff;
+	}
+	w = i1 - i0;
+	if (w <= 0)
+	{
+		fz_free(x0);
+		return;
+	}
+	x0 += i0;
+	x1 += i0;
+	uf += i0;
+	dp += i0 * n;
+
+	buf = fz_calloc(w, bn);
+
+	while (h--)
+	{
+		int vi = v >> 16;
+		if (vi >= 0 && vi < sh)
+		{
+			byte *row = img->samples + vi * sw * sn;
+			byte *sp = buf;
+
+			if (dolerp)
+			{
+				byte *row1 = img->samples + MIN(vi + 1, sh - 1) * sw * sn;
+				fz_sample_row_lerp(buf, row, row1, x0, x1, uf, v & 0xffff, w, sn, bn != sn);
+			}
+			else if (bn == sn && step == sn && (fa & 0xffff) == 0)
+			{
+				/* 1:1 blit straight from the image */
+				sp = row + x0[0];
+			}
+			else if (bn == sn && (fa & 0xffff) == 0)
+			{
+				/* integer downscale */
+				fz_sample_row_step(buf, row + x0[0], step, w, sn);
+			}
+			else
+			{
+				fz_sample_row(buf, row, x0, w, sn, bn != sn);
+			}
+
+			if (color)
+				fz_paint_affine_color_row(dp, sp, n, w, color);
+			else
+				fz_paint_affine_row(dp, sp, n, w, alpha);
+		}
+		dp += dw;
+		v += fd;
+	}
+
+	fz_free(buf);
+	fz_free(x0 - i0);
+}
+
+/* Draw an image with an affine transform on destination */
+
+static void
+fz_paint_image_imp(fz_pixmap *dst, fz_bbox scissor, fz_pixmap *shape, fz_pixmap *img, fz_matrix ctm, byte *color, int alpha)
+{
+	byte *dp, *sp, *hp;
+	int u, v, fa, fb, fc, fd;
+	int x, y, w, h;
+	int sw, sh, n, hw;
+	fz_matrix inv;
+	fz_bbox bbox;
+	int dolerp;
+	void (*paintfn)(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int n, int alpha, byte *color, byte *hp);
+
+	/* grid fit the image */
+	fz_gridfit_matrix(&ctm);
+
+	/* turn on interpolation for upscaled and non-rectilinear transforms */
+	dolerp = 0;
+	if (!fz_is_rectilinear(ctm))
+		dolerp = 1;
+	if (sqrtf(ctm.a * ctm.a + ctm.b * ctm.b) > img->w)
+		dolerp = 1;
+	if (sqrtf(ctm.c * ctm.c + ctm.d * ctm.d) > img->h)
+		dolerp = 1;
+
+	/* except when we shouldn't, at large magnifications */
+	if (!img->interpolate)
+	{
+		if (sqrtf(ctm.a * ctm.a + ctm.b * ctm.b) > img->w * 2)
+			dolerp = 0;
+		if (sqrtf(ctm.c * ctm.c + ctm.d * ctm.d) > img->h * 2)
+			dolerp = 0;
+	}
+
+	bbox = fz_round_rect(fz_transform_rect(ctm, fz_unit_rect));
+	bbox = fz_intersect_bbox(bbox, scissor);
+	x = bbox.x0;
+	y = bbox.y0;
+	w = bbox.x1 - bbox.x0;
+	h = bbox.y1 - bbox.y0;
+
+	/* map from screen space (x,y) to image space (u,v) */
+	inv = fz_scale(1.0f / img->w, -1.0f / img->h);
+	inv = fz_concat(inv, fz_translate(0, 1));
+	inv = fz_concat(inv, ctm);
+	inv = fz_invert_matrix(inv);
+
+	fa = inv.a * 65536;
+	fb = inv.b * 65536;
+	fc = inv.c * 65536;
+	fd = inv.d * 65536;
+
+	/* Calculate initial texture positions. Do a half step to start. */
+	u = (fa * x) + (fc * y) + inv.e * 65536 + ((fa + fc) >> 1);
+	v = (fb * x) + (fd * y) + inv.f * 65536 + ((fb + fd) >> 1);
+
+	/* RJW: The following is voodoo. No idea why it works, but it gives
+	 * the best match between scaled/unscaled/interpolated/non-interpolated
+	 * that we have found. */
+	if (dolerp) {
+		u -= 32768;
+		v -= 32768;
+	}
+
+	dp = dst->samples + ((y - dst->y) * dst->w + (x - dst->x)) * dst->n;
+	n = dst->n;
+	sp = img->samples;
+	sw = img->w;
+	sh = img->h;
+	if (shape)
+	{
+		hw = shape->w;
+		hp = shape->samples + ((y - shape->y) * hw) + x - dst->x;
+	}
+	else
+	{
+		hw = 0;
+		hp = NULL;
+	}
+
+	if (fb == 0 && fc == 0 && !hp)
+	{
+		fz_paint_image_rows(dp, dst->w * n, n, img, u, v, fa, fd, w, h, dolerp, alpha, color);
+		return;
+	}
+
+	if (dst->n == 4 && img->n == 2)
+	{
+		assert(color == NULL);
+		if (dolerp)
+			paintfn = fz_paint_affine_g2rgb_lerp;
+		else
+			paintfn = fz_paint_affine_g2rgb_near;
+	}
+	else
+	{
+		if (dolerp)
+		{
+			if (color)
+				paintfn = fz_paint_affine_color_lerp;
+			else
+				paintfn = fz_paint_affine_lerp;
+		}
+		else
+		{
+			if (color)
+				paintfn = fz_paint_affine_color_near;
+			else
+				paintfn = fz_paint_affine_near;
+		}
+	}
+
+	while (h--)
+	{
+		paintfn(dp, sp, sw, sh, u, v, fa, fb, w, n, alpha, color, hp);
+		dp += dst->w * n;
+		hp += hw;
+		u += fc;
+		v += fd;
+	}
+}
+
+void
+fz_paint_image_with_color(fz_pixmap *dst, fz_bbox scissor, fz_pixmap *shape, fz_pixmap *img, fz_matrix ctm, byte *color)
+{
+	assert(img->n == 1);
+	fz_paint_image_imp(dst, scissor, shape, img, ctm, color, 255);
+}
+
+void
+fz_paint_image(fz_pixmap *dst, fz_bbox scissor, fz_pixmap *shape, fz_pixmap *img, fz_matrix ctm, int alpha)
+{
+	assert(dst->n == img->n || (dst->n == 4 && img->n == 2));
+	fz_paint_image_imp(dst, scissor, shape, img, ctm, NULL, alpha);
+}
@@ -0,0 +1,250 @@
+
+/*
+ * This is a modified version of draw_glyph.c file which is part of MuPDF
+ * by Artifex Software, Inc.
+ * Adds fz_glyph_cache_size, used by APV to account memory held by the glyph cache.
+ * Glyph positions are quantized to fewer subpixel phases, cache is kept within
+ * byte budget by dropping least recently used glyphs instead of flushing it,
+ * and hits and misses are counted. Anti-aliasing level is part of the key,
+ * so glyphs rendered in draft quality are not reused in full quality.
+ */
+
+#include "fitz.h"
+
+#define MAX_FONT_SIZE 1000
+#define MAX_GLYPH_SIZE 256
+#define MAX_CACHE_SIZE (1024*1024)
+
+/* glyphs up to this size get 4 subpixel phases in each direction, up to twice that 2, bigger ones none */
+#define SUBPIX_SIZE 24
+
+typedef struct fz_glyph_key_s fz_glyph_key;
+typedef struct fz_glyph_entry_s fz_glyph_entry;
+
+struct fz_glyph_cache_s
+{
+	fz_hash_table *hash;
+	fz_glyph_entry *head; /* most recently used */
+	fz_glyph_entry *tail; /* least recently used */
+	int total;
+	int budget;
+	int hits;
+	int misses;
+};
+
+struct fz_glyph_key_s
+{
+	fz_font *font;
+	int a, b;
+	int c, d;
+	unsigned short gid;
+	unsigned char e, f;
+	unsigned char aa;
+};
+
+struct fz_glyph_entry_s
+{
+	fz_glyph_key key;
+	fz_pixmap *val;
+	int size;
+	fz_glyph_entry *prev, *next;
+};
+
+fz_glyph_cache *
+fz_new_glyph_cache(void)
+{
+	fz_glyph_cache *cache;
+
+	cache = fz_malloc(sizeof(fz_glyph_cache));
+	cache->hash = fz_new_hash_table(509, sizeof(fz_glyph_key));
+	cache->head = NULL;
+	cache->tail = NULL;
+	cache->total = 0;
+	cache->budget = MAX_CACHE_SIZE;
+	cache->hits = 0;
+	cache->misses = 0;
+
+	return cache;
+}
+
+static void
+fz_unlink_glyph(fz_glyph_cache *cache, fz_glyph_entry *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		cache->head = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		cache->tail = entry->prev;
+}
+
+static void
+fz_link_glyph(fz_glyph_cache *cache, fz_glyph_entry *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+	if (cache->head)
+		cache->head->prev = entry;
+	else
+		cache->tail = entry;
+	cache->head = entry;
+}
+
+static void
+fz_evict_glyph(fz_glyph_cache *cache, fz_glyph_entry *entry)
+{
+	fz_unlink_glyph(cache, entry);
+	fz_hash_remove(cache->hash, &entry->key);
+	cache->total -= entry->size;
+	fz_drop_font(entry->key.font);
+	fz_drop_pixmap(entry->val);
+	fz_free(entry);
+}
+
+/*
+ * Drop least recently used glyphs until at most size bytes are held.
+ */
+void
+fz_trim_glyph_cache(fz_glyph_cache *cache, int size)
+{
+	while (cache->tail && cache->total > size)
+		fz_evict_glyph(cache, cache->tail);
+}
+
+/*
+ * Set number of bytes rendered glyphs may take, 0 restores the default.
+ */
+void
+fz_set_glyph_cache_budget(fz_glyph_cache *cache, int budget)
+{
+	cache->budget = budget > 0 ? budget : MAX_CACHE_SIZE;
+	fz_trim_glyph_cache(cache, cache->budget);
+}
+
+/*
+ * Get number of bytes held by rendered glyphs.
+ */
+int
+fz_glyph_cache_size(fz_glyph_cache *cache)
+{
+	return cache->total;
+}
+
+/*
+ * Get number of lookups that found the glyph already rendered, and that did not.
+ */
+void
+fz_glyph_cache_stats(fz_glyph_cache *cache, int *hits, int *misses)
+{
+	*hits = cache->hits;
+	*misses = cache->misses;
+}
+
+void
+fz_free_glyph_cache(fz_glyph_cache *cache)
+{
+	fz_trim_glyph_cache(cache, 0);
+	fz_free_hash(cache->hash);
+	fz_free(cache);
+}
+
+fz_pixmap *
+fz_render_stroked_glyph(fz_glyph_cache *cache, fz_font *font, int gid, fz_matrix trm, fz_matrix ctm, fz_stroke_state *stroke)
+{
+	if (font->ft_face)
+		return fz_render_ft_stroked_glyph(font, gid, trm, ctm, stroke);
+	return fz_render_glyph(cache, font, gid, trm, NULL);
+}
+
+fz_pixmap *
+fz_render_glyph(fz_glyph_cache *cache, fz_font *font, int gid, fz_matrix ctm, fz_colorspace *model)
+{
+	fz_glyph_key key;
+	fz_glyph_entry *entry;
+	fz_pixmap *val;
+	float size = fz_matrix_expansion(ctm);
+	int subpix;
+
+	if (size > MAX_FONT_SIZE)
+	{
+		/* TODO: this case should be handled by rendering glyph as a path fill */
+		fz_warn("font size too large (%g), not rendering glyph", size);
+		return NULL;
+	}
+
+	memset(&key, 0, sizeof key);
+	key.font = font;
+	key.gid = gid;
+	key.a = ctm.a * 65536;
+	key.b = ctm.b * 65536;
+	key.c = ctm.c * 65536;
+	key.d = ctm.d * 65536;
+	key.aa = fz_get_aa_level();
+
+	/*
+	 * Draw device places glyph at integer part of its origin, so phases are
+	 * rounded down. Small glyphs keep 4 phases, bigger ones less, since their
+	 * shapes don't depend on them so much and they take more space in cache.
+	 */
+	if (size <= SUBPIX_SIZE)
+		subpix = 0xc0;
+	else if (size <= SUBPIX_SIZE * 2)
+		subpix = 0x80;
+	else
+		subpix = 0;
+	key.e = (int)((ctm.e - floorf(ctm.e)) * 256) & subpix;
+	key.f = (int)((ctm.f - floorf(ctm.f)) * 256) & subpix;
+
+	entry = fz_hash_find(cache->hash, &key);
+	if (entry)
+	{
+		cache->hits++;
+		if (entry != cache->head)
+		{
+			fz_unlink_glyph(cache, entry);
+			fz_link_glyph(cache, entry);
+		}
+		return fz_keep_pixmap(entry->val);
+	}
+	cache->misses++;
+
+	ctm.e = floorf(ctm.e) + key.e / 256.0f;
+	ctm.f = floorf(ctm.f) + key.f / 256.0f;
+
+	if (font->ft_face)
+	{
+		val = fz_render_ft_glyph(font, gid, ctm);
+	}
+	else if (font->t3procs)
+	{
+		val = fz_render_t3_glyph(font, gid, ctm, model);
+	}
+	else
+	{
+		fz_warn("assert: uninitialized font structure");
+		return NULL;
+	}
+
+	if (val)
+	{
+		if (val->w < MAX_GLYPH_SIZE && val->h < MAX_GLYPH_SIZE &&
+			val->w * val->h * val->n <= cache->budget)
+		{
+			entry = fz_malloc(sizeof(fz_glyph_entry));
+			entry->key = key;
+			entry->val = fz_keep_pixmap(val);
+			entry->size = val->w * val->h * val->n;
+			fz_trim_glyph_cache(cache, cache->budget - entry->size);
+			fz_keep_font(key.font);
+			fz_hash_insert(cache->hash, &entry->key, entry);
+			fz_link_glyph(cache, entry);
+			cache->total += entry->size;
+			return val;
+		}
+		return val;
+	}
+
+	return NULL;
+}
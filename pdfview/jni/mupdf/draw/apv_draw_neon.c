@@ -0,0 +1,679 @@
+/*
+ * NEON versions of the span painters from apv_draw_paint.c, the image
+ * row painters from apv_draw_affine.c and the separable blend modes from
+ * apv_draw_blend.c, for pixmaps with 1, 2 and 4 components. Installed by fz_accelerate_arch() (apv_draw_simd.c) when the
+ * CPU has NEON; this file is only built for armeabi-v7a.
+ *
+ * Eight pixels are done at a time, with one vector per component. The
+ * arithmetic is the same as in the C code, including its truncations, so
+ * the results are identical. A short tail is copied to a scratch buffer,
+ * so that loads and stores never go past the end of the span.
+ */
+
+#include "fitz.h"
+
+#include <arm_neon.h>
+
+typedef unsigned char byte;
+
+static inline void
+load8(const byte *p, int n, uint8x8_t *v)
+{
+	uint8x8x2_t v2;
+	uint8x8x4_t v4;
+
+	switch (n)
+	{
+	case 1:
+		v[0] = vld1_u8(p);
+		break;
+	case 2:
+		v2 = vld2_u8(p);
+		v[0] = v2.val[0];
+		v[1] = v2.val[1];
+		break;
+	case 4:
+		v4 = vld4_u8(p);
+		v[0] = v4.val[0];
+		v[1] = v4.val[1];
+		v[2] = v4.val[2];
+		v[3] = v4.val[3];
+		break;
+	}
+}
+
+static inline void
+store8(byte *p, int n, const uint8x8_t *v)
+{
+	uint8x8x2_t v2;
+	uint8x8x4_t v4;
+
+	switch (n)
+	{
+	case 1:
+		vst1_u8(p, v[0]);
+		break;
+	case 2:
+		v2.val[0] = v[0];
+		v2.val[1] = v[1];
+		vst2_u8(p, v2);
+		break;
+	case 4:
+		v4.val[0] = v[0];
+		v4.val[1] = v[1];
+		v4.val[2] = v[2];
+		v4.val[3] = v[3];
+		vst4_u8(p, v4);
+		break;
+	}
+}
+
+/* FZ_EXPAND, widened to 16 bits */
+static inline uint16x8_t
+expand8(uint8x8_t a)
+{
+	return vaddl_u8(a, vshr_n_u8(a, 7));
+}
+
+/* FZ_COMBINE with b <= 256 */
+static inline uint16x8_t
+combine8(uint8x8_t a, uint16x8_t b)
+{
+	return vshrq_n_u16(vmulq_u16(vmovl_u8(a), b), 8);
+}
+
+/* FZ_BLEND with amount <= 256; the result is in 0..255*256, so it can be
+ * computed modulo 2^16 */
+static inline uint8x8_t
+blend8(uint8x8_t src, uint8x8_t dst, uint16x8_t amount)
+{
+	uint16x8_t t = vmlaq_u16(vshll_n_u8(dst, 8), vsubl_u8(src, dst), amount);
+	return vshrn_n_u16(t, 8);
+}
+
+/* fz_mul255 */
+static inline uint8x8_t
+mul255_8(uint8x8_t a, uint8x8_t b)
+{
+	uint16x8_t t = vmull_u8(a, b);
+	return vraddhn_u16(t, vrshrq_n_u16(t, 8));
+}
+
+/* Solid color */
+
+static inline void
+paint_solid_color8(byte * restrict dp, int n, uint8x8_t *c, uint16x8_t ma)
+{
+	uint8x8_t d[4];
+	int k;
+
+	load8(dp, n, d);
+	for (k = 0; k < n; k++)
+		d[k] = blend8(c[k], d[k], ma);
+	store8(dp, n, d);
+}
+
+static inline void
+paint_solid_color_n(byte * restrict dp, int n, int w, byte *color)
+{
+	byte buf[8 * 4];
+	uint8x8_t c[4];
+	uint16x8_t ma;
+	int k;
+
+	for (k = 0; k < n - 1; k++)
+		c[k] = vdup_n_u8(color[k]);
+	c[k] = vdup_n_u8(255);
+	ma = vdupq_n_u16(FZ_COMBINE(FZ_EXPAND(255), FZ_EXPAND(color[n - 1])));
+
+	for (; w >= 8; w -= 8)
+	{
+		paint_solid_color8(dp, n, c, ma);
+		dp += 8 * n;
+	}
+	if (w > 0)
+	{
+		memcpy(buf, dp, w * n);
+		paint_solid_color8(buf, n, c, ma);
+		memcpy(dp, buf, w * n);
+	}
+}
+
+void
+fz_paint_solid_color_neon(byte * restrict dp, int n, int w, byte *color)
+{
+	switch (n)
+	{
+	case 1: paint_solid_color_n(dp, 1, w, color); break;
+	case 2: paint_solid_color_n(dp, 2, w, color); break;
+	case 4: paint_solid_color_n(dp, 4, w, color); break;
+	}
+}
+
+/* Non-premultiplied color in mask over destination */
+
+static inline void
+paint_span_with_color8(byte * restrict dp, const byte * restrict mp, int n, uint8x8_t *c, uint16x4_t sa)
+{
+	uint8x8_t d[4];
+	uint16x8_t ma;
+	int k;
+
+	ma = expand8(vld1_u8(mp));
+	/* FZ_EXPAND(255) * FZ_EXPAND(255) does not fit in 16 bits */
+	ma = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(ma), sa), 8),
+		vshrn_n_u32(vmull_u16(vget_high_u16(ma), sa), 8));
+
+	load8(dp, n, d);
+	for (k = 0; k < n; k++)
+		d[k] = blend8(c[k], d[k], ma);
+	store8(dp, n, d);
+}
+
+static inline void
+paint_span_with_color_n(byte * restrict dp, byte * restrict mp, int n, int w, byte *color)
+{
+	byte buf[8 * 4];
+	byte mbuf[8];
+	uint8x8_t c[4];
+	uint16x4_t sa;
+	int k;
+
+	for (k = 0; k < n - 1; k++)
+		c[k] = vdup_n_u8(color[k]);
+	c[k] = vdup_n_u8(255);
+	sa = vdup_n_u16(FZ_EXPAND(color[n - 1]));
+
+	for (; w >= 8; w -= 8)
+	{
+		paint_span_with_color8(dp, mp, n, c, sa);
+		dp += 8 * n;
+		mp += 8;
+	}
+	if (w > 0)
+	{
+		memcpy(buf, dp, w * n);
+		memcpy(mbuf, mp, w);
+		paint_span_with_color8(buf, mbuf, n, c, sa);
+		memcpy(dp, buf, w * n);
+	}
+}
+
+void
+fz_paint_span_with_color_neon(byte * restrict dp, byte * restrict mp, int n, int w, byte *color)
+{
+	switch (n)
+	{
+	case 1: paint_span_with_color_n(dp, mp, 1, w, color); break;
+	case 2: paint_span_with_color_n(dp, mp, 2, w, color); break;
+	case 4: paint_span_with_color_n(dp, mp, 4, w, color); break;
+	}
+}
+
+/* Source in mask over destination */
+
+static inline void
+paint_span_with_mask8(byte * restrict dp, const byte * restrict sp, const byte * restrict mp, int n)
+{
+	uint8x8_t d[4], s[4];
+	uint16x8_t ma, masa;
+	int k;
+
+	ma = expand8(vld1_u8(mp));
+	load8(sp, n, s);
+	masa = combine8(s[n - 1], ma);
+	masa = expand8(vsub_u8(vdup_n_u8(255), vmovn_u16(masa)));
+
+	load8(dp, n, d);
+	for (k = 0; k < n; k++)
+		d[k] = vmovn_u16(vaddq_u16(combine8(s[k], ma), combine8(d[k], masa)));
+	store8(dp, n, d);
+}
+
+static inline void
+paint_span_with_mask_n(byte * restrict dp, byte * restrict sp, byte * restrict mp, int n, int w)
+{
+	byte buf[8 * 4];
+	byte sbuf[8 * 4];
+	byte mbuf[8];
+
+	for (; w >= 8; w -= 8)
+	{
+		paint_span_with_mask8(dp, sp, mp, n);
+		dp += 8 * n;
+		sp += 8 * n;
+		mp += 8;
+	}
+	if (w > 0)
+	{
+		memcpy(buf, dp, w * n);
+		memcpy(sbuf, sp, w * n);
+		memcpy(mbuf, mp, w);
+		paint_span_with_mask8(buf, sbuf, mbuf, n);
+		memcpy(dp, buf, w * n);
+	}
+}
+
+void
+fz_paint_span_with_mask_neon(byte * restrict dp, byte * restrict sp, byte * restrict mp, int n, int w)
+{
+	switch (n)
+	{
+	case 1: paint_span_with_mask_n(dp, sp, mp, 1, w); break;
+	case 2: paint_span_with_mask_n(dp, sp, mp, 2, w); break;
+	case 4: paint_span_with_mask_n(dp, sp, mp, 4, w); break;
+	}
+}
+
+/* Source over destination, with constant alpha if alpha < 255 */
+
+static inline void
+paint_span8(byte * restrict dp, const byte * restrict sp, int n)
+{
+	uint8x8_t d[4], s[4];
+	uint16x8_t t;
+	int k;
+
+	load8(sp, n, s);
+	t = expand8(vsub_u8(vdup_n_u8(255), s[n - 1]));
+
+	load8(dp, n, d);
+	for (k = 0; k < n; k++)
+		d[k] = vmovn_u16(vaddw_u8(combine8(d[k], t), s[k]));
+	store8(dp, n, d);
+}
+
+static inline void
+paint_span_with_alpha8(byte * restrict dp, const byte * restrict sp, int n, uint16x8_t alpha)
+{
+	uint8x8_t d[4], s[4];
+	uint16x8_t masa;
+	int k;
+
+	load8(sp, n, s);
+	masa = combine8(s[n - 1], alpha);
+
+	load8(dp, n, d);
+	for (k = 0; k < n; k++)
+		d[k] = blend8(s[k], d[k], masa);
+	store8(dp, n, d);
+}
+
+static inline void
+paint_span_n(byte * restrict dp, byte * restrict sp, int n, int w, int alpha)
+{
+	byte buf[8 * 4];
+	byte sbuf[8 * 4];
+	uint16x8_t a = vdupq_n_u16(FZ_EXPAND(alpha));
+
+	for (; w >= 8; w -= 8)
+	{
+		if (alpha == 255)
+			paint_span8(dp, sp, n);
+		else
+			paint_span_with_alpha8(dp, sp, n, a);
+		dp += 8 * n;
+		sp += 8 * n;
+	}
+	if (w > 0)
+	{
+		memcpy(buf, dp, w * n);
+		memcpy(sbuf, sp, w * n);
+		if (alpha == 255)
+			paint_span8(buf, sbuf, n);
+		else
+			paint_span_with_alpha8(buf, sbuf, n, a);
+		memcpy(dp, buf, w * n);
+	}
+}
+
+void
+fz_paint_span_neon(byte * restrict dp, byte * restrict sp, int n, int w, int alpha)
+{
+	switch (n)
+	{
+	case 1: paint_span_n(dp, sp, 1, w, alpha); break;
+	case 2: paint_span_n(dp, sp, 2, w, alpha); break;
+	case 4: paint_span_n(dp, sp, 4, w, alpha); break;
+	}
+}
+
+/* Rows of image samples over destination, as painted by apv_draw_affine.c */
+
+static inline void
+paint_affine_row8(byte * restrict dp, const byte * restrict sp, int n, uint8x8_t alpha)
+{
+	uint8x8_t d[4], s[4];
+	uint8x8_t t;
+	int k;
+
+	load8(sp, n, s);
+	for (k = 0; k < n; k++)
+		s[k] = mul255_8(s[k], alpha);
+	t = vsub_u8(vdup_n_u8(255), s[n - 1]);
+
+	load8(dp, n, d);
+	for (k = 0; k < n; k++)
+		d[k] = vadd_u8(s[k], mul255_8(d[k], t));
+	store8(dp, n, d);
+}
+
+static inline void
+paint_affine_row_n(byte * restrict dp, byte * restrict sp, int n, int w, int alpha)
+{
+	byte buf[8 * 4];
+	byte sbuf[8 * 4];
+	uint8x8_t a = vdup_n_u8(alpha);
+
+	/* fz_mul255(x, 255) == x, so the solid case needs no special code */
+	for (; w >= 8; w -= 8)
+	{
+		paint_affine_row8(dp, sp, n, a);
+		dp += 8 * n;
+		sp += 8 * n;
+	}
+	if (w > 0)
+	{
+		memcpy(buf, dp, w * n);
+		memcpy(sbuf, sp, w * n);
+		paint_affine_row8(buf, sbuf, n, a);
+		memcpy(dp, buf, w * n);
+	}
+}
+
+void
+fz_paint_affine_row_neon(byte * restrict dp, byte * restrict sp, int n, int w, int alpha)
+{
+	switch (n)
+	{
+	case 1: paint_affine_row_n(dp, sp, 1, w, alpha); break;
+	case 2: paint_affine_row_n(dp, sp, 2, w, alpha); break;
+	case 4: paint_affine_row_n(dp, sp, 4, w, alpha); break;
+	}
+}
+
+static inline void
+paint_affine_color_row8(byte * restrict dp, const byte * restrict mp, int n, uint8x8_t *c, uint16x8_t sa)
+{
+	uint8x8_t d[4];
+	uint16x8_t masa;
+	int k;
+
+	masa = vshrq_n_u16(vmulq_u16(expand8(vld1_u8(mp)), sa), 8);
+
+	load8(dp, n, d);
+	for (k = 0; k < n; k++)
+		d[k] = blend8(c[k], d[k], masa);
+	store8(dp, n, d);
+}
+
+static inline void
+paint_affine_color_row_n(byte * restrict dp, byte * restrict mp, int n, int w, byte *color)
+{
+	byte buf[8 * 4];
+	byte mbuf[8];
+	uint8x8_t c[4];
+	uint16x8_t sa;
+	int k;
+
+	/* unlike fz_paint_span_with_color, the color alpha is not expanded */
+	for (k = 0; k < n - 1; k++)
+		c[k] = vdup_n_u8(color[k]);
+	c[k] = vdup_n_u8(255);
+	sa = vdupq_n_u16(color[n - 1]);
+
+	for (; w >= 8; w -= 8)
+	{
+		paint_affine_color_row8(dp, mp, n, c, sa);
+		dp += 8 * n;
+		mp += 8;
+	}
+	if (w > 0)
+	{
+		memcpy(buf, dp, w * n);
+		memcpy(mbuf, mp, w);
+		paint_affine_color_row8(buf, mbuf, n, c, sa);
+		memcpy(dp, buf, w * n);
+	}
+}
+
+void
+fz_paint_affine_color_row_neon(byte * restrict dp, byte * restrict mp, int n, int w, byte *color)
+{
+	switch (n)
+	{
+	case 1: paint_affine_color_row_n(dp, mp, 1, w, color); break;
+	case 2: paint_affine_color_row_n(dp, mp, 2, w, color); break;
+	case 4: paint_affine_color_row_n(dp, mp, 4, w, color); break;
+	}
+}
+
+/* Separable blend modes */
+
+/* 255 * 256 / a, for un-premultiplying */
+static unsigned short fz_inv_alpha[256];
+
+static void
+init_inv_alpha(void)
+{
+	int a;
+	fz_inv_alpha[0] = 0;
+	for (a = 1; a < 256; a++)
+		fz_inv_alpha[a] = 255 * 256 / a;
+}
+
+static inline uint16x8_t
+inv_alpha8(const byte *a, int n)
+{
+	unsigned short t[8];
+	int i;
+	for (i = 0; i < 8; i++)
+		t[i] = fz_inv_alpha[a[i * n]];
+	return vld1q_u16(t);
+}
+
+/* (c * inv) >> 8; fits in a byte when c <= alpha */
+static inline uint8x8_t
+unpremultiply8(uint8x8_t c, uint16x8_t inv)
+{
+	uint16x8_t c16 = vmovl_u8(c);
+	uint16x4_t lo = vshrn_n_u32(vmull_u16(vget_low_u16(c16), vget_low_u16(inv)), 8);
+	uint16x4_t hi = vshrn_n_u32(vmull_u16(vget_high_u16(c16), vget_high_u16(inv)), 8);
+	return vqmovn_u16(vcombine_u16(lo, hi));
+}
+
+static inline uint8x8_t
+screen8(uint8x8_t b, uint8x8_t s)
+{
+	return vsub_u8(vadd_u8(b, s), mul255_8(b, s));
+}
+
+static inline uint8x8_t
+hard_light8(uint8x8_t b, uint8x8_t s)
+{
+	/* s << 1 for s <= 127, (s << 1) - 255 otherwise */
+	uint8x8_t s2 = vshl_n_u8(s, 1);
+	uint8x8_t lo = mul255_8(b, s2);
+	uint8x8_t hi = screen8(b, vadd_u8(s2, vdup_n_u8(1)));
+	return vbsl_u8(vcle_u8(s, vdup_n_u8(127)), lo, hi);
+}
+
+static inline uint8x8_t
+blend_mode8(uint8x8_t b, uint8x8_t s, int blendmode)
+{
+	switch (blendmode)
+	{
+	default:
+	case FZ_BLEND_NORMAL: return s;
+	case FZ_BLEND_MULTIPLY: return mul255_8(b, s);
+	case FZ_BLEND_SCREEN: return screen8(b, s);
+	case FZ_BLEND_OVERLAY: return hard_light8(s, b);
+	case FZ_BLEND_DARKEN: return vmin_u8(b, s);
+	case FZ_BLEND_LIGHTEN: return vmax_u8(b, s);
+	case FZ_BLEND_HARD_LIGHT: return hard_light8(b, s);
+	case FZ_BLEND_DIFFERENCE: return vabd_u8(b, s);
+	case FZ_BLEND_EXCLUSION:
+		return vsub_u8(vadd_u8(b, s), vshl_n_u8(mul255_8(b, s), 1));
+	}
+}
+
+static inline void
+blend_separable8(byte * restrict bp, const byte * restrict sp, int n, int blendmode)
+{
+	uint8x8_t b[4], s[4];
+	uint8x8_t sa, ba, saba, isa, iba;
+	uint16x8_t invsa, invba;
+	int k;
+
+	load8(sp, n, s);
+	load8(bp, n, b);
+	sa = s[n - 1];
+	ba = b[n - 1];
+	saba = mul255_8(sa, ba);
+	invsa = inv_alpha8(sp + n - 1, n);
+	invba = inv_alpha8(bp + n - 1, n);
+	isa = vsub_u8(vdup_n_u8(255), sa);
+	iba = vsub_u8(vdup_n_u8(255), ba);
+
+	for (k = 0; k < n - 1; k++)
+	{
+		uint8x8_t sc = unpremultiply8(s[k], invsa);
+		uint8x8_t bc = unpremultiply8(b[k], invba);
+		uint8x8_t rc = blend_mode8(bc, sc, blendmode);
+		uint16x8_t t = vaddl_u8(mul255_8(isa, b[k]), mul255_8(iba, s[k]));
+		b[k] = vmovn_u16(vaddw_u8(t, mul255_8(saba, rc)));
+	}
+	b[k] = vsub_u8(vadd_u8(ba, sa), saba);
+	store8(bp, n, b);
+}
+
+static inline void
+blend_separable_n(byte * restrict bp, byte * restrict sp, int n, int w, int blendmode)
+{
+	byte buf[8 * 4];
+	byte sbuf[8 * 4];
+
+	for (; w >= 8; w -= 8)
+	{
+		blend_separable8(bp, sp, n, blendmode);
+		bp += 8 * n;
+		sp += 8 * n;
+	}
+	if (w > 0)
+	{
+		memcpy(buf, bp, w * n);
+		memcpy(sbuf, sp, w * n);
+		blend_separable8(buf, sbuf, n, blendmode);
+		memcpy(bp, buf, w * n);
+	}
+}
+
+void
+fz_blend_separable_neon(byte * restrict bp, byte * restrict sp, int n, int w, int blendmode)
+{
+	switch (n)
+	{
+	case 1: blend_separable_n(bp, sp, 1, w, blendmode); break;
+	case 2: blend_separable_n(bp, sp, 2, w, blendmode); break;
+	case 4: blend_separable_n(bp, sp, 4, w, blendmode); break;
+	}
+}
+
+/* sc = (((sc - bc) * invha) >> 8) + bc, clamped to 0..255 */
+static inline uint8x8_t
+uncomposite8(uint8x8_t sc, uint8x8_t bc, uint16x8_t invha)
+{
+	int16x8_t d = vreinterpretq_s16_u16(vsubl_u8(sc, bc));
+	int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(bc));
+	int32x4_t lo = vmulq_s32(vmovl_s16(vget_low_s16(d)), vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(invha))));
+	int32x4_t hi = vmulq_s32(vmovl_s16(vget_high_s16(d)), vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(invha))));
+	lo = vaddq_s32(vshrq_n_s32(lo, 8), vmovl_s16(vget_low_s16(b)));
+	hi = vaddq_s32(vshrq_n_s32(hi, 8), vmovl_s16(vget_high_s16(b)));
+	return vqmovun_s16(vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+}
+
+static inline void
+blend_separable_nonisolated8(byte * restrict bp, const byte * restrict sp, int n, int blendmode, const byte * restrict hp, uint8x8_t alpha)
+{
+	uint8x8_t b[4], s[4];
+	uint8x8_t ha, haa, ba, baha, ra, ihaa, iba, changed, colored;
+	uint16x8_t invsa, invba, invha;
+	int k;
+
+	ha = vld1_u8(hp);
+	haa = mul255_8(ha, alpha);
+	changed = vmvn_u8(vceq_u8(haa, vdup_n_u8(0)));
+	if ((vget_lane_u32(vreinterpret_u32_u8(changed), 0) | vget_lane_u32(vreinterpret_u32_u8(changed), 1)) == 0)
+		return;
+
+	load8(sp, n, s);
+	load8(bp, n, b);
+	ba = b[n - 1];
+	baha = mul255_8(ba, haa);
+	invsa = inv_alpha8(sp + n - 1, n);
+	invba = inv_alpha8(bp + n - 1, n);
+	invha = inv_alpha8(hp, 1);
+	ra = vadd_u8(vsub_u8(ba, baha), haa);
+	colored = vand_u8(changed, vmvn_u8(vceq_u8(ra, vdup_n_u8(0))));
+	ihaa = vsub_u8(vdup_n_u8(255), haa);
+	iba = vsub_u8(vdup_n_u8(255), ba);
+
+	for (k = 0; k < n - 1; k++)
+	{
+		uint8x8_t sc = unpremultiply8(s[k], invsa);
+		uint8x8_t bc = unpremultiply8(b[k], invba);
+		uint8x8_t rc;
+		uint16x8_t t;
+
+		sc = uncomposite8(sc, bc, invha);
+		rc = blend_mode8(bc, sc, blendmode);
+		t = vaddl_u8(mul255_8(ihaa, bc), mul255_8(mul255_8(iba, sc), haa));
+		rc = vqmovn_u16(vaddw_u8(t, mul255_8(baha, rc)));
+		b[k] = vbsl_u8(colored, mul255_8(rc, ra), b[k]);
+	}
+	b[k] = vbsl_u8(changed, ra, ba);
+	store8(bp, n, b);
+}
+
+static inline void
+blend_separable_nonisolated_n(byte * restrict bp, byte * restrict sp, int n, int w, int blendmode, byte * restrict hp, int alpha)
+{
+	byte buf[8 * 4];
+	byte sbuf[8 * 4];
+	byte hbuf[8];
+	uint8x8_t a = vdup_n_u8(alpha);
+
+	for (; w >= 8; w -= 8)
+	{
+		blend_separable_nonisolated8(bp, sp, n, blendmode, hp, a);
+		bp += 8 * n;
+		sp += 8 * n;
+		hp += 8;
+	}
+	if (w > 0)
+	{
+		memcpy(buf, bp, w * n);
+		memcpy(sbuf, sp, w * n);
+		memset(hbuf, 0, 8);
+		memcpy(hbuf, hp, w);
+		blend_separable_nonisolated8(buf, sbuf, n, blendmode, hbuf, a);
+		memcpy(bp, buf, w * n);
+	}
+}
+
+void
+fz_blend_separable_nonisolated_neon(byte * restrict bp, byte * restrict sp, int n, int w, int blendmode, byte * restrict hp, int alpha)
+{
+	switch (n)
+	{
+	case 1: blend_separable_nonisolated_n(bp, sp, 1, w, blendmode, hp, alpha); break;
+	case 2: blend_separable_nonisolated_n(bp, sp, 2, w, blendmode, hp, alpha); break;
+	case 4: blend_separable_nonisolated_n(bp, sp, 4, w, blendmode, hp, alpha); break;
+	}
+}
+
+void
+fz_init_draw_neon(void)
+{
+	init_inv_alpha();
+}
@@ -0,0 +1,55 @@
+/*
+ * Runtime selection of SIMD span painters, image row painters and
+ * blending loops.
+ * fz_accelerate() calls fz_accelerate_arch() when HAVE_CPUDEP is defined,
+ * which is only done for armeabi-v7a, where NEON is optional.
+ */
+
+#include "fitz.h"
+
+#include <cpu-features.h>
+
+typedef unsigned char byte;
+
+/* defined in draw/apv_draw_paint.c */
+extern void (*fz_paint_solid_color_simd)(byte * restrict dp, int n, int w, byte *color);
+extern void (*fz_paint_span_with_color_simd)(byte * restrict dp, byte * restrict mp, int n, int w, byte *color);
+extern void (*fz_paint_span_with_mask_simd)(byte * restrict dp, byte * restrict sp, byte * restrict mp, int n, int w);
+extern void (*fz_paint_span_simd)(byte * restrict dp, byte * restrict sp, int n, int w, int alpha);
+
+/* defined in draw/apv_draw_affine.c */
+extern void (*fz_paint_affine_row_simd)(byte * restrict dp, byte * restrict sp, int n, int w, int alpha);
+extern void (*fz_paint_affine_color_row_simd)(byte * restrict dp, byte * restrict mp, int n, int w, byte *color);
+
+/* defined in draw/apv_draw_blend.c */
+extern void (*fz_blend_separable_simd)(byte * restrict bp, byte * restrict sp, int n, int w, int blendmode);
+extern void (*fz_blend_separable_nonisolated_simd)(byte * restrict bp, byte * restrict sp, int n, int w, int blendmode, byte * restrict hp, int alpha);
+
+/* defined in draw/apv_draw_neon.c */
+extern void fz_init_draw_neon(void);
+extern void fz_paint_solid_color_neon(byte * restrict dp, int n, int w, byte *color);
+extern void fz_paint_span_with_color_neon(byte * restrict dp, byte * restrict mp, int n, int w, byte *color);
+extern void fz_paint_span_with_mask_neon(byte * restrict dp, byte * restrict sp, byte * restrict mp, int n, int w);
+extern void fz_paint_span_neon(byte * restrict dp, byte * restrict sp, int n, int w, int alpha);
+extern void fz_paint_affine_row_neon(byte * restrict dp, byte * restrict sp, int n, int w, int alpha);
+extern void fz_paint_affine_color_row_neon(byte * restrict dp, byte * restrict mp, int n, int w, byte *color);
+extern void fz_blend_separable_neon(byte * restrict bp, byte * restrict sp, int n, int w, int blendmode);
+extern void fz_blend_separable_nonisolated_neon(byte * restrict bp, byte * restrict sp, int n, int w, int blendmode, byte * restrict hp, int alpha);
+
+void
+fz_accelerate_arch(void)
+{
+	if (android_getCpuFamily() != ANDROID_CPU_FAMILY_ARM ||
+		!(android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON))
+		return;
+
+	fz_init_draw_neon();
+	fz_paint_solid_color_simd = fz_paint_solid_color_neon;
+	fz_paint_span_with_color_simd = fz_paint_span_with_color_neon;
+	fz_paint_span_with_mask_simd = fz_paint_span_with_mask_neon;
+	fz_paint_span_simd = fz_paint_span_neon;
+	fz_paint_affine_row_simd = fz_paint_affine_row_neon;
+	fz_paint_affine_color_row_simd = fz_paint_affine_color_row_neon;
+	fz_blend_separable_simd = fz_blend_separable_neon;
+	fz_blend_separable_nonisolated_simd = fz_blend_separable_nonisolated_neon;
+}
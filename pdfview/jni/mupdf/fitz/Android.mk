@@ -19,6 +19,7 @@ LOCAL_SRC_FILES := \
 	base_object.c \
 	base_hash.c \
 	base_memory.c \
+	apv_base_arena.c \
 	base_string.c \
 	base_geometry.c \
 	\
@@ -35,23 +36,23 @@ LOCAL_SRC_FILES := \
 	\
 	filt_basic.c \
 	\
-	filt_dctd.c \
+	apv_filt_dctd.c \
 	filt_faxd.c \
 	filt_flate.c \
 	filt_lzwd.c \
 	filt_predict.c \
-	filt_jbig2d.c \
-	filt_jpxd.c \
+	apv_filt_jbig2d.c \
+	apv_filt_jpxd.c \
 	\
 	res_colorspace.c \
-	res_font.c \
+	apv_res_font.c \
 	res_pixmap.c \
 	res_shade.c \
 	res_text.c \
 	res_path.c \
 	\
-	dev_list.c \
-	dev_text.c \
+	apv_dev_list.c \
+	apv_dev_text.c \
 	dev_bbox.c \
 	dev_null.c
 
@@ -0,0 +1,201 @@
+
+/*
+ * Arena allocator, see apv_base_arena.h.
+ *
+ * Arena is a list of chunks, the first one being the current chunk that
+ * objects are cut from. Objects too big to share a chunk get chunks of
+ * their own. A few free chunks are kept in a pool, so that arenas created
+ * for each page run or type3 glyph don't call malloc at all.
+ * Arenas of different documents are used from different threads, so the
+ * pool is guarded by fz_arena_lock. Arenas themselves are used by one
+ * thread at a time.
+ */
+
+#include "fitz.h"
+#include "apv_base_arena.h"
+
+#include <pthread.h>
+
+#define ARENA_CHUNK_SIZE (64*1024)
+/* bigger objects get chunks of their own */
+#define ARENA_BIG_OBJECT (ARENA_CHUNK_SIZE/4)
+/* max number of free chunks kept for next arenas */
+#define ARENA_POOL_SIZE 4
+
+#define ARENA_ALIGN(n) (((n) + 7) & ~7)
+
+typedef struct fz_arena_chunk_s fz_arena_chunk;
+
+struct fz_arena_chunk_s
+{
+	fz_arena_chunk *next;
+	int size; /* of data following header */
+};
+
+#define ARENA_CHUNK_HEADER ARENA_ALIGN((int)sizeof(fz_arena_chunk))
+#define ARENA_CHUNK_DATA(chunk) ((unsigned char *)(chunk) + ARENA_CHUNK_HEADER)
+
+struct fz_arena_s
+{
+	fz_arena_chunk *chunk; /* current chunk, followed by older and big object chunks */
+	unsigned char *pos, *end; /* free space in current chunk */
+	unsigned char *last; /* last object cut from current chunk, which can grow in place */
+	int size; /* of all chunks */
+};
+
+static pthread_mutex_t fz_arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static fz_arena_chunk *fz_arena_pool = NULL;
+static int fz_arena_pool_len = 0;
+
+fz_arena *
+fz_new_arena(void)
+{
+	fz_arena *arena = fz_malloc(sizeof(fz_arena));
+	arena->chunk = NULL;
+	arena->pos = NULL;
+	arena->end = NULL;
+	arena->last = NULL;
+	arena->size = 0;
+	return arena;
+}
+
+static fz_arena_chunk *
+fz_new_arena_chunk(fz_arena *arena, int size)
+{
+	fz_arena_chunk *chunk = NULL;
+
+	if (size == ARENA_CHUNK_SIZE)
+	{
+		pthread_mutex_lock(&fz_arena_lock);
+		chunk = fz_arena_pool;
+		if (chunk)
+		{
+			fz_arena_pool = chunk->next;
+			fz_arena_pool_len--;
+		}
+		pthread_mutex_unlock(&fz_arena_lock);
+	}
+	if (!chunk)
+	{
+		chunk = fz_malloc(ARENA_CHUNK_HEADER + size);
+		chunk->size = size;
+	}
+	arena->size += ARENA_CHUNK_HEADER + size;
+	return chunk;
+}
+
+/*
+ * Release all objects of arena. Chunks go back to pool while there's room,
+ * nothing is done for objects themselves.
+ */
+void
+fz_free_arena(fz_arena *arena)
+{
+	fz_arena_chunk *chunk, *next;
+
+	pthread_mutex_lock(&fz_arena_lock);
+	for (chunk = arena->chunk; chunk; chunk = next)
+	{
+		next = chunk->next;
+		if (chunk->size == ARENA_CHUNK_SIZE && fz_arena_pool_len < ARENA_POOL_SIZE)
+		{
+			chunk->next = fz_arena_pool;
+			fz_arena_pool = chunk;
+			fz_arena_pool_len++;
+		}
+		else
+			fz_free(chunk);
+	}
+	pthread_mutex_unlock(&fz_arena_lock);
+	fz_free(arena);
+}
+
+void *
+fz_arena_alloc(fz_arena *arena, int size)
+{
+	fz_arena_chunk *chunk;
+	unsigned char *p;
+
+	if (size < 0 || size > INT_MAX - ARENA_CHUNK_HEADER - 7)
+	{
+		fprintf(stderr, "fatal error: out of memory (integer overflow)\n");
+		abort();
+	}
+	size = ARENA_ALIGN(size);
+
+	if (size > arena->end - arena->pos)
+	{
+		if (size > ARENA_BIG_OBJECT)
+		{
+			/* put it behind current chunk, which still has room for small objects */
+			chunk = fz_new_arena_chunk(arena, size);
+			if (arena->chunk)
+			{
+				chunk->next = arena->chunk->next;
+				arena->chunk->next = chunk;
+			}
+			else
+			{
+				chunk->next = NULL;
+				arena->chunk = chunk;
+			}
+			return ARENA_CHUNK_DATA(chunk);
+		}
+
+		chunk = fz_new_arena_chunk(arena, ARENA_CHUNK_SIZE);
+		chunk->next = arena->chunk;
+		arena->chunk = chunk;
+		arena->pos = ARENA_CHUNK_DATA(chunk);
+		arena->end = arena->pos + ARENA_CHUNK_SIZE;
+	}
+
+	p = arena->pos;
+	arena->pos += size;
+	arena->last = p;
+	return p;
+}
+
+/*
+ * Like fz_realloc for object of arena. Last object is grown in place when
+ * there's room for it, others are copied and old copy stays in arena.
+ */
+void *
+fz_arena_grow(fz_arena *arena, void *p, int old_size, int new_size)
+{
+	void *np;
+
+	if (p && p == arena->last && new_size >= 0 && new_size <= arena->end - arena->last)
+	{
+		arena->pos = arena->last + ARENA_ALIGN(new_size);
+		return p;
+	}
+
+	np = fz_arena_alloc(arena, new_size);
+	if (p)
+		memcpy(np, p, MIN(old_size, new_size));
+	return np;
+}
+
+/* Returns size of memory taken by arena. */
+int
+fz_arena_size(fz_arena *arena)
+{
+	return arena->size;
+}
+
+/* Free chunks kept for reuse. */
+void
+fz_trim_arena_pool(void)
+{
+	fz_arena_chunk *next;
+
+	pthread_mutex_lock(&fz_arena_lock);
+	while (fz_arena_pool)
+	{
+		next = fz_arena_pool->next;
+		fz_free(fz_arena_pool);
+		fz_arena_pool = next;
+	}
+	fz_arena_pool_len = 0;
+	pthread_mutex_unlock(&fz_arena_lock);
+}
@@ -0,0 +1,17 @@
+
+/*
+ * Arena allocator for many small objects that are freed together, like
+ * nodes of a display list or paths and text of a page being interpreted.
+ * Objects are cut from big chunks and can't be freed one by one, whole
+ * arena is released at once by fz_free_arena.
+ * Implemented in fitz/apv_base_arena.c.
+ */
+
+typedef struct fz_arena_s fz_arena;
+
+fz_arena *fz_new_arena(void);
+void fz_free_arena(fz_arena *arena);
+void *fz_arena_alloc(fz_arena *arena, int size);
+void *fz_arena_grow(fz_arena *arena, void *p, int old_size, int new_size);
+int fz_arena_size(fz_arena *arena);
+void fz_trim_arena_pool(void);
@@ -0,0 +1,1035 @@
+
+/*
+ * This is a modified version of dev_list.c file which is part of MuPDF
+ * by Artifex Software, Inc.
+ * Adds spatial index of display list, so that executing list for small area
+ * of big page visits only objects near that area, and makes list execution
+ * honour FZ_IGNORE_IMAGE and FZ_IGNORE_SHADE hints of target device.
+ * Nodes and their paths, text and stroke states are kept in an arena,
+ * which is released at once with the list.
+ */
+
+#include "fitz.h"
+#include "apv_base_arena.h"
+
+typedef struct fz_display_node_s fz_display_node;
+typedef struct fz_display_span_s fz_display_span;
+
+#define STACK_SIZE 96
+
+/* lists with fewer spans are executed without index */
+#define INDEX_MIN_SPANS 64
+/* max number of grid cells along one side */
+#define INDEX_MAX_GRID 64
+
+typedef enum fz_display_command_e
+{
+	FZ_CMD_FILL_PATH,
+	FZ_CMD_STROKE_PATH,
+	FZ_CMD_CLIP_PATH,
+	FZ_CMD_CLIP_STROKE_PATH,
+	FZ_CMD_FILL_TEXT,
+	FZ_CMD_STROKE_TEXT,
+	FZ_CMD_CLIP_TEXT,
+	FZ_CMD_CLIP_STROKE_TEXT,
+	FZ_CMD_IGNORE_TEXT,
+	FZ_CMD_FILL_SHADE,
+	FZ_CMD_FILL_IMAGE,
+	FZ_CMD_FILL_IMAGE_MASK,
+	FZ_CMD_CLIP_IMAGE_MASK,
+	FZ_CMD_POP_CLIP,
+	FZ_CMD_BEGIN_MASK,
+	FZ_CMD_END_MASK,
+	FZ_CMD_BEGIN_GROUP,
+	FZ_CMD_END_GROUP,
+	FZ_CMD_BEGIN_TILE,
+	FZ_CMD_END_TILE
+} fz_display_command;
+
+struct fz_display_node_s
+{
+	fz_display_command cmd;
+	fz_display_node *next;
+	fz_rect rect;
+	union {
+		fz_path *path;
+		fz_text *text;
+		fz_shade *shade;
+		fz_pixmap *image;
+		int blendmode;
+	} item;
+	fz_stroke_state *stroke;
+	int flag; /* even_odd, accumulate, isolated/knockout... */
+	fz_matrix ctm;
+	fz_colorspace *colorspace;
+	float alpha;
+	float color[FZ_MAX_COLORS];
+};
+
+/*
+ * Span is a top level node together with nodes nested in it, for example
+ * clip path and everything up to matching pop clip. Whole span is either
+ * culled or executed, so spans are the units of the spatial index.
+ */
+struct fz_display_span_s
+{
+	fz_display_node *first;
+	fz_display_node *end; /* node after span */
+	fz_rect rect; /* culling rect, infinite if span is never culled */
+};
+
+struct fz_display_list_s
+{
+	fz_arena *arena;
+	fz_display_node *first;
+	fz_display_node *last;
+
+	int top;
+	struct {
+		fz_rect *update;
+		fz_rect rect;
+	} stack[STACK_SIZE];
+	int tiled;
+
+	/* spatial index, built on first execution */
+	fz_display_node *indexed_last;
+	int span_count;
+	fz_display_span *spans;
+	fz_rect bounds; /* union of finite span rects */
+	int grid_w, grid_h;
+	int *cell_start; /* grid_w * grid_h + 1 offsets into cell_spans */
+	int *cell_spans; /* span indexes of each cell in list order */
+	int always_count;
+	int *always_spans; /* spans that are never culled */
+	int *candidates; /* query buffer, span_count entries */
+	unsigned char *marks; /* query buffer, span_count entries */
+};
+
+enum { ISOLATED = 1, KNOCKOUT = 2 };
+
+static fz_display_node *
+fz_new_display_node(fz_display_list *list, fz_display_command cmd, fz_matrix ctm,
+	fz_colorspace *colorspace, float *color, float alpha)
+{
+	fz_display_node *node;
+	int i;
+
+	node = fz_arena_alloc(list->arena, sizeof(fz_display_node));
+	node->cmd = cmd;
+	node->next = NULL;
+	node->rect = fz_empty_rect;
+	node->item.path = NULL;
+	node->stroke = NULL;
+	node->flag = 0;
+	node->ctm = ctm;
+	if (colorspace)
+	{
+		node->colorspace = fz_keep_colorspace(colorspace);
+		if (color)
+		{
+			for (i = 0; i < node->colorspace->n; i++)
+				node->color[i] = color[i];
+		}
+	}
+	else
+	{
+		node->colorspace = NULL;
+	}
+	node->alpha = alpha;
+
+	return node;
+}
+
+static fz_stroke_state *
+fz_clone_stroke_state(fz_display_list *list, fz_stroke_state *stroke)
+{
+	fz_stroke_state *newstroke = fz_arena_alloc(list->arena, sizeof(fz_stroke_state));
+	*newstroke = *stroke;
+	return newstroke;
+}
+
+static fz_path *
+fz_clone_list_path(fz_display_list *list, fz_path *old)
+{
+	fz_path *path;
+
+	path = fz_arena_alloc(list->arena, sizeof(fz_path));
+	path->len = old->len;
+	path->cap = old->len;
+	path->items = fz_arena_alloc(list->arena, old->len * sizeof(fz_path_item));
+	memcpy(path->items, old->items, old->len * sizeof(fz_path_item));
+
+	return path;
+}
+
+static fz_text *
+fz_clone_list_text(fz_display_list *list, fz_text *old)
+{
+	fz_text *text;
+
+	text = fz_arena_alloc(list->arena, sizeof(fz_text));
+	text->font = fz_keep_font(old->font);
+	text->trm = old->trm;
+	text->wmode = old->wmode;
+	text->len = old->len;
+	text->cap = old->len;
+	text->items = fz_arena_alloc(list->arena, old->len * sizeof(fz_text_item));
+	memcpy(text->items, old->items, old->len * sizeof(fz_text_item));
+
+	return text;
+}
+
+static void
+fz_append_display_node(fz_display_list *list, fz_display_node *node)
+{
+	switch (node->cmd)
+	{
+	case FZ_CMD_CLIP_PATH:
+	case FZ_CMD_CLIP_STROKE_PATH:
+	case FZ_CMD_CLIP_IMAGE_MASK:
+		if (list->top < STACK_SIZE)
+		{
+			list->stack[list->top].update = &node->rect;
+			list->stack[list->top].rect = fz_empty_rect;
+		}
+		list->top++;
+		break;
+	case FZ_CMD_END_MASK:
+	case FZ_CMD_CLIP_TEXT:
+	case FZ_CMD_CLIP_STROKE_TEXT:
+		if (list->top < STACK_SIZE)
+		{
+			list->stack[list->top].update = NULL;
+			list->stack[list->top].rect = fz_empty_rect;
+		}
+		list->top++;
+		break;
+	case FZ_CMD_BEGIN_TILE:
+		list->tiled++;
+		if (list->top > 0 && list->top < STACK_SIZE)
+		{
+			list->stack[list->top-1].rect = fz_infinite_rect;
+		}
+		break;
+	case FZ_CMD_END_TILE:
+		list->tiled--;
+		break;
+	case FZ_CMD_END_GROUP:
+		break;
+	case FZ_CMD_POP_CLIP:
+		if (list->top > STACK_SIZE)
+		{
+			list->top--;
+			node->rect = fz_infinite_rect;
+		}
+		else if (list->top > 0)
+		{
+			fz_rect *update;
+			list->top--;
+			update = list->stack[list->top].update;
+			if (list->tiled == 0)
+			{
+				if (update != NULL)
+				{
+					*update = fz_intersect_rect(*update, list->stack[list->top].rect);
+					node->rect = *update;
+				}
+				else
+					node->rect = list->stack[list->top].rect;
+			}
+			else
+				node->rect = fz_infinite_rect;
+		}
+		/* fallthrough */
+	default:
+		if (list->top > 0 && list->tiled == 0 && list->top <= STACK_SIZE)
+			list->stack[list->top-1].rect = fz_union_rect(list->stack[list->top-1].rect, node->rect);
+		break;
+	}
+	if (!list->first)
+	{
+		list->first = node;
+		list->last = node;
+	}
+	else
+	{
+		list->last->next = node;
+		list->last = node;
+	}
+}
+
+/* Drop resources kept by node, memory of node itself is freed with arena. */
+static void
+fz_drop_display_node(fz_display_node *node)
+{
+	switch (node->cmd)
+	{
+	case FZ_CMD_FILL_PATH:
+	case FZ_CMD_STROKE_PATH:
+	case FZ_CMD_CLIP_PATH:
+	case FZ_CMD_CLIP_STROKE_PATH:
+		break;
+	case FZ_CMD_FILL_TEXT:
+	case FZ_CMD_STROKE_TEXT:
+	case FZ_CMD_CLIP_TEXT:
+	case FZ_CMD_CLIP_STROKE_TEXT:
+	case FZ_CMD_IGNORE_TEXT:
+		fz_drop_font(node->item.text->font);
+		break;
+	case FZ_CMD_FILL_SHADE:
+		fz_drop_shade(node->item.shade);
+		break;
+	case FZ_CMD_FILL_IMAGE:
+	case FZ_CMD_FILL_IMAGE_MASK:
+	case FZ_CMD_CLIP_IMAGE_MASK:
+		fz_drop_pixmap(node->item.image);
+		break;
+	case FZ_CMD_POP_CLIP:
+	case FZ_CMD_BEGIN_MASK:
+	case FZ_CMD_END_MASK:
+	case FZ_CMD_BEGIN_GROUP:
+	case FZ_CMD_END_GROUP:
+	case FZ_CMD_BEGIN_TILE:
+	case FZ_CMD_END_TILE:
+		break;
+	}
+	if (node->colorspace)
+		fz_drop_colorspace(node->colorspace);
+}
+
+static void
+fz_list_fill_path(void *user, fz_path *path, int even_odd, fz_matrix ctm,
+	fz_colorspace *colorspace, float *color, float alpha)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_FILL_PATH, ctm, colorspace, color, alpha);
+	node->rect = fz_bound_path(path, NULL, ctm);
+	node->item.path = fz_clone_list_path(user, path);
+	node->flag = even_odd;
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_stroke_path(void *user, fz_path *path, fz_stroke_state *stroke, fz_matrix ctm,
+	fz_colorspace *colorspace, float *color, float alpha)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_STROKE_PATH, ctm, colorspace, color, alpha);
+	node->rect = fz_bound_path(path, stroke, ctm);
+	node->item.path = fz_clone_list_path(user, path);
+	node->stroke = fz_clone_stroke_state(user, stroke);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_clip_path(void *user, fz_path *path, fz_rect *rect, int even_odd, fz_matrix ctm)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_CLIP_PATH, ctm, NULL, NULL, 0);
+	node->rect = fz_bound_path(path, NULL, ctm);
+	if (rect != NULL)
+		node->rect = fz_intersect_rect(node->rect, *rect);
+	node->item.path = fz_clone_list_path(user, path);
+	node->flag = even_odd;
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_clip_stroke_path(void *user, fz_path *path, fz_rect *rect, fz_stroke_state *stroke, fz_matrix ctm)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_CLIP_STROKE_PATH, ctm, NULL, NULL, 0);
+	node->rect = fz_bound_path(path, stroke, ctm);
+	if (rect != NULL)
+		node->rect = fz_intersect_rect(node->rect, *rect);
+	node->item.path = fz_clone_list_path(user, path);
+	node->stroke = fz_clone_stroke_state(user, stroke);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_fill_text(void *user, fz_text *text, fz_matrix ctm,
+	fz_colorspace *colorspace, float *color, float alpha)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_FILL_TEXT, ctm, colorspace, color, alpha);
+	node->rect = fz_bound_text(text, ctm);
+	node->item.text = fz_clone_list_text(user, text);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_stroke_text(void *user, fz_text *text, fz_stroke_state *stroke, fz_matrix ctm,
+	fz_colorspace *colorspace, float *color, float alpha)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_STROKE_TEXT, ctm, colorspace, color, alpha);
+	node->rect = fz_bound_text(text, ctm);
+	node->item.text = fz_clone_list_text(user, text);
+	node->stroke = fz_clone_stroke_state(user, stroke);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_clip_text(void *user, fz_text *text, fz_matrix ctm, int accumulate)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_CLIP_TEXT, ctm, NULL, NULL, 0);
+	node->rect = fz_bound_text(text, ctm);
+	node->item.text = fz_clone_list_text(user, text);
+	node->flag = accumulate;
+	/* when accumulating, be conservative about culling */
+	if (accumulate)
+		node->rect = fz_infinite_rect;
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_clip_stroke_text(void *user, fz_text *text, fz_stroke_state *stroke, fz_matrix ctm)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_CLIP_STROKE_TEXT, ctm, NULL, NULL, 0);
+	node->rect = fz_bound_text(text, ctm);
+	node->item.text = fz_clone_list_text(user, text);
+	node->stroke = fz_clone_stroke_state(user, stroke);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_ignore_text(void *user, fz_text *text, fz_matrix ctm)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_IGNORE_TEXT, ctm, NULL, NULL, 0);
+	node->rect = fz_bound_text(text, ctm);
+	node->item.text = fz_clone_list_text(user, text);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_pop_clip(void *user)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_POP_CLIP, fz_identity, NULL, NULL, 0);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_fill_shade(void *user, fz_shade *shade, fz_matrix ctm, float alpha)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_FILL_SHADE, ctm, NULL, NULL, alpha);
+	node->rect = fz_bound_shade(shade, ctm);
+	node->item.shade = fz_keep_shade(shade);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_fill_image(void *user, fz_pixmap *image, fz_matrix ctm, float alpha)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_FILL_IMAGE, ctm, NULL, NULL, alpha);
+	node->rect = fz_transform_rect(ctm, fz_unit_rect);
+	node->item.image = fz_keep_pixmap(image);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_fill_image_mask(void *user, fz_pixmap *image, fz_matrix ctm,
+	fz_colorspace *colorspace, float *color, float alpha)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_FILL_IMAGE_MASK, ctm, colorspace, color, alpha);
+	node->rect = fz_transform_rect(ctm, fz_unit_rect);
+	node->item.image = fz_keep_pixmap(image);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_clip_image_mask(void *user, fz_pixmap *image, fz_rect *rect, fz_matrix ctm)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_CLIP_IMAGE_MASK, ctm, NULL, NULL, 0);
+	node->rect = fz_transform_rect(ctm, fz_unit_rect);
+	if (rect != NULL)
+		node->rect = fz_intersect_rect(node->rect, *rect);
+	node->item.image = fz_keep_pixmap(image);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_begin_mask(void *user, fz_rect rect, int luminosity, fz_colorspace *colorspace, float *color)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_BEGIN_MASK, fz_identity, colorspace, color, 0);
+	node->rect = rect;
+	node->flag = luminosity;
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_end_mask(void *user)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_END_MASK, fz_identity, NULL, NULL, 0);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_begin_group(void *user, fz_rect rect, int isolated, int knockout, int blendmode, float alpha)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_BEGIN_GROUP, fz_identity, NULL, NULL, alpha);
+	node->rect = rect;
+	node->item.blendmode = blendmode;
+	node->flag |= isolated ? ISOLATED : 0;
+	node->flag |= knockout ? KNOCKOUT : 0;
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_end_group(void *user)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_END_GROUP, fz_identity, NULL, NULL, 0);
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_begin_tile(void *user, fz_rect area, fz_rect view, float xstep, float ystep, fz_matrix ctm)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_BEGIN_TILE, ctm, NULL, NULL, 0);
+	node->rect = area;
+	node->color[0] = xstep;
+	node->color[1] = ystep;
+	node->color[2] = view.x0;
+	node->color[3] = view.y0;
+	node->color[4] = view.x1;
+	node->color[5] = view.y1;
+	fz_append_display_node(user, node);
+}
+
+static void
+fz_list_end_tile(void *user)
+{
+	fz_display_node *node;
+	node = fz_new_display_node(user, FZ_CMD_END_TILE, fz_identity, NULL, NULL, 0);
+	fz_append_display_node(user, node);
+}
+
+fz_device *
+fz_new_list_device(fz_display_list *list)
+{
+	fz_device *dev = fz_new_device(list);
+
+	dev->fill_path = fz_list_fill_path;
+	dev->stroke_path = fz_list_stroke_path;
+	dev->clip_path = fz_list_clip_path;
+	dev->clip_stroke_path = fz_list_clip_stroke_path;
+
+	dev->fill_text = fz_list_fill_text;
+	dev->stroke_text = fz_list_stroke_text;
+	dev->clip_text = fz_list_clip_text;
+	dev->clip_stroke_text = fz_list_clip_stroke_text;
+	dev->ignore_text = fz_list_ignore_text;
+
+	dev->fill_shade = fz_list_fill_shade;
+	dev->fill_image = fz_list_fill_image;
+	dev->fill_image_mask = fz_list_fill_image_mask;
+	dev->clip_image_mask = fz_list_clip_image_mask;
+
+	dev->pop_clip = fz_list_pop_clip;
+
+	dev->begin_mask = fz_list_begin_mask;
+	dev->end_mask = fz_list_end_mask;
+	dev->begin_group = fz_list_begin_group;
+	dev->end_group = fz_list_end_group;
+
+	dev->begin_tile = fz_list_begin_tile;
+	dev->end_tile = fz_list_end_tile;
+
+	return dev;
+}
+
+fz_display_list *
+fz_new_display_list(void)
+{
+	fz_display_list *list = fz_malloc(sizeof(fz_display_list));
+	list->arena = fz_new_arena();
+	list->first = NULL;
+	list->last = NULL;
+	list->top = 0;
+	list->tiled = 0;
+	list->indexed_last = NULL;
+	list->span_count = 0;
+	list->spans = NULL;
+	list->grid_w = 0;
+	list->grid_h = 0;
+	list->cell_start = NULL;
+	list->cell_spans = NULL;
+	list->always_count = 0;
+	list->always_spans = NULL;
+	list->candidates = NULL;
+	list->marks = NULL;
+	return list;
+}
+
+static void
+fz_free_display_index(fz_display_list *list)
+{
+	fz_free(list->spans);
+	fz_free(list->cell_start);
+	fz_free(list->cell_spans);
+	fz_free(list->always_spans);
+	fz_free(list->candidates);
+	fz_free(list->marks);
+	list->indexed_last = NULL;
+	list->span_count = 0;
+	list->spans = NULL;
+	list->grid_w = 0;
+	list->grid_h = 0;
+	list->cell_start = NULL;
+	list->cell_spans = NULL;
+	list->always_count = 0;
+	list->always_spans = NULL;
+	list->candidates = NULL;
+	list->marks = NULL;
+}
+
+void
+fz_free_display_list(fz_display_list *list)
+{
+	fz_display_node *node = list->first;
+	while (node)
+	{
+		fz_display_node *next = node->next;
+		fz_drop_display_node(node);
+		node = next;
+	}
+	fz_free_display_index(list);
+	fz_free_arena(list->arena);
+	fz_free(list);
+}
+
+/* Returns size of memory taken by list nodes and index. */
+int
+fz_display_list_size(fz_display_list *list)
+{
+	int size = sizeof(fz_display_list) + fz_arena_size(list->arena);
+	if (list->spans)
+	{
+		size += list->span_count * (sizeof(fz_display_span) + 2 * sizeof(int) + 1);
+		size += (list->grid_w * list->grid_h + 1) * sizeof(int);
+		size += list->cell_start[list->grid_w * list->grid_h] * sizeof(int);
+	}
+	return size;
+}
+
+static int
+fz_is_opening_node(fz_display_node *node)
+{
+	switch (node->cmd)
+	{
+	case FZ_CMD_CLIP_PATH:
+	case FZ_CMD_CLIP_STROKE_PATH:
+	case FZ_CMD_CLIP_TEXT:
+	case FZ_CMD_CLIP_STROKE_TEXT:
+	case FZ_CMD_CLIP_IMAGE_MASK:
+	case FZ_CMD_BEGIN_MASK:
+	case FZ_CMD_BEGIN_GROUP:
+	case FZ_CMD_BEGIN_TILE:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static int
+fz_is_closing_node(fz_display_node *node)
+{
+	switch (node->cmd)
+	{
+	case FZ_CMD_POP_CLIP:
+	case FZ_CMD_END_GROUP:
+	case FZ_CMD_END_TILE:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Get cells covered by rect, clamped to grid.
+ * Returns 0 if rect is outside of grid.
+ */
+static int
+fz_get_index_cells(fz_display_list *list, fz_rect rect, int *x0, int *y0, int *x1, int *y1)
+{
+	float cw = (list->bounds.x1 - list->bounds.x0) / list->grid_w;
+	float ch = (list->bounds.y1 - list->bounds.y0) / list->grid_h;
+
+	if (rect.x1 < list->bounds.x0 || rect.x0 > list->bounds.x1 ||
+		rect.y1 < list->bounds.y0 || rect.y0 > list->bounds.y1)
+		return 0;
+
+	*x0 = cw > 0 ? (int)((rect.x0 - list->bounds.x0) / cw) : 0;
+	*y0 = ch > 0 ? (int)((rect.y0 - list->bounds.y0) / ch) : 0;
+	*x1 = cw > 0 ? (int)((rect.x1 - list->bounds.x0) / cw) : list->grid_w - 1;
+	*y1 = ch > 0 ? (int)((rect.y1 - list->bounds.y0) / ch) : list->grid_h - 1;
+	*x0 = CLAMP(*x0, 0, list->grid_w - 1);
+	*y0 = CLAMP(*y0, 0, list->grid_h - 1);
+	*x1 = CLAMP(*x1, 0, list->grid_w - 1);
+	*y1 = CLAMP(*y1, 0, list->grid_h - 1);
+	return 1;
+}
+
+/*
+ * Split list into spans and put them in uniform grid over list bounds.
+ * Span rect is the rect of its first node, the same rect that
+ * fz_execute_display_list tests to decide if whole span is culled.
+ */
+static void
+fz_build_display_index(fz_display_list *list)
+{
+	fz_display_node *node;
+	fz_display_span *span;
+	int *pos;
+	int depth, count, always;
+	int i, x, y, x0, y0, x1, y1, total;
+
+	fz_free_display_index(list);
+
+	count = 0;
+	depth = 0;
+	for (node = list->first; node; node = node->next)
+	{
+		if (depth == 0)
+			count++;
+		if (fz_is_opening_node(node))
+			depth++;
+		else if (fz_is_closing_node(node) && depth > 0)
+			depth--;
+	}
+
+	list->indexed_last = list->last;
+	list->span_count = count;
+	if (count < INDEX_MIN_SPANS)
+		return;
+
+	list->spans = fz_calloc(count, sizeof(fz_display_span));
+	list->bounds = fz_empty_rect;
+	span = NULL;
+	depth = 0;
+	for (node = list->first; node; node = node->next)
+	{
+		if (depth == 0)
+		{
+			if (span)
+				span->end = node;
+			span = span ? span + 1 : list->spans;
+			span->first = node;
+			span->end = NULL;
+			/* tiles are not culled, unbalanced closing nodes are always executed */
+			always = node->cmd == FZ_CMD_BEGIN_TILE || fz_is_closing_node(node);
+			span->rect = always ? fz_infinite_rect : node->rect;
+			if (!fz_is_infinite_rect(span->rect) && !fz_is_empty_rect(span->rect))
+				list->bounds = fz_union_rect(list->bounds, span->rect);
+		}
+		if (fz_is_opening_node(node))
+			depth++;
+		else if (fz_is_closing_node(node) && depth > 0)
+			depth--;
+	}
+
+	/* about 4 spans per cell if spans were spread evenly */
+	list->grid_w = CLAMP((int)sqrtf(count / 4), 1, INDEX_MAX_GRID);
+	list->grid_h = list->grid_w;
+	list->cell_start = fz_calloc(list->grid_w * list->grid_h + 1, sizeof(int));
+	list->always_spans = fz_calloc(count, sizeof(int));
+	list->candidates = fz_calloc(count, sizeof(int));
+	list->marks = fz_calloc(count, 1);
+	/* fz_calloc doesn't clear memory */
+	memset(list->cell_start, 0, (list->grid_w * list->grid_h + 1) * sizeof(int));
+	memset(list->marks, 0, count);
+
+	/* count spans per cell, then fill cells */
+	total = 0;
+	for (i = 0; i < count; i++)
+	{
+		span = &list->spans[i];
+		if (fz_is_infinite_rect(span->rect))
+		{
+			list->always_spans[list->always_count++] = i;
+			continue;
+		}
+		/* spans with empty rect are always culled */
+		if (fz_is_empty_rect(span->rect))
+			continue;
+		if (!fz_get_index_cells(list, span->rect, &x0, &y0, &x1, &y1))
+			continue;
+		for (y = y0; y <= y1; y++)
+			for (x = x0; x <= x1; x++)
+				list->cell_start[y * list->grid_w + x + 1]++;
+		total += (x1 - x0 + 1) * (y1 - y0 + 1);
+	}
+	for (i = 0; i < list->grid_w * list->grid_h; i++)
+		list->cell_start[i + 1] += list->cell_start[i];
+
+	list->cell_spans = fz_calloc(MAX(total, 1), sizeof(int));
+	pos = fz_calloc(list->grid_w * list->grid_h, sizeof(int));
+	for (i = 0; i < list->grid_w * list->grid_h; i++)
+		pos[i] = list->cell_start[i];
+	for (i = 0; i < count; i++)
+	{
+		span = &list->spans[i];
+		if (fz_is_infinite_rect(span->rect) || fz_is_empty_rect(span->rect))
+			continue;
+		if (!fz_get_index_cells(list, span->rect, &x0, &y0, &x1, &y1))
+			continue;
+		for (y = y0; y <= y1; y++)
+			for (x = x0; x <= x1; x++)
+				list->cell_spans[pos[y * list->grid_w + x]++] = i;
+	}
+	fz_free(pos);
+}
+
+static int
+fz_compare_ints(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * Find spans that may intersect rect, in list order.
+ * Returns number of spans stored in list->candidates.
+ */
+static int
+fz_query_display_index(fz_display_list *list, fz_rect rect)
+{
+	int i, k, n, x, y, x0, y0, x1, y1;
+	int *cell;
+
+	n = 0;
+	for (i = 0; i < list->always_count; i++)
+	{
+		list->marks[list->always_spans[i]] = 1;
+		list->candidates[n++] = list->always_spans[i];
+	}
+	if (fz_get_index_cells(list, rect, &x0, &y0, &x1, &y1))
+	{
+		for (y = y0; y <= y1; y++)
+		{
+			for (x = x0; x <= x1; x++)
+			{
+				cell = &list->cell_start[y * list->grid_w + x];
+				for (k = cell[0]; k < cell[1]; k++)
+				{
+					i = list->cell_spans[k];
+					if (!list->marks[i])
+					{
+						list->marks[i] = 1;
+						list->candidates[n++] = i;
+					}
+				}
+			}
+		}
+	}
+	for (i = 0; i < n; i++)
+		list->marks[list->candidates[i]] = 0;
+	qsort(list->candidates, n, sizeof(int), fz_compare_ints);
+	return n;
+}
+
+static void
+fz_execute_display_nodes(fz_display_node *first, fz_display_node *end, fz_device *dev, fz_matrix top_ctm, fz_bbox scissor)
+{
+	fz_display_node *node;
+	fz_matrix ctm;
+	fz_rect rect;
+	fz_bbox bbox;
+	int clipped = 0;
+	int tiled = 0;
+	int empty;
+
+	for (node = first; node != end; node = node->next)
+	{
+		/* cull objects to draw using a quick visibility test */
+
+		if (tiled || node->cmd == FZ_CMD_BEGIN_TILE || node->cmd == FZ_CMD_END_TILE)
+		{
+			empty = 0;
+		}
+		else
+		{
+			bbox = fz_round_rect(fz_transform_rect(top_ctm, node->rect));
+			bbox = fz_intersect_bbox(bbox, scissor);
+			empty = fz_is_empty_bbox(bbox);
+		}
+
+		/* skip what target device doesn't want, like interpreter does */
+		if ((dev->hints & FZ_IGNORE_IMAGE) && (node->cmd == FZ_CMD_FILL_IMAGE ||
+			node->cmd == FZ_CMD_FILL_IMAGE_MASK || node->cmd == FZ_CMD_CLIP_IMAGE_MASK))
+			empty = 1;
+		if ((dev->hints & FZ_IGNORE_SHADE) && node->cmd == FZ_CMD_FILL_SHADE)
+			empty = 1;
+
+		if (clipped || empty)
+		{
+			switch (node->cmd)
+			{
+			case FZ_CMD_CLIP_PATH:
+			case FZ_CMD_CLIP_STROKE_PATH:
+			case FZ_CMD_CLIP_TEXT:
+			case FZ_CMD_CLIP_STROKE_TEXT:
+			case FZ_CMD_CLIP_IMAGE_MASK:
+			case FZ_CMD_BEGIN_MASK:
+			case FZ_CMD_BEGIN_GROUP:
+				clipped++;
+				continue;
+			case FZ_CMD_POP_CLIP:
+			case FZ_CMD_END_GROUP:
+				if (!clipped)
+					goto visible;
+				clipped--;
+				continue;
+			case FZ_CMD_END_MASK:
+				if (!clipped)
+					goto visible;
+				continue;
+			default:
+				continue;
+			}
+		}
+
+visible:
+		ctm = fz_concat(node->ctm, top_ctm);
+
+		switch (node->cmd)
+		{
+		case FZ_CMD_FILL_PATH:
+			fz_fill_path(dev, node->item.path, node->flag, ctm,
+				node->colorspace, node->color, node->alpha);
+			break;
+		case FZ_CMD_STROKE_PATH:
+			fz_stroke_path(dev, node->item.path, node->stroke, ctm,
+				node->colorspace, node->color, node->alpha);
+			break;
+		case FZ_CMD_CLIP_PATH:
+		{
+			fz_rect trect = fz_transform_rect(top_ctm, node->rect);
+			fz_clip_path(dev, node->item.path, &trect, node->flag, ctm);
+			break;
+		}
+		case FZ_CMD_CLIP_STROKE_PATH:
+		{
+			fz_rect trect = fz_transform_rect(top_ctm, node->rect);
+			fz_clip_stroke_path(dev, node->item.path, &trect, node->stroke, ctm);
+			break;
+		}
+		case FZ_CMD_FILL_TEXT:
+			fz_fill_text(dev, node->item.text, ctm,
+				node->colorspace, node->color, node->alpha);
+			break;
+		case FZ_CMD_STROKE_TEXT:
+			fz_stroke_text(dev, node->item.text, node->stroke, ctm,
+				node->colorspace, node->color, node->alpha);
+			break;
+		case FZ_CMD_CLIP_TEXT:
+			fz_clip_text(dev, node->item.text, ctm, node->flag);
+			break;
+		case FZ_CMD_CLIP_STROKE_TEXT:
+			fz_clip_stroke_text(dev, node->item.text, node->stroke, ctm);
+			break;
+		case FZ_CMD_IGNORE_TEXT:
+			fz_ignore_text(dev, node->item.text, ctm);
+			break;
+		case FZ_CMD_FILL_SHADE:
+			fz_fill_shade(dev, node->item.shade, ctm, node->alpha);
+			break;
+		case FZ_CMD_FILL_IMAGE:
+			fz_fill_image(dev, node->item.image, ctm, node->alpha);
+			break;
+		case FZ_CMD_FILL_IMAGE_MASK:
+			fz_fill_image_mask(dev, node->item.image, ctm,
+				node->colorspace, node->color, node->alpha);
+			break;
+		case FZ_CMD_CLIP_IMAGE_MASK:
+		{
+			fz_rect trect = fz_transform_rect(top_ctm, node->rect);
+			fz_clip_image_mask(dev, node->item.image, &trect, ctm);
+			break;
+		}
+		case FZ_CMD_POP_CLIP:
+			fz_pop_clip(dev);
+			break;
+		case FZ_CMD_BEGIN_MASK:
+			rect = fz_transform_rect(top_ctm, node->rect);
+			fz_begin_mask(dev, rect, node->flag, node->colorspace, node->color);
+			break;
+		case FZ_CMD_END_MASK:
+			fz_end_mask(dev);
+			break;
+		case FZ_CMD_BEGIN_GROUP:
+			rect = fz_transform_rect(top_ctm, node->rect);
+			fz_begin_group(dev, rect,
+				(node->flag & ISOLATED) != 0, (node->flag & KNOCKOUT) != 0,
+				node->item.blendmode, node->alpha);
+			break;
+		case FZ_CMD_END_GROUP:
+			fz_end_group(dev);
+			break;
+		case FZ_CMD_BEGIN_TILE:
+			tiled++;
+			rect.x0 = node->color[2];
+			rect.y0 = node->color[3];
+			rect.x1 = node->color[4];
+			rect.y1 = node->color[5];
+			fz_begin_tile(dev, node->rect, rect,
+				node->color[0], node->color[1], ctm);
+			break;
+		case FZ_CMD_END_TILE:
+			tiled--;
+			fz_end_tile(dev);
+			break;
+		}
+	}
+}
+
+void
+fz_execute_display_list(fz_display_list *list, fz_device *dev, fz_matrix top_ctm, fz_bbox scissor)
+{
+	fz_rect area;
+	fz_display_span *span;
+	int i, n;
+
+	if (!fz_is_infinite_bbox(scissor))
+	{
+		/* add some fuzz at the edges, as especially glyph rects
+		 * are sometimes not actually completely bounding the glyph */
+		scissor.x0 -= 20; scissor.y0 -= 20;
+		scissor.x1 += 20; scissor.y1 += 20;
+	}
+
+	if (list->indexed_last != list->last)
+		fz_build_display_index(list);
+
+	if (fz_is_infinite_bbox(scissor) || !list->spans)
+	{
+		fz_execute_display_nodes(list->first, NULL, dev, top_ctm, scissor);
+		return;
+	}
+
+	/* scissor in list space; bounding box of it is enough for the index */
+	area.x0 = scissor.x0;
+	area.y0 = scissor.y0;
+	area.x1 = scissor.x1;
+	area.y1 = scissor.y1;
+	area = fz_transform_rect(fz_invert_matrix(top_ctm), area);
+
+	n = fz_query_display_index(list, area);
+	for (i = 0; i < n; i++)
+	{
+		span = &list->spans[list->candidates[i]];
+		fz_execute_display_nodes(span->first, span->end, dev, top_ctm, scissor);
+	}
+}
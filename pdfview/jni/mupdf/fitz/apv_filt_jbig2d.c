@@ -0,0 +1,199 @@
+
+/*
+ * This is a modified version of filt_jbig2d.c file which is part of MuPDF
+ * by Artifex Software, Inc.
+ * Adds fz_jbig2_globals, decoded JBIG2Globals segments that can be shared by
+ * decoders of all pages using them, so symbol dictionaries are decoded once.
+ */
+
+#include "fitz.h"
+
+#ifdef _WIN32 /* Microsoft Visual C++ */
+
+typedef signed char int8_t;
+typedef short int int16_t;
+typedef int int32_t;
+typedef __int64 int64_t;
+
+typedef unsigned char uint8_t;
+typedef unsigned short int uint16_t;
+typedef unsigned int uint32_t;
+
+#else
+#include <inttypes.h>
+#endif
+
+#include <jbig2.h>
+#include "jbig2_priv.h"
+#include "jbig2_symbol_dict.h"
+
+typedef struct fz_jbig2d_s fz_jbig2d;
+typedef struct fz_jbig2_globals_s fz_jbig2_globals;
+
+struct fz_jbig2_globals_s
+{
+	int refs;
+	Jbig2GlobalCtx *gctx;
+	int size;
+};
+
+struct fz_jbig2d_s
+{
+	fz_stream *chain;
+	Jbig2Ctx *ctx;
+	fz_jbig2_globals *globals;
+	Jbig2Image *page;
+	int idx;
+};
+
+/*
+ * Estimate bytes held by global segments, counting glyphs of symbol dictionaries.
+ */
+static int
+fz_jbig2_global_ctx_size(Jbig2Ctx *ctx)
+{
+	Jbig2SymbolDict *dict;
+	Jbig2Image *glyph;
+	int size = 0;
+	int i, k;
+
+	for (i = 0; i < ctx->segment_index; i++)
+	{
+		if ((ctx->segments[i]->flags & 63) != 0 || !ctx->segments[i]->result)
+			continue;
+		dict = ctx->segments[i]->result;
+		for (k = 0; k < dict->n_symbols; k++)
+		{
+			glyph = dict->glyphs[k];
+			if (glyph)
+				size += sizeof(Jbig2Image) + glyph->stride * glyph->height;
+		}
+	}
+
+	return size;
+}
+
+/*
+ * Decode JBIG2Globals stream contents.
+ */
+fz_jbig2_globals *
+fz_load_jbig2_globals(unsigned char *data, int len)
+{
+	fz_jbig2_globals *globals;
+	Jbig2Ctx *ctx;
+
+	ctx = jbig2_ctx_new(NULL, JBIG2_OPTIONS_EMBEDDED, NULL, NULL, NULL);
+	jbig2_data_in(ctx, data, len);
+
+	globals = fz_malloc(sizeof(fz_jbig2_globals));
+	globals->refs = 1;
+	globals->size = fz_jbig2_global_ctx_size(ctx);
+	globals->gctx = jbig2_make_global_ctx(ctx);
+	return globals;
+}
+
+fz_jbig2_globals *
+fz_keep_jbig2_globals(fz_jbig2_globals *globals)
+{
+	globals->refs++;
+	return globals;
+}
+
+void
+fz_drop_jbig2_globals(fz_jbig2_globals *globals)
+{
+	if (globals && --globals->refs == 0)
+	{
+		jbig2_global_ctx_free(globals->gctx);
+		fz_free(globals);
+	}
+}
+
+int
+fz_jbig2_globals_size(fz_jbig2_globals *globals)
+{
+	return sizeof(fz_jbig2_globals) + globals->size;
+}
+
+static void
+close_jbig2d(fz_stream *stm)
+{
+	fz_jbig2d *state = stm->state;
+	if (state->page)
+		jbig2_release_page(state->ctx, state->page);
+	jbig2_ctx_free(state->ctx);
+	fz_drop_jbig2_globals(state->globals);
+	fz_close(state->chain);
+	fz_free(state);
+}
+
+static int
+read_jbig2d(fz_stream *stm, unsigned char *buf, int len)
+{
+	fz_jbig2d *state = stm->state;
+	unsigned char tmp[4096];
+	unsigned char *p = buf;
+	unsigned char *ep = buf + len;
+	unsigned char *s;
+	int x, w, n;
+
+	if (!state->page)
+	{
+		while (1)
+		{
+			n = fz_read(state->chain, tmp, sizeof tmp);
+			if (n < 0)
+				return fz_rethrow(n, "read error in jbig2 filter");
+			if (n == 0)
+				break;
+			jbig2_data_in(state->ctx, tmp, n);
+		}
+
+		jbig2_complete_page(state->ctx);
+
+		state->page = jbig2_page_out(state->ctx);
+		if (!state->page)
+			return fz_throw("jbig2_page_out failed");
+	}
+
+	s = state->page->data;
+	w = state->page->height * state->page->stride;
+	x = state->idx;
+	while (p < ep && x < w)
+		*p++ = s[x++] ^ 0xff;
+	state->idx = x;
+
+	return p - buf;
+}
+
+/*
+ * Open JBIG2 decoder that refers to already decoded global segments.
+ * Decoder keeps its own reference to globals, which may be NULL.
+ */
+fz_stream *
+fz_open_jbig2d_globals(fz_stream *chain, fz_jbig2_globals *globals)
+{
+	fz_jbig2d *state;
+
+	state = fz_malloc(sizeof(fz_jbig2d));
+	state->chain = chain;
+	state->globals = globals ? fz_keep_jbig2_globals(globals) : NULL;
+	state->ctx = jbig2_ctx_new(NULL, JBIG2_OPTIONS_EMBEDDED, globals ? globals->gctx : NULL, NULL, NULL);
+	state->page = NULL;
+	state->idx = 0;
+
+	return fz_new_stream(state, read_jbig2d, close_jbig2d);
+}
+
+fz_stream *
+fz_open_jbig2d(fz_stream *chain, fz_buffer *globals)
+{
+	fz_jbig2_globals *decoded = NULL;
+	fz_stream *stm;
+
+	if (globals)
+		decoded = fz_load_jbig2_globals(globals->data, globals->len);
+	stm = fz_open_jbig2d_globals(chain, decoded);
+	fz_drop_jbig2_globals(decoded);
+	return stm;
+}
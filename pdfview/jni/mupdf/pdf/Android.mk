@@ -13,35 +13,34 @@ LOCAL_SRC_FILES := \
 	pdf_nametree.c \
 	pdf_parse.c \
 	pdf_repair.c \
-	pdf_stream.c \
+	apv_pdf_stream.c \
 	pdf_xref.c \
 	pdf_annot.c \
 	pdf_outline.c \
 	pdf_cmap.c \
 	pdf_cmap_parse.c \
 	pdf_cmap_load.c \
-	pdf_cmap_table.c \
+	apv_pdf_cmap_table.c \
 	pdf_encoding.c \
 	pdf_unicode.c \
-	pdf_font.c \
+	apv_pdf_font.c \
 	pdf_type3.c \
 	pdf_metrics.c \
-	pdf_fontfile.c \
+	apv_pdf_fontfile.c \
 	pdf_function.c \
 	pdf_colorspace.c \
-	pdf_image.c \
+	apv_pdf_image.c \
 	pdf_pattern.c \
 	pdf_shade.c \
 	pdf_xobject.c \
-	pdf_interpret.c \
+	apv_pdf_interpret.c \
 	pdf_page.c \
-	pdf_store.c \
-	pdf_crypt.c
+	apv_pdf_store.c \
+	pdf_crypt.c \
+	apv_pdf_cjk.c
 
-#	cmap_tounicode.c \
-# 	font_cjk.c \
-# 	cmap_cns.c \
-# 	cmap_gb.c cmap_japan.c cmap_korea.c
+# CJK CMaps and font are not compiled in (NOCJK), they are read from CJK pack
+# built by scripts/cjkpack.c, see apv_pdf_cjk.c
 
 
 
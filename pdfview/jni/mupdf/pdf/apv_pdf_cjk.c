@@ -0,0 +1,223 @@
+
+/*
+ * CJK CMaps and fallback font read from CJK pack (see apv_pdf_cjk.h)
+ * instead of being compiled in. Pack is memory-mapped the first time
+ * a document asks for one of them, and its pages are read on demand,
+ * so documents without CJK text don't pay for it at all.
+ * Pack may be set from any thread while documents are being rendered, so
+ * all pack state is guarded by pdf_cjk_lock.
+ */
+
+#include "fitz.h"
+#include "mupdf.h"
+#include "apv_pdf_cjk.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static pthread_mutex_t pdf_cjk_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *pdf_cjk_path = NULL;
+static int pdf_cjk_offset = 0;
+static int pdf_cjk_length = 0;
+
+static unsigned char *pdf_cjk_data = NULL; /* mapped pack, NULL if not mapped yet */
+static int pdf_cjk_failed = 0;
+static pdf_cjk_entry *pdf_cjk_entries = NULL;
+static int pdf_cjk_count = 0;
+static pdf_cmap **pdf_cjk_cmaps = NULL; /* cmaps created from entries so far, never freed */
+
+/*
+ * Set where CJK pack is: length bytes at offset in file at path.
+ * Pack is not opened until it's needed.
+ */
+void
+pdf_set_cjk_pack(char *path, int offset, int length)
+{
+	pthread_mutex_lock(&pdf_cjk_lock);
+	if (!pdf_cjk_data)
+	{
+		fz_free(pdf_cjk_path);
+		pdf_cjk_path = fz_strdup(path);
+		pdf_cjk_offset = offset;
+		pdf_cjk_length = length;
+		pdf_cjk_failed = 0;
+	}
+	pthread_mutex_unlock(&pdf_cjk_lock);
+}
+
+/* called with pdf_cjk_lock held */
+static int
+pdf_open_cjk_pack(void)
+{
+	pdf_cjk_header *header;
+	unsigned char *map;
+	int start, maplen;
+	int fd;
+	int i;
+
+	if (pdf_cjk_data)
+		return 1;
+	if (pdf_cjk_failed || !pdf_cjk_path)
+		return 0;
+	pdf_cjk_failed = 1;
+
+	fd = open(pdf_cjk_path, O_RDONLY);
+	if (fd < 0)
+	{
+		fz_warn("cannot open cjk pack: %s", pdf_cjk_path);
+		return 0;
+	}
+
+	/* pack inside apk starts wherever zip entry does, while mapping must start at page boundary */
+	start = pdf_cjk_offset - pdf_cjk_offset % getpagesize();
+	maplen = pdf_cjk_offset - start + pdf_cjk_length;
+	map = mmap(NULL, maplen, PROT_READ, MAP_SHARED, fd, start);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		fz_warn("cannot map cjk pack: %s", pdf_cjk_path);
+		return 0;
+	}
+	/* lookups touch few scattered pages, so don't read ahead */
+	madvise(map, maplen, MADV_RANDOM);
+
+	header = (pdf_cjk_header *)(map + pdf_cjk_offset - start);
+	if (pdf_cjk_length < (int)sizeof(pdf_cjk_header) ||
+		memcmp(header->magic, PDF_CJK_MAGIC, sizeof header->magic) != 0 ||
+		header->count < 0 ||
+		header->count > (pdf_cjk_length - (int)sizeof(pdf_cjk_header)) / (int)sizeof(pdf_cjk_entry))
+	{
+		fz_warn("invalid cjk pack: %s", pdf_cjk_path);
+		munmap(map, maplen);
+		return 0;
+	}
+
+	pdf_cjk_entries = (pdf_cjk_entry *)(header + 1);
+	pdf_cjk_count = header->count;
+	for (i = 0; i < pdf_cjk_count; i++)
+	{
+		if (pdf_cjk_entries[i].offset < 0 || pdf_cjk_entries[i].length < 0 ||
+			pdf_cjk_entries[i].offset > pdf_cjk_length - pdf_cjk_entries[i].length)
+		{
+			fz_warn("invalid cjk pack entry: %.32s", pdf_cjk_entries[i].name);
+			munmap(map, maplen);
+			return 0;
+		}
+	}
+
+	pdf_cjk_data = (unsigned char *)header;
+	pdf_cjk_cmaps = fz_calloc(pdf_cjk_count, sizeof(pdf_cmap *));
+	memset(pdf_cjk_cmaps, 0, pdf_cjk_count * sizeof(pdf_cmap *));
+	pdf_cjk_failed = 0;
+	return 1;
+}
+
+/* called with pdf_cjk_lock held */
+static int
+pdf_find_cjk_entry(char *name, int kind)
+{
+	int l, r;
+
+	if (!pdf_open_cjk_pack())
+		return -1;
+
+	l = 0;
+	r = pdf_cjk_count - 1;
+
+	while (l <= r)
+	{
+		int m = (l + r) >> 1;
+		int c = strncmp(name, pdf_cjk_entries[m].name, sizeof pdf_cjk_entries[m].name);
+		if (c < 0)
+			r = m - 1;
+		else if (c > 0)
+			l = m + 1;
+		else
+			return pdf_cjk_entries[m].kind == kind ? m : -1;
+	}
+	return -1;
+}
+
+static pdf_cmap *
+pdf_load_packed_cmap(char *name)
+{
+	pdf_cjk_entry *entry;
+	pdf_cjk_cmap *src;
+	pdf_cmap *cmap;
+	int i;
+
+	i = pdf_find_cjk_entry(name, PDF_CJK_CMAP);
+	if (i < 0)
+		return NULL;
+	if (pdf_cjk_cmaps[i])
+		return pdf_cjk_cmaps[i];
+
+	entry = &pdf_cjk_entries[i];
+	src = (pdf_cjk_cmap *)(pdf_cjk_data + entry->offset);
+	if (entry->length < (int)sizeof(pdf_cjk_cmap) ||
+		src->codespace_len < 0 || src->codespace_len > (int)nelem(src->codespace) ||
+		src->rlen < 0 || src->tlen < 0 ||
+		src->rlen > (entry->length - (int)sizeof(pdf_cjk_cmap)) / (int)sizeof(pdf_range) ||
+		src->tlen > (entry->length - (int)sizeof(pdf_cjk_cmap) - src->rlen * (int)sizeof(pdf_range)) / 2)
+	{
+		fz_warn("invalid cjk pack cmap: %s", name);
+		return NULL;
+	}
+
+	cmap = fz_malloc(sizeof(pdf_cmap));
+	memset(cmap, 0, sizeof(pdf_cmap));
+	cmap->refs = -1;
+	fz_strlcpy(cmap->cmap_name, src->cmap_name, sizeof cmap->cmap_name);
+	fz_strlcpy(cmap->usecmap_name, src->usecmap_name, sizeof cmap->usecmap_name);
+	cmap->usecmap = NULL;
+	cmap->wmode = src->wmode;
+	cmap->codespace_len = src->codespace_len;
+	memcpy(cmap->codespace, src->codespace, sizeof cmap->codespace);
+	cmap->rlen = cmap->rcap = src->rlen;
+	cmap->ranges = (pdf_range *)(src + 1);
+	cmap->tlen = cmap->tcap = src->tlen;
+	cmap->table = (unsigned short *)(cmap->ranges + src->rlen);
+
+	pdf_cjk_cmaps[i] = cmap;
+	return cmap;
+}
+
+/*
+ * Find CMap in CJK pack. It's kept for the rest of process life like
+ * builtin CMaps, and its ranges and table stay in mapped pack.
+ */
+pdf_cmap *
+pdf_find_packed_cmap(char *name)
+{
+	pdf_cmap *cmap;
+
+	pthread_mutex_lock(&pdf_cjk_lock);
+	cmap = pdf_load_packed_cmap(name);
+	pthread_mutex_unlock(&pdf_cjk_lock);
+	return cmap;
+}
+
+/*
+ * Find font file in CJK pack. Returned data stays mapped for the rest of
+ * process life, so it can be used as static font data.
+ */
+unsigned char *
+pdf_find_packed_font(char *name, unsigned int *len)
+{
+	unsigned char *data = NULL;
+	int i;
+
+	*len = 0;
+	pthread_mutex_lock(&pdf_cjk_lock);
+	i = pdf_find_cjk_entry(name, PDF_CJK_FONT);
+	if (i >= 0)
+	{
+		*len = pdf_cjk_entries[i].length;
+		data = pdf_cjk_data + pdf_cjk_entries[i].offset;
+	}
+	pthread_mutex_unlock(&pdf_cjk_lock);
+	return data;
+}
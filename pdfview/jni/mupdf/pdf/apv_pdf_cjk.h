@@ -0,0 +1,52 @@
+
+/*
+ * Layout of CJK pack, a file with CJK CMaps and DroidSansFallback font,
+ * written by scripts/cjkpack.c and memory-mapped by apv_pdf_cjk.c.
+ *
+ * File starts with pdf_cjk_header followed by count pdf_cjk_entry items
+ * sorted by name. Each entry points to either a CMap (pdf_cjk_cmap followed
+ * by rlen pdf_range items and tlen unsigned shorts) or a font file.
+ * Numbers are little-endian and each item starts at 4 byte boundary.
+ */
+
+#define PDF_CJK_MAGIC "APVCJK1"
+
+enum { PDF_CJK_CMAP, PDF_CJK_FONT };
+
+typedef struct pdf_cjk_header_s pdf_cjk_header;
+typedef struct pdf_cjk_entry_s pdf_cjk_entry;
+typedef struct pdf_cjk_cmap_s pdf_cjk_cmap;
+
+struct pdf_cjk_header_s
+{
+	char magic[8];
+	int count;
+};
+
+struct pdf_cjk_entry_s
+{
+	char name[32];
+	int kind;
+	int offset; /* from start of file */
+	int length;
+};
+
+struct pdf_cjk_cmap_s
+{
+	char cmap_name[32];
+	char usecmap_name[32];
+	int wmode;
+	int codespace_len;
+	struct
+	{
+		unsigned short n;
+		unsigned short low;
+		unsigned short high;
+	} codespace[40];
+	int rlen;
+	int tlen;
+};
+
+void pdf_set_cjk_pack(char *path, int offset, int length);
+pdf_cmap *pdf_find_packed_cmap(char *name);
+unsigned char *pdf_find_packed_font(char *name, unsigned int *len);
@@ -0,0 +1,542 @@
+
+/*
+ * This is a modified version of pdf_image.c file which is part of MuPDF
+ * by Artifex Software, Inc.
+ * Adds pdf_load_image_at_size, which decodes plain JPEG and JPEG 2000 images
+ * at the smallest scale that still covers their size on device,
+ * see pdf_image_decode_zoom.
+ */
+
+#include "fitz.h"
+#include "mupdf.h"
+
+/* TODO: store JPEG compressed samples */
+/* TODO: store flate compressed samples */
+
+static fz_error pdf_load_jpx_image(fz_pixmap **imgp, pdf_xref *xref, fz_obj *dict, int l2factor);
+
+extern fz_stream *fz_open_dctd_scaled(fz_stream *chain, fz_obj *params, int l2factor); /* defined in fitz/apv_filt_dctd.c */
+extern fz_error fz_load_jpx_image_scaled(fz_pixmap **imgp, unsigned char *data, int size, fz_colorspace *defcs, int reduce); /* defined in fitz/apv_filt_jpxd.c */
+
+/*
+ * Device pixels per unit of the matrix pages are run with, used to choose
+ * image decode scale. 0 means images are always decoded at full resolution.
+ */
+float pdf_image_decode_zoom = 0;
+
+static void
+pdf_mask_color_key(fz_pixmap *pix, int n, int *colorkey)
+{
+	unsigned char *p = pix->samples;
+	int len = pix->w * pix->h;
+	int k, t;
+	while (len--)
+	{
+		t = 1;
+		for (k = 0; k < n; k++)
+			if (p[k] < colorkey[k * 2] || p[k] > colorkey[k * 2 + 1])
+				t = 0;
+		if (t)
+			for (k = 0; k < pix->n; k++)
+				p[k] = 0;
+		p += pix->n;
+	}
+}
+
+static fz_error
+pdf_load_image_imp(fz_pixmap **imgp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict, fz_stream *cstm, int forcemask, int l2factor)
+{
+	fz_stream *stm;
+	fz_pixmap *tile;
+	fz_obj *obj, *res;
+	fz_error error;
+
+	int w, h, bpc, n;
+	int imagemask;
+	int interpolate;
+	int indexed;
+	fz_colorspace *colorspace;
+	fz_pixmap *mask; /* explicit mask/softmask image */
+	int usecolorkey;
+	int colorkey[FZ_MAX_COLORS * 2];
+	float decode[FZ_MAX_COLORS * 2];
+
+	int stride;
+	unsigned char *samples;
+	int i, len;
+
+	/* special case for JPEG2000 images */
+	if (pdf_is_jpx_image(dict))
+	{
+		tile = NULL;
+		error = pdf_load_jpx_image(&tile, xref, dict, l2factor);
+		if (error)
+			return fz_rethrow(error, "cannot load jpx image");
+		if (forcemask)
+		{
+			if (tile->n != 2)
+			{
+				fz_drop_pixmap(tile);
+				return fz_throw("softmask must be grayscale");
+			}
+			mask = fz_alpha_from_gray(tile, 1);
+			fz_drop_pixmap(tile);
+			*imgp = mask;
+			return fz_okay;
+		}
+		*imgp = tile;
+		return fz_okay;
+	}
+
+	w = fz_to_int(fz_dict_getsa(dict, "Width", "W"));
+	h = fz_to_int(fz_dict_getsa(dict, "Height", "H"));
+	bpc = fz_to_int(fz_dict_getsa(dict, "BitsPerComponent", "BPC"));
+	imagemask = fz_to_bool(fz_dict_getsa(dict, "ImageMask", "IM"));
+	interpolate = fz_to_bool(fz_dict_getsa(dict, "Interpolate", "I"));
+
+	indexed = 0;
+	usecolorkey = 0;
+	colorspace = NULL;
+	mask = NULL;
+
+	if (imagemask)
+		bpc = 1;
+
+	if (w == 0)
+		return fz_throw("image width is zero");
+	if (h == 0)
+		return fz_throw("image height is zero");
+	if (bpc == 0)
+		return fz_throw("image depth is zero");
+	if (bpc > 16)
+		return fz_throw("image depth is too large: %d", bpc);
+	if (w > (1 << 16))
+		return fz_throw("image is too wide");
+	if (h > (1 << 16))
+		return fz_throw("image is too high");
+
+	/* DCT scaling rounds output size up */
+	if (l2factor > 0)
+	{
+		w = (w + (1 << l2factor) - 1) >> l2factor;
+		h = (h + (1 << l2factor) - 1) >> l2factor;
+	}
+
+	obj = fz_dict_getsa(dict, "ColorSpace", "CS");
+	if (obj && !imagemask && !forcemask)
+	{
+		/* colorspace resource lookup is only done for inline images */
+		if (fz_is_name(obj))
+		{
+			res = fz_dict_get(fz_dict_gets(rdb, "ColorSpace"), obj);
+			if (res)
+				obj = res;
+		}
+
+		error = pdf_load_colorspace(&colorspace, xref, obj);
+		if (error)
+			return fz_rethrow(error, "cannot load image colorspace");
+
+		if (!strcmp(colorspace->name, "Indexed"))
+			indexed = 1;
+
+		n = colorspace->n;
+	}
+	else
+	{
+		n = 1;
+	}
+
+	obj = fz_dict_getsa(dict, "Decode", "D");
+	if (obj)
+	{
+		for (i = 0; i < n * 2; i++)
+			decode[i] = fz_to_real(fz_array_get(obj, i));
+	}
+	else
+	{
+		float maxval = indexed ? (1 << bpc) - 1 : 1;
+		for (i = 0; i < n * 2; i++)
+			decode[i] = i & 1 ? maxval : 0;
+	}
+
+	obj = fz_dict_getsa(dict, "SMask", "Mask");
+	if (fz_is_dict(obj))
+	{
+		/* Not allowed for inline images */
+		if (!cstm)
+		{
+			error = pdf_load_image_imp(&mask, xref, rdb, obj, NULL, 1, 0);
+			if (error)
+			{
+				if (colorspace)
+					fz_drop_colorspace(colorspace);
+				return fz_rethrow(error, "cannot load image mask/softmask");
+			}
+		}
+	}
+	else if (fz_is_array(obj))
+	{
+		usecolorkey = 1;
+		for (i = 0; i < n * 2; i++)
+		{
+			if (!fz_is_int(fz_array_get(obj, i)))
+			{
+				fz_warn("invalid value in color key mask");
+				usecolorkey = 0;
+			}
+			colorkey[i] = fz_to_int(fz_array_get(obj, i));
+		}
+	}
+
+	/* Allocate now, to fail early if we run out of memory */
+	tile = fz_new_pixmap_with_limit(colorspace, w, h);
+	if (!tile)
+	{
+		if (colorspace)
+			fz_drop_colorspace(colorspace);
+		if (mask)
+			fz_drop_pixmap(mask);
+		return fz_throw("out of memory");
+	}
+
+	if (colorspace)
+		fz_drop_colorspace(colorspace);
+
+	tile->mask = mask;
+	tile->interpolate = interpolate;
+
+	stride = (w * n * bpc + 7) / 8;
+
+	if (cstm)
+	{
+		stm = pdf_open_inline_stream(cstm, xref, dict, stride * h);
+	}
+	else if (l2factor > 0)
+	{
+		/* only plain DCTDecode images get here, JPX is handled above */
+		error = pdf_open_raw_stream(&stm, xref, fz_to_num(dict), fz_to_gen(dict));
+		if (error)
+		{
+			fz_drop_pixmap(tile);
+			return fz_rethrow(error, "cannot open image data stream (%d 0 R)", fz_to_num(dict));
+		}
+		obj = fz_dict_gets(dict, "DecodeParms");
+		if (fz_is_array(obj))
+			obj = fz_array_get(obj, 0);
+		stm = fz_open_dctd_scaled(stm, obj, l2factor);
+	}
+	else
+	{
+		error = pdf_open_stream(&stm, xref, fz_to_num(dict), fz_to_gen(dict));
+		if (error)
+		{
+			fz_drop_pixmap(tile);
+			return fz_rethrow(error, "cannot open image data stream (%d 0 R)", fz_to_num(dict));
+		}
+	}
+
+	samples = fz_calloc(h, stride);
+
+	len = fz_read(stm, samples, h * stride);
+	if (len < 0)
+	{
+		fz_close(stm);
+		fz_free(samples);
+		fz_drop_pixmap(tile);
+		return fz_rethrow(len, "cannot read image data");
+	}
+
+	/* Make sure we read the EOF marker (for inline images only) */
+	if (cstm)
+	{
+		unsigned char tbuf[512];
+		int tlen = fz_read(stm, tbuf, sizeof tbuf);
+		if (tlen < 0)
+			fz_catch(tlen, "ignoring error at end of image");
+		if (tlen > 0)
+			fz_warn("ignoring garbage at end of image");
+	}
+
+	fz_close(stm);
+
+	/* Pad truncated images */
+	if (len < stride * h)
+	{
+		fz_warn("padding truncated image (%d 0 R)", fz_to_num(dict));
+		memset(samples + len, 0, stride * h - len);
+	}
+
+	/* Invert 1-bit image masks */
+	if (imagemask)
+	{
+		/* 0=opaque and 1=transparent so we need to invert */
+		unsigned char *p = samples;
+		len = h * stride;
+		for (i = 0; i < len; i++)
+			p[i] = ~p[i];
+	}
+
+	fz_unpack_tile(tile, samples, n, bpc, stride, indexed);
+
+	fz_free(samples);
+
+	if (usecolorkey)
+		pdf_mask_color_key(tile, n, colorkey);
+
+	if (indexed)
+	{
+		fz_pixmap *conv;
+		fz_decode_indexed_tile(tile, decode, (1 << bpc) - 1);
+		conv = pdf_expand_indexed_pixmap(tile);
+		fz_drop_pixmap(tile);
+		tile = conv;
+	}
+	else
+	{
+		fz_decode_tile(tile, decode);
+	}
+
+	*imgp = tile;
+	return fz_okay;
+}
+
+fz_error
+pdf_load_inline_image(fz_pixmap **pixp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict, fz_stream *file)
+{
+	fz_error error;
+
+	error = pdf_load_image_imp(pixp, xref, rdb, dict, file, 0, 0);
+	if (error)
+		return fz_rethrow(error, "cannot load inline image");
+
+	return fz_okay;
+}
+
+int
+pdf_is_jpx_image(fz_obj *dict)
+{
+	fz_obj *filter;
+	int i;
+
+	filter = fz_dict_gets(dict, "Filter");
+	if (!strcmp(fz_to_name(filter), "JPXDecode"))
+		return 1;
+	for (i = 0; i < fz_array_len(filter); i++)
+		if (!strcmp(fz_to_name(fz_array_get(filter, i)), "JPXDecode"))
+			return 1;
+	return 0;
+}
+
+static fz_error
+pdf_load_jpx_image(fz_pixmap **imgp, pdf_xref *xref, fz_obj *dict, int l2factor)
+{
+	fz_error error;
+	fz_buffer *buf;
+	fz_colorspace *colorspace;
+	fz_pixmap *img;
+	fz_obj *obj;
+
+	colorspace = NULL;
+
+	error = pdf_load_stream(&buf, xref, fz_to_num(dict), fz_to_gen(dict));
+	if (error)
+		return fz_rethrow(error, "cannot load jpx image data");
+
+	obj = fz_dict_gets(dict, "ColorSpace");
+	if (obj)
+	{
+		error = pdf_load_colorspace(&colorspace, xref, obj);
+		if (error)
+			fz_catch(error, "cannot load image colorspace");
+	}
+
+	error = fz_load_jpx_image_scaled(&img, buf->data, buf->len, colorspace, l2factor);
+	if (error)
+	{
+		if (colorspace)
+			fz_drop_colorspace(colorspace);
+		fz_drop_buffer(buf);
+		return fz_rethrow(error, "cannot load jpx image");
+	}
+
+	if (colorspace)
+		fz_drop_colorspace(colorspace);
+	fz_drop_buffer(buf);
+
+	obj = fz_dict_getsa(dict, "SMask", "Mask");
+	if (fz_is_dict(obj))
+	{
+		error = pdf_load_image_imp(&img->mask, xref, NULL, obj, NULL, 1, 0);
+		if (error)
+		{
+			fz_drop_pixmap(img);
+			return fz_rethrow(error, "cannot load image mask/softmask");
+		}
+	}
+
+	obj = fz_dict_getsa(dict, "Decode", "D");
+	if (obj)
+	{
+		float decode[FZ_MAX_COLORS * 2];
+		int i;
+
+		for (i = 0; i < img->n * 2; i++)
+			decode[i] = fz_to_real(fz_array_get(obj, i));
+
+		fz_decode_tile(img, decode);
+	}
+
+	*imgp = img;
+	return fz_okay;
+}
+
+fz_error
+pdf_load_image(fz_pixmap **pixp, pdf_xref *xref, fz_obj *dict)
+{
+	fz_error error;
+
+	if ((*pixp = pdf_find_item(xref->store, fz_drop_pixmap, dict)))
+	{
+		fz_keep_pixmap(*pixp);
+		return fz_okay;
+	}
+
+	error = pdf_load_image_imp(pixp, xref, NULL, dict, NULL, 0, 0);
+	if (error)
+		return fz_rethrow(error, "cannot load image (%d 0 R)", fz_to_num(dict));
+
+	pdf_store_item(xref->store, fz_keep_pixmap, fz_drop_pixmap, dict, *pixp);
+
+	return fz_okay;
+}
+
+/*
+ * Images decoded at reduced scale are stored under their own drop functions,
+ * so that each scale of image is a separate store item.
+ */
+static void
+pdf_drop_image_half(fz_pixmap *pix)
+{
+	fz_drop_pixmap(pix);
+}
+
+static void
+pdf_drop_image_quarter(fz_pixmap *pix)
+{
+	fz_drop_pixmap(pix);
+}
+
+static void
+pdf_drop_image_eighth(fz_pixmap *pix)
+{
+	fz_drop_pixmap(pix);
+}
+
+static void
+pdf_drop_image_sixteenth(fz_pixmap *pix)
+{
+	fz_drop_pixmap(pix);
+}
+
+static void
+pdf_drop_image_thirty_second(fz_pixmap *pix)
+{
+	fz_drop_pixmap(pix);
+}
+
+/* DCT scaling goes down to 1/8, JPEG 2000 codestreams usually have 5 levels below full resolution */
+#define MAX_DCT_L2FACTOR 3
+#define MAX_JPX_L2FACTOR 5
+
+static void (*pdf_scaled_image_drop_funcs[MAX_JPX_L2FACTOR + 1])(fz_pixmap *) =
+{
+	fz_drop_pixmap,
+	pdf_drop_image_half,
+	pdf_drop_image_quarter,
+	pdf_drop_image_eighth,
+	pdf_drop_image_sixteenth,
+	pdf_drop_image_thirty_second,
+};
+
+int
+pdf_is_scaled_image_drop_func(void *drop_func)
+{
+	int i;
+	for (i = 1; i <= MAX_JPX_L2FACTOR; i++)
+		if (drop_func == (void *)pdf_scaled_image_drop_funcs[i])
+			return 1;
+	return 0;
+}
+
+/*
+ * Choose how many times image can be halved while decoding so that it
+ * still has at least as many pixels as it covers on device.
+ * Only images with single DCTDecode or JPXDecode filter can be scaled,
+ * by DCT scaling or by skipping JPEG 2000 resolution levels.
+ */
+static int
+pdf_get_image_l2factor(fz_obj *dict, float dev_w, float dev_h)
+{
+	fz_obj *filter;
+	int w, h, l2factor, max_l2factor;
+
+	if (pdf_image_decode_zoom <= 0)
+		return 0;
+
+	filter = fz_dict_gets(dict, "Filter");
+	if (fz_is_array(filter) && fz_array_len(filter) == 1)
+		filter = fz_array_get(filter, 0);
+	if (!strcmp(fz_to_name(filter), "DCTDecode") || !strcmp(fz_to_name(filter), "DCT"))
+		max_l2factor = MAX_DCT_L2FACTOR;
+	else if (!strcmp(fz_to_name(filter), "JPXDecode"))
+		max_l2factor = MAX_JPX_L2FACTOR;
+	else
+		return 0;
+	if (fz_to_bool(fz_dict_getsa(dict, "ImageMask", "IM")))
+		return 0;
+
+	w = fz_to_int(fz_dict_getsa(dict, "Width", "W"));
+	h = fz_to_int(fz_dict_getsa(dict, "Height", "H"));
+	dev_w *= pdf_image_decode_zoom;
+	dev_h *= pdf_image_decode_zoom;
+
+	l2factor = 0;
+	while (l2factor < max_l2factor &&
+		((w + (2 << l2factor) - 1) >> (l2factor + 1)) >= dev_w &&
+		((h + (2 << l2factor) - 1) >> (l2factor + 1)) >= dev_h)
+		l2factor++;
+	return l2factor;
+}
+
+/*
+ * Load image that is drawn dev_w x dev_h units large, in units of the matrix
+ * page is run with. JPEG and JPEG 2000 images much larger than that are decoded
+ * at reduced scale, which is faster and takes a fraction of memory.
+ */
+fz_error
+pdf_load_image_at_size(fz_pixmap **pixp, pdf_xref *xref, fz_obj *dict, float dev_w, float dev_h)
+{
+	fz_error error;
+	int l2factor;
+	void *drop_func;
+
+	l2factor = pdf_get_image_l2factor(dict, dev_w, dev_h);
+	if (l2factor == 0)
+		return pdf_load_image(pixp, xref, dict);
+
+	drop_func = pdf_scaled_image_drop_funcs[l2factor];
+	if ((*pixp = pdf_find_item(xref->store, drop_func, dict)))
+	{
+		fz_keep_pixmap(*pixp);
+		return fz_okay;
+	}
+
+	error = pdf_load_image_imp(pixp, xref, NULL, dict, NULL, 0, l2factor);
+	if (error)
+		return fz_rethrow(error, "cannot load image (%d 0 R) at 1/%d scale", fz_to_num(dict), 1 << l2factor);
+
+	pdf_store_item(xref->store, fz_keep_pixmap, drop_func, dict, *pixp);
+
+	return fz_okay;
+}
@@ -14,14 +14,33 @@
 #define FIND_STORE_MAX_AGE    4
 #define TEXT_STORE_MAX_AGE    4
 
+/* prefetched resources must survive page switches until their page is shown */
+#define PREFETCH_STORE_MAX_AGE_PER_PAGE 2
+#define TRIM_OLD_STORE_MAX_AGE 1
+
+/* anti-aliasing bits used for draft renders; must stay above 0, so glyphs in glyph cache are not affected */
+#define DRAFT_AA_LEVEL 2
+
 static jintArray get_page_image_bitmap(JNIEnv *env,
       pdf_t *pdf, int pageno, int zoom_pmil, int left, int top, int rotation,
-      int gray, int skipImages,
-      int *width, int *height);
+      int gray, int skipImages, int draft,
+      jintArray reuse, int *width, int *height);
+static unsigned char* get_render_buf(pdf_t *pdf, int size);
 static void copy_alpha(unsigned char* out, unsigned char *in, unsigned int w, unsigned int h);
 
 
 extern char fz_errorbuf[150*20]; /* defined in fitz/apv_base_error.c */
+extern int pdf_store_size(pdf_store *store); /* defined in pdf/apv_pdf_store.c */
+extern int fz_glyph_cache_size(fz_glyph_cache *cache); /* defined in draw/apv_draw_glyph.c */
+extern void fz_glyph_cache_stats(fz_glyph_cache *cache, int *hits, int *misses); /* defined in draw/apv_draw_glyph.c */
+extern void fz_set_glyph_cache_budget(fz_glyph_cache *cache, int budget); /* defined in draw/apv_draw_glyph.c */
+extern void fz_trim_glyph_cache(fz_glyph_cache *cache, int size); /* defined in draw/apv_draw_glyph.c */
+extern int fz_font_cache_size(void); /* defined in fitz/apv_res_font.c */
+extern void fz_trim_font_cache(int size); /* defined in fitz/apv_res_font.c */
+extern void fz_trim_arena_pool(void); /* defined in fitz/apv_base_arena.c */
+extern int fz_display_list_size(fz_display_list *list); /* defined in fitz/apv_dev_list.c */
+extern void pdf_set_cjk_pack(char *path, int offset, int length); /* defined in pdf/apv_pdf_cjk.c */
+extern float pdf_image_decode_zoom; /* defined in pdf/apv_pdf_image.c */
 
 #define NUM_BOXES 5
 
@@ -42,6 +61,27 @@ JNI_OnLoad(JavaVM *jvm, void *reserved) {
 }
 
 
+/**
+ * Implementation of static native method PDF.setCJKPack.
+ * Only remembers where CJK pack is, it's mapped when a document needs it.
+ */
+JNIEXPORT void JNICALL
+Java_cx_hell_android_lib_pdf_PDF_setCJKPack(
+        JNIEnv *env,
+        jclass cls,
+        jstring path,
+        jint offset,
+        jint length) {
+    const char *c_path = NULL;
+    jboolean iscopy;
+
+    c_path = (*env)->GetStringUTFChars(env, path, &iscopy);
+    __android_log_print(ANDROID_LOG_INFO, PDFVIEW_LOG_TAG, "CJK pack: %s (offset: %d, length: %d)", c_path, (int)offset, (int)length);
+    pdf_set_cjk_pack((char*)c_path, offset, length);
+    (*env)->ReleaseStringUTFChars(env, path, c_path);
+}
+
+
 /**
  * Implementation of native method PDF.parseFile.
  * Opens file and parses at least some bytes - so it could take a while.
@@ -176,6 +216,8 @@ Java_cx_hell_android_lib_pdf_PDF_renderPage(
         jint rotation,
         jboolean gray,
         jboolean skipImages,
+        jboolean draft,
+        jintArray reuse,
         jobject size) {
 
     jint *buf; /* rendered page, freed before return, as bitmap */
@@ -193,7 +235,7 @@ Java_cx_hell_android_lib_pdf_PDF_renderPage(
     pdf = get_pdf_from_this(env, this);
 
     jints = get_page_image_bitmap(env, pdf, pageno, zoom, left, top, rotation, gray,
-          skipImages, &width, &height);
+          skipImages, draft, reuse, &width, &height);
 
     if (jints != NULL)
         save_size(env, size, width, height);
@@ -231,6 +273,126 @@ Java_cx_hell_android_lib_pdf_PDF_getPageSize(
 }
 
 
+/**
+ * Implementation of native method PDF.prefetchPage.
+ * Loads page, fonts and images into resource store, but doesn't rasterize anything.
+ * @param pageno 0-based page number
+ * @return error code - 0 means ok
+ */
+JNIEXPORT jint JNICALL
+Java_cx_hell_android_lib_pdf_PDF_prefetchPage(
+        JNIEnv *env,
+        jobject this,
+        jint pageno) {
+    pdf_t *pdf = NULL;
+
+    pdf = get_pdf_from_this(env, this);
+    if (pdf == NULL) {
+        __android_log_print(ANDROID_LOG_ERROR, PDFVIEW_LOG_TAG, "this.pdf is null");
+        return 1;
+    }
+
+    return prefetch_page(pdf, pageno);
+}
+
+
+/**
+ * Get estimated number of bytes held by native caches.
+ * Returns array indexed by MEMORY_* constants, or null on error.
+ */
+JNIEXPORT jintArray JNICALL
+Java_cx_hell_android_lib_pdf_PDF_getMemoryUsage(
+        JNIEnv *env,
+        jobject this) {
+    pdf_t *pdf = NULL;
+    int usage[MEMORY_USAGE_COUNT];
+    jintArray jusage;
+
+    pdf = get_pdf_from_this(env, this);
+    if (pdf == NULL) {
+        __android_log_print(ANDROID_LOG_ERROR, PDFVIEW_LOG_TAG, "this.pdf is null");
+        return NULL;
+    }
+
+    get_memory_usage(pdf, usage);
+    jusage = (*env)->NewIntArray(env, MEMORY_USAGE_COUNT);
+    if (jusage == NULL) return NULL;
+    (*env)->SetIntArrayRegion(env, jusage, 0, MEMORY_USAGE_COUNT, (jint*)usage);
+    return jusage;
+}
+
+
+/**
+ * Free native caches, level is one of TRIM_* constants.
+ */
+JNIEXPORT void JNICALL
+Java_cx_hell_android_lib_pdf_PDF_trimMemory(
+        JNIEnv *env,
+        jobject this,
+        jint level) {
+    pdf_t *pdf = NULL;
+
+    pdf = get_pdf_from_this(env, this);
+    if (pdf == NULL) {
+        __android_log_print(ANDROID_LOG_ERROR, PDFVIEW_LOG_TAG, "this.pdf is null");
+        return;
+    }
+
+    trim_memory(pdf, level);
+}
+
+
+/**
+ * Get glyph cache hit and miss counts.
+ * Returns array indexed by GLYPH_CACHE_* constants, or null on error.
+ */
+JNIEXPORT jintArray JNICALL
+Java_cx_hell_android_lib_pdf_PDF_getGlyphCacheStats(
+        JNIEnv *env,
+        jobject this) {
+    pdf_t *pdf = NULL;
+    int stats[GLYPH_CACHE_STATS_COUNT];
+    jintArray jstats;
+
+    pdf = get_pdf_from_this(env, this);
+    if (pdf == NULL) {
+        __android_log_print(ANDROID_LOG_ERROR, PDFVIEW_LOG_TAG, "this.pdf is null");
+        return NULL;
+    }
+
+    stats[GLYPH_CACHE_HITS] = 0;
+    stats[GLYPH_CACHE_MISSES] = 0;
+    if (pdf->glyph_cache)
+        fz_glyph_cache_stats(pdf->glyph_cache, &stats[GLYPH_CACHE_HITS], &stats[GLYPH_CACHE_MISSES]);
+    jstats = (*env)->NewIntArray(env, GLYPH_CACHE_STATS_COUNT);
+    if (jstats == NULL) return NULL;
+    (*env)->SetIntArrayRegion(env, jstats, 0, GLYPH_CACHE_STATS_COUNT, (jint*)stats);
+    return jstats;
+}
+
+
+/**
+ * Set number of bytes glyph cache may hold, 0 for default.
+ */
+JNIEXPORT void JNICALL
+Java_cx_hell_android_lib_pdf_PDF_setGlyphCacheBudget(
+        JNIEnv *env,
+        jobject this,
+        jint budget) {
+    pdf_t *pdf = NULL;
+
+    pdf = get_pdf_from_this(env, this);
+    if (pdf == NULL) {
+        __android_log_print(ANDROID_LOG_ERROR, PDFVIEW_LOG_TAG, "this.pdf is null");
+        return;
+    }
+
+    pdf->glyph_cache_budget = budget;
+    if (pdf->glyph_cache)
+        fz_set_glyph_cache_budget(pdf->glyph_cache, budget);
+}
+
+
 // #ifdef pro
 // /**
 //  * Get document outline.
@@ -319,6 +481,16 @@ Java_cx_hell_android_lib_pdf_PDF_freeMemory(
     if (pdf->fileno >= 0) close(pdf->fileno);
     if (pdf->glyph_cache)
         fz_free_glyph_cache(pdf->glyph_cache);
+    if (pdf->render_buf)
+        fz_free(pdf->render_buf);
+    if (pdf->content_bboxes)
+        free(pdf->content_bboxes);
+    if (pdf->content_bboxes_valid)
+        free(pdf->content_bboxes_valid);
+    free_page_lists(pdf);
+    free_scanned_page(pdf);
+    if (pdf->page_kinds)
+        free(pdf->page_kinds);
     if (pdf->xref)
         pdf_free_xref(pdf->xref);
 
@@ -804,12 +976,32 @@ void save_size(JNIEnv *env, jobject size, int width, int height) {
  */
 pdf_t* create_pdf_t() {
     pdf_t *pdf = NULL;
+    int i;
     pdf = (pdf_t*)malloc(sizeof(pdf_t));
     pdf->xref = NULL;
     pdf->outline = NULL;
     pdf->fileno = -1;
     pdf->pages = NULL;
     pdf->glyph_cache = NULL;
+    pdf->glyph_cache_budget = 0;
+    pdf->prefetch_pageno = -1;
+    pdf->render_buf = NULL;
+    pdf->render_buf_size = 0;
+    pdf->content_bboxes = NULL;
+    pdf->content_bboxes_valid = NULL;
+    for(i = 0; i < PAGE_LIST_CACHE_SIZE; ++i) {
+        pdf->page_lists[i] = NULL;
+        pdf->page_list_pagenos[i] = -1;
+        pdf->page_list_skip_images[i] = 0;
+        pdf->page_list_image_zooms[i] = 0;
+    }
+    pdf->page_kinds = NULL;
+    pdf->scan_pageno = -1;
+    pdf->scan_image = NULL;
+    pdf->scan_ctm = fz_identity;
+    pdf->scan_scaled = NULL;
+    pdf->scan_scaled_w = 0;
+    pdf->scan_scaled_h = 0;
     
     return pdf;
 }
@@ -1038,16 +1230,705 @@ pdf_page* get_page(pdf_t *pdf, int pageno) {
 }
 
 
+/**
+ * Warm up page for later rendering.
+ * Runs page through bbox device, so interpreter parses content stream, loads fonts
+ * and decodes images into xref->store, but no pixels are drawn.
+ * Store is not aged here, so prefetching doesn't evict resources of visible pages.
+ * @param pdf pdf struct
+ * @param pageno 0-based page number
+ * @return error code - 0 means ok
+ */
+int prefetch_page(pdf_t *pdf, int pageno) {
+    fz_error error = 0;
+    pdf_page *page = NULL;
+    fz_device *dev = NULL;
+    fz_bbox bbox;
+
+    if (pageno < 0 || pageno >= pdf_count_pages(pdf->xref))
+        return 1;
+
+    page = get_page(pdf, pageno);
+    if (!page) return 2;
+
+    dev = fz_new_bbox_device(&bbox);
+    error = pdf_run_page(pdf->xref, page, dev, fz_identity);
+    fz_free_device(dev);
+
+    if (error) {
+        fz_catch(error, "prefetching page %d failed", pageno);
+        return 3;
+    }
+
+    /* content bbox comes for free, so tiles of this page can be checked for being blank */
+    if (pdf->content_bboxes) {
+        pdf->content_bboxes[pageno * 2] = bbox;
+        pdf->content_bboxes_valid[pageno] |= CONTENT_BBOX_IMAGES;
+    }
+
+    pdf->prefetch_pageno = pageno;
+    __android_log_print(ANDROID_LOG_DEBUG, PDFVIEW_LOG_TAG, "prefetched page %d", pageno);
+    return 0;
+}
+
+
+/**
+ * Get bbox of everything drawn on page, in page space.
+ * Pages rendered without images have their own bbox, since parts with images only are blank for them.
+ * Computed with bbox device on first use and remembered.
+ * @param list display list of page recorded with the same skip_images, or NULL to interpret page
+ * @return error code - 0 means ok
+ */
+int get_content_bbox(pdf_t *pdf, int pageno, pdf_page *page, fz_display_list *list, int skip_images, fz_bbox *bbox) {
+    fz_error error = 0;
+    fz_device *dev = NULL;
+    int pagecount;
+    int i;
+    int valid;
+
+    if (!pdf->content_bboxes) {
+        pagecount = pdf_count_pages(pdf->xref);
+        pdf->content_bboxes = (fz_bbox*)malloc(pagecount * 2 * sizeof(fz_bbox));
+        pdf->content_bboxes_valid = (unsigned char*)calloc(pagecount, 1);
+        if (!pdf->content_bboxes || !pdf->content_bboxes_valid) {
+            free(pdf->content_bboxes);
+            free(pdf->content_bboxes_valid);
+            pdf->content_bboxes = NULL;
+            pdf->content_bboxes_valid = NULL;
+            return 1;
+        }
+    }
+
+    i = pageno * 2 + (skip_images ? 1 : 0);
+    valid = skip_images ? CONTENT_BBOX_NO_IMAGES : CONTENT_BBOX_IMAGES;
+    if (!(pdf->content_bboxes_valid[pageno] & valid)) {
+        dev = fz_new_bbox_device(&pdf->content_bboxes[i]);
+        /* replaying display list is much cheaper than interpreting page again */
+        if (list) {
+            fz_execute_display_list(list, dev, fz_identity, fz_infinite_bbox);
+        } else {
+            if (skip_images)
+                dev->hints |= FZ_IGNORE_IMAGE;
+            error = pdf_run_page(pdf->xref, page, dev, fz_identity);
+        }
+        fz_free_device(dev);
+        if (error) {
+            fz_catch(error, "computing content bbox of page %d failed", pageno);
+            return 2;
+        }
+        pdf->content_bboxes_valid[pageno] |= valid;
+    }
+
+    *bbox = pdf->content_bboxes[i];
+    return 0;
+}
+
+
+/**
+ * Get display list of page, recording it if it's not cached.
+ * Page is interpreted once and tiles replay the list, which is spatially indexed,
+ * so tile only visits objects near it - that matters a lot for big and complex pages.
+ * Lists recorded with skip_images lack images and are recorded again when images are needed.
+ * JPEG images in list are decoded just large enough for image_zoom, so list is also recorded
+ * again when page is rendered at higher zoom than that.
+ * @return display list owned by pdf_t or NULL on error
+ */
+fz_display_list* get_page_list(pdf_t *pdf, int pageno, pdf_page *page, int skip_images, float image_zoom) {
+    fz_error error = 0;
+    fz_display_list *list = NULL;
+    fz_device *dev = NULL;
+    int i;
+    int list_skip_images;
+    float list_image_zoom;
+
+    for(i = 0; i < PAGE_LIST_CACHE_SIZE; ++i) {
+        if (pdf->page_lists[i] && pdf->page_list_pagenos[i] == pageno) {
+            if (!skip_images && (pdf->page_list_skip_images[i] || pdf->page_list_image_zooms[i] < image_zoom)) {
+                fz_free_display_list(pdf->page_lists[i]);
+                pdf->page_lists[i] = NULL;
+            } else {
+                list = pdf->page_lists[i];
+                list_skip_images = pdf->page_list_skip_images[i];
+                list_image_zoom = pdf->page_list_image_zooms[i];
+            }
+            break;
+        }
+    }
+
+    if (!list) {
+        /* scanned page image comes from list, so it's stale now */
+        if (pdf->scan_pageno == pageno)
+            free_scanned_page(pdf);
+        list = fz_new_display_list();
+        dev = fz_new_list_device(list);
+        if (skip_images)
+            dev->hints |= FZ_IGNORE_IMAGE;
+        pdf_image_decode_zoom = image_zoom;
+        error = pdf_run_page(pdf->xref, page, dev, fz_identity);
+        fz_free_device(dev);
+        if (error) {
+            fz_catch(error, "recording display list of page %d failed", pageno);
+            fz_free_display_list(list);
+            return NULL;
+        }
+        list_skip_images = skip_images;
+        list_image_zoom = image_zoom;
+        if (i == PAGE_LIST_CACHE_SIZE) {
+            /* not cached - drop least recently used list */
+            i = PAGE_LIST_CACHE_SIZE - 1;
+            if (pdf->page_lists[i])
+                fz_free_display_list(pdf->page_lists[i]);
+        }
+    }
+
+    /* move to front, slot i is overwritten */
+    for(; i > 0; --i) {
+        pdf->page_lists[i] = pdf->page_lists[i - 1];
+        pdf->page_list_pagenos[i] = pdf->page_list_pagenos[i - 1];
+        pdf->page_list_skip_images[i] = pdf->page_list_skip_images[i - 1];
+        pdf->page_list_image_zooms[i] = pdf->page_list_image_zooms[i - 1];
+    }
+    pdf->page_lists[0] = list;
+    pdf->page_list_pagenos[0] = pageno;
+    pdf->page_list_skip_images[0] = list_skip_images;
+    pdf->page_list_image_zooms[0] = list_image_zoom;
+
+    return list;
+}
+
+
+/**
+ * Free all cached display lists.
+ */
+void free_page_lists(pdf_t *pdf) {
+    int i;
+    for(i = 0; i < PAGE_LIST_CACHE_SIZE; ++i) {
+        if (pdf->page_lists[i]) {
+            fz_free_display_list(pdf->page_lists[i]);
+            pdf->page_lists[i] = NULL;
+        }
+        pdf->page_list_pagenos[i] = -1;
+    }
+}
+
+
+/**
+ * Free cached display lists of pages other than the one rendered last.
+ */
+void free_old_page_lists(pdf_t *pdf) {
+    int i;
+    for(i = 0; i < PAGE_LIST_CACHE_SIZE; ++i) {
+        if (pdf->page_lists[i] && pdf->page_list_pagenos[i] != pdf->last_pageno) {
+            fz_free_display_list(pdf->page_lists[i]);
+            pdf->page_lists[i] = NULL;
+            pdf->page_list_pagenos[i] = -1;
+        }
+    }
+}
+
+/**
+ * Collects what scanned page detection needs to know about page contents.
+ */
+typedef struct {
+    int complex; /* page draws something else than single image */
+    fz_pixmap *image;
+    fz_matrix ctm;
+    fz_rect clip; /* intersection of rectangular clips in effect when image was drawn */
+    int clip_depth;
+} scan_detector_t;
+
+
+static void scan_detector_complex(scan_detector_t *d) {
+    d->complex = 1;
+}
+
+static void scan_detector_fill_path(void *user, fz_path *path, int even_odd, fz_matrix ctm,
+        fz_colorspace *colorspace, float *color, float alpha) {
+    scan_detector_complex(user);
+}
+
+static void scan_detector_stroke_path(void *user, fz_path *path, fz_stroke_state *stroke, fz_matrix ctm,
+        fz_colorspace *colorspace, float *color, float alpha) {
+    scan_detector_complex(user);
+}
+
+/**
+ * Scans often clip to page rectangle before drawing image; such clip doesn't change anything
+ * if it contains the image, any other clip makes page complex.
+ */
+static void scan_detector_clip_path(void *user, fz_path *path, fz_rect *rect, int even_odd, fz_matrix ctm) {
+    scan_detector_t *d = user;
+    fz_rect bounds;
+    fz_point p;
+    int i = 0;
+    int points = 0;
+
+    d->clip_depth += 1;
+    if (d->complex)
+        return;
+
+    bounds = fz_bound_path(path, NULL, ctm);
+    /* path must be moveto and lineto to corners of its bounds only */
+    while (i < path->len) {
+        switch (path->items[i++].k) {
+        case FZ_MOVETO:
+        case FZ_LINETO:
+            p.x = path->items[i++].v;
+            p.y = path->items[i++].v;
+            p = fz_transform_point(ctm, p);
+            if ((fabsf(p.x - bounds.x0) > 0.01f && fabsf(p.x - bounds.x1) > 0.01f) ||
+                (fabsf(p.y - bounds.y0) > 0.01f && fabsf(p.y - bounds.y1) > 0.01f)) {
+                d->complex = 1;
+                return;
+            }
+            points += 1;
+            break;
+        case FZ_CLOSE_PATH:
+            break;
+        default:
+            d->complex = 1;
+            return;
+        }
+    }
+    if (points > 5) {
+        d->complex = 1;
+        return;
+    }
+    d->clip = fz_intersect_rect(d->clip, bounds);
+}
+
+static void scan_detector_clip_stroke_path(void *user, fz_path *path, fz_rect *rect, fz_stroke_state *stroke, fz_matrix ctm) {
+    scan_detector_t *d = user;
+    d->clip_depth += 1;
+    scan_detector_complex(user);
+}
+
+static void scan_detector_fill_text(void *user, fz_text *text, fz_matrix ctm,
+        fz_colorspace *colorspace, float *color, float alpha) {
+    scan_detector_complex(user);
+}
+
+static void scan_detector_stroke_text(void *user, fz_text *text, fz_stroke_state *stroke, fz_matrix ctm,
+        fz_colorspace *colorspace, float *color, float alpha) {
+    scan_detector_complex(user);
+}
+
+static void scan_detector_clip_text(void *user, fz_text *text, fz_matrix ctm, int accumulate) {
+    scan_detector_t *d = user;
+    d->clip_depth += 1;
+    scan_detector_complex(user);
+}
+
+static void scan_detector_clip_stroke_text(void *user, fz_text *text, fz_stroke_state *stroke, fz_matrix ctm) {
+    scan_detector_t *d = user;
+    d->clip_depth += 1;
+    scan_detector_complex(user);
+}
+
+static void scan_detector_fill_shade(void *user, fz_shade *shade, fz_matrix ctm, float alpha) {
+    scan_detector_complex(user);
+}
+
+static void scan_detector_fill_image(void *user, fz_pixmap *image, fz_matrix ctm, float alpha) {
+    scan_detector_t *d = user;
+    fz_rect r;
+
+    if (d->complex)
+        return;
+    if (d->image || alpha < 1.0f || image->mask || !image->colorspace || image->w == 0 || image->h == 0) {
+        d->complex = 1;
+        return;
+    }
+    /* clip in effect must contain whole image */
+    r = fz_transform_rect(ctm, fz_unit_rect);
+    if (!fz_is_infinite_rect(d->clip) && (r.x0 < d->clip.x0 - 0.5f || r.y0 < d->clip.y0 - 0.5f ||
+            r.x1 > d->clip.x1 + 0.5f || r.y1 > d->clip.y1 + 0.5f)) {
+        d->complex = 1;
+        return;
+    }
+    d->image = fz_keep_pixmap(image);
+    d->ctm = ctm;
+}
+
+static void scan_detector_fill_image_mask(void *user, fz_pixmap *image, fz_matrix ctm,
+        fz_colorspace *colorspace, float *color, float alpha) {
+    scan_detector_complex(user);
+}
+
+static void scan_detector_clip_image_mask(void *user, fz_pixmap *image, fz_rect *rect, fz_matrix ctm) {
+    scan_detector_t *d = user;
+    d->clip_depth += 1;
+    scan_detector_complex(user);
+}
+
+static void scan_detector_pop_clip(void *user) {
+    scan_detector_t *d = user;
+    d->clip_depth -= 1;
+    /* clips are not tracked per level; leaving all of them is enough for scans */
+    if (d->clip_depth <= 0) {
+        d->clip_depth = 0;
+        d->clip = fz_infinite_rect;
+    }
+}
+
+static void scan_detector_begin_mask(void *user, fz_rect rect, int luminosity, fz_colorspace *colorspace, float *bc) {
+    scan_detector_complex(user);
+}
+
+static void scan_detector_begin_group(void *user, fz_rect rect, int isolated, int knockout, int blendmode, float alpha) {
+    scan_detector_complex(user);
+}
+
+static void scan_detector_begin_tile(void *user, fz_rect area, fz_rect view, float xstep, float ystep, fz_matrix ctm) {
+    scan_detector_complex(user);
+}
+
+
+/**
+ * Check if page is scanned, that is if it draws nothing but single image (invisible text
+ * of OCR layer is fine). Kind of page is detected once, from its display list.
+ * Image of last checked scanned page is kept in pdf_t for paint_scanned_page.
+ * @return 1 if page is scanned, 0 if it's not or it can't be determined
+ */
+int is_scanned_page(pdf_t *pdf, int pageno, fz_display_list *list) {
+    scan_detector_t detector;
+    fz_device *dev = NULL;
+    int pagecount;
+
+    if (!pdf->page_kinds) {
+        pagecount = pdf_count_pages(pdf->xref);
+        pdf->page_kinds = (unsigned char*)calloc(pagecount, 1);
+        if (!pdf->page_kinds)
+            return 0;
+    }
+
+    if (pdf->page_kinds[pageno] == PAGE_KIND_NORMAL)
+        return 0;
+    if (pdf->page_kinds[pageno] == PAGE_KIND_SCANNED && pdf->scan_pageno == pageno)
+        return 1;
+
+    detector.complex = 0;
+    detector.image = NULL;
+    detector.ctm = fz_identity;
+    detector.clip = fz_infinite_rect;
+    detector.clip_depth = 0;
+
+    dev = fz_new_device(&detector);
+    dev->fill_path = scan_detector_fill_path;
+    dev->stroke_path = scan_detector_stroke_path;
+    dev->clip_path = scan_detector_clip_path;
+    dev->clip_stroke_path = scan_detector_clip_stroke_path;
+    dev->fill_text = scan_detector_fill_text;
+    dev->stroke_text = scan_detector_stroke_text;
+    dev->clip_text = scan_detector_clip_text;
+    dev->clip_stroke_text = scan_detector_clip_stroke_text;
+    dev->fill_shade = scan_detector_fill_shade;
+    dev->fill_image = scan_detector_fill_image;
+    dev->fill_image_mask = scan_detector_fill_image_mask;
+    dev->clip_image_mask = scan_detector_clip_image_mask;
+    dev->pop_clip = scan_detector_pop_clip;
+    dev->begin_mask = scan_detector_begin_mask;
+    dev->begin_group = scan_detector_begin_group;
+    dev->begin_tile = scan_detector_begin_tile;
+    fz_execute_display_list(list, dev, fz_identity, fz_infinite_bbox);
+    fz_free_device(dev);
+
+    if (detector.complex || !detector.image) {
+        if (detector.image)
+            fz_drop_pixmap(detector.image);
+        pdf->page_kinds[pageno] = PAGE_KIND_NORMAL;
+        return 0;
+    }
+
+    if (pdf->page_kinds[pageno] == PAGE_KIND_UNKNOWN)
+        __android_log_print(ANDROID_LOG_DEBUG, PDFVIEW_LOG_TAG, "page %d is scanned, image %d x %d",
+                pageno, detector.image->w, detector.image->h);
+    pdf->page_kinds[pageno] = PAGE_KIND_SCANNED;
+    free_scanned_page(pdf);
+    pdf->scan_pageno = pageno;
+    pdf->scan_image = detector.image;
+    pdf->scan_ctm = detector.ctm;
+    return 1;
+}
+
+
+/**
+ * Drop image of scanned page and its scaled copy.
+ */
+void free_scanned_page(pdf_t *pdf) {
+    if (pdf->scan_scaled)
+        fz_drop_pixmap(pdf->scan_scaled);
+    if (pdf->scan_image)
+        fz_drop_pixmap(pdf->scan_image);
+    pdf->scan_scaled = NULL;
+    pdf->scan_image = NULL;
+    pdf->scan_pageno = -1;
+    pdf->scan_scaled_w = 0;
+    pdf->scan_scaled_h = 0;
+}
+
+
+/**
+ * Get image of scanned page converted to given colorspace and scaled down to w x h,
+ * or not scaled at all if it's smaller than that.
+ * Result is cached, so all tiles of page at the same zoom share one scaled image.
+ */
+static fz_pixmap* get_scanned_page_pixmap(pdf_t *pdf, fz_colorspace *model, int w, int h) {
+    fz_pixmap *image = pdf->scan_image;
+    fz_pixmap *converted = NULL;
+    fz_pixmap *scaled = NULL;
+    int convert_first;
+
+    if (w < 1) w = 1;
+    if (h < 1) h = 1;
+    if (w >= image->w || h >= image->h) {
+        w = image->w;
+        h = image->h;
+    }
+
+    if (pdf->scan_scaled && pdf->scan_scaled->colorspace == model
+            && pdf->scan_scaled_w == w && pdf->scan_scaled_h == h)
+        return pdf->scan_scaled;
+
+    if (pdf->scan_scaled) {
+        fz_drop_pixmap(pdf->scan_scaled);
+        pdf->scan_scaled = NULL;
+    }
+
+    /* like draw device: images with more components are converted before scaling */
+    convert_first = image->colorspace != model && image->colorspace->n >= model->n;
+    if (convert_first) {
+        converted = fz_new_pixmap_with_rect(model, fz_bound_pixmap(image));
+        fz_convert_pixmap(image, converted);
+        image = converted;
+    }
+
+    if (w != image->w || h != image->h) {
+        scaled = fz_scale_pixmap(image, 0, 0, w, h);
+        if (scaled) {
+            if (converted)
+                fz_drop_pixmap(converted);
+            converted = NULL;
+            image = scaled;
+        }
+    }
+
+    if (image->colorspace != model) {
+        converted = fz_new_pixmap_with_rect(model, fz_bound_pixmap(image));
+        fz_convert_pixmap(image, converted);
+        if (scaled)
+            fz_drop_pixmap(scaled);
+        image = converted;
+    }
+    else if (image == pdf->scan_image) {
+        fz_keep_pixmap(image);
+    }
+
+    pdf->scan_scaled = image;
+    pdf->scan_scaled_w = w;
+    pdf->scan_scaled_h = h;
+    return image;
+}
+
+
+/**
+ * Render tile of scanned page by sampling its image straight into dest pixmap,
+ * without interpreter and draw device.
+ * Image is first scaled to render size once for all tiles, then each tile pixel takes
+ * nearest image pixel; images smaller than render size are interpolated.
+ * Image is painted over what's in dest.
+ * @param ctm page to device transform of tile
+ * @return error code - 0 means ok
+ */
+int paint_scanned_page(pdf_t *pdf, int pageno, fz_pixmap *dest, fz_matrix ctm) {
+    fz_matrix m;
+    fz_matrix inv;
+    fz_pixmap *image;
+    unsigned char *dp, *sp, *p00, *p01, *p10, *p11;
+    int x, y, k, n, sw, sh, w, h;
+    int u, v, du, dv, iu, iv, fu, fv, u0, v0, u1, v1, c, t;
+    int lerp;
+    float fx, fy;
+
+    if (pdf->scan_pageno != pageno || !pdf->scan_image)
+        return 1;
+
+    /* unit square to device */
+    m = fz_concat(pdf->scan_ctm, ctm);
+    w = sqrtf(m.a * m.a + m.b * m.b);
+    h = sqrtf(m.c * m.c + m.d * m.d);
+    image = get_scanned_page_pixmap(pdf, dest->colorspace, w, h);
+    if (!image || image->n != dest->n)
+        return 2;
+
+    sw = image->w;
+    sh = image->h;
+    n = dest->n;
+    lerp = sw < w || sh < h;
+
+    /* device to image pixels, as in draw_affine.c */
+    inv = fz_scale(1.0f / sw, -1.0f / sh);
+    inv = fz_concat(inv, fz_translate(0, 1));
+    inv = fz_concat(inv, m);
+    inv = fz_invert_matrix(inv);
+    du = inv.a * 65536;
+    dv = inv.b * 65536;
+
+    for(y = 0; y < dest->h; ++y) {
+        /* pixel centers */
+        fx = dest->x + 0.5f;
+        fy = dest->y + y + 0.5f;
+        u = (fx * inv.a + fy * inv.c + inv.e) * 65536;
+        v = (fx * inv.b + fy * inv.d + inv.f) * 65536;
+        dp = dest->samples + y * dest->w * n;
+        for(x = 0; x < dest->w; ++x, u += du, v += dv, dp += n) {
+            iu = u >> 16;
+            iv = v >> 16;
+            if (iu < 0 || iu >= sw || iv < 0 || iv >= sh)
+                continue;
+            if (!lerp) {
+                sp = image->samples + (iv * sw + iu) * n;
+                t = 255 - sp[n - 1];
+                for(k = 0; k < n; ++k)
+                    dp[k] = sp[k] + fz_mul255(dp[k], t);
+                continue;
+            }
+            /* bilinear, between centers of neighbouring image pixels */
+            u0 = (u - 32768) >> 16;
+            v0 = (v - 32768) >> 16;
+            fu = ((u - 32768) >> 8) & 0xff;
+            fv = ((v - 32768) >> 8) & 0xff;
+            u1 = CLAMP(u0 + 1, 0, sw - 1);
+            v1 = CLAMP(v0 + 1, 0, sh - 1);
+            u0 = CLAMP(u0, 0, sw - 1);
+            v0 = CLAMP(v0, 0, sh - 1);
+            p00 = image->samples + (v0 * sw + u0) * n;
+            p10 = image->samples + (v0 * sw + u1) * n;
+            p01 = image->samples + (v1 * sw + u0) * n;
+            p11 = image->samples + (v1 * sw + u1) * n;
+            t = 255 - ((((p00[n-1] * (256 - fu) + p10[n-1] * fu) >> 8) * (256 - fv) +
+                    ((p01[n-1] * (256 - fu) + p11[n-1] * fu) >> 8) * fv) >> 8);
+            for(k = 0; k < n; ++k) {
+                c = (((p00[k] * (256 - fu) + p10[k] * fu) >> 8) * (256 - fv) +
+                        ((p01[k] * (256 - fu) + p11[k] * fu) >> 8) * fv) >> 8;
+                dp[k] = c + fz_mul255(dp[k], t);
+            }
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Estimate memory held by loaded pages and their display lists, resource store, glyph cache and font face cache.
+ * Fills usage array indexed by MEMORY_* constants, sizes are in bytes.
+ */
+void get_memory_usage(pdf_t *pdf, int *usage) {
+    int i;
+    int pagecount;
+
+    usage[MEMORY_PAGES] = 0;
+    usage[MEMORY_STORE] = 0;
+    usage[MEMORY_GLYPHS] = 0;
+    usage[MEMORY_FONTS] = fz_font_cache_size();
+
+    if (pdf->pages) {
+        pagecount = pdf_count_pages(pdf->xref);
+        for(i = 0; i < pagecount; ++i) {
+            if (pdf->pages[i]) {
+                usage[MEMORY_PAGES] += sizeof(pdf_page);
+                if (pdf->pages[i]->contents)
+                    usage[MEMORY_PAGES] += pdf->pages[i]->contents->cap;
+            }
+        }
+    }
+    for(i = 0; i < PAGE_LIST_CACHE_SIZE; ++i) {
+        if (pdf->page_lists[i])
+            usage[MEMORY_PAGES] += fz_display_list_size(pdf->page_lists[i]);
+    }
+    if (pdf->scan_scaled && pdf->scan_scaled != pdf->scan_image)
+        usage[MEMORY_PAGES] += pdf->scan_scaled->w * pdf->scan_scaled->h * pdf->scan_scaled->n;
+    if (pdf->xref && pdf->xref->store)
+        usage[MEMORY_STORE] = pdf_store_size(pdf->xref->store);
+    if (pdf->glyph_cache)
+        usage[MEMORY_GLYPHS] = fz_glyph_cache_size(pdf->glyph_cache);
+}
+
+
+/**
+ * Free native caches in order of how cheap they are to rebuild:
+ * what page rendered last doesn't use first, then glyph cache, then unused store
+ * resources and font faces, then loaded pages.
+ * Page that was rendered last is kept, since it's most likely to be rendered again.
+ */
+void trim_memory(pdf_t *pdf, int level) {
+    int i;
+    int pagecount;
+
+    __android_log_print(ANDROID_LOG_DEBUG, PDFVIEW_LOG_TAG, "trim_memory(level: %d)", level);
+
+    /* store items are aged on every page change, so old ones are those not used since then */
+    if (level == TRIM_OLD) {
+        free_old_page_lists(pdf);
+        if (pdf->scan_pageno != pdf->last_pageno)
+            free_scanned_page(pdf);
+        if (pdf->xref && pdf->xref->store)
+            pdf_age_store(pdf->xref->store, TRIM_OLD_STORE_MAX_AGE);
+        return;
+    }
+
+    /* glyph cache itself is kept, so its hit and miss counts survive trimming */
+    if (pdf->glyph_cache)
+        fz_trim_glyph_cache(pdf->glyph_cache, 0);
+    if (pdf->render_buf) {
+        fz_free(pdf->render_buf);
+        pdf->render_buf = NULL;
+        pdf->render_buf_size = 0;
+    }
+
+    /* display lists and scanned page image keep store resources alive, so they go before store is aged */
+    if (level >= TRIM_STORE) {
+        free_page_lists(pdf);
+        free_scanned_page(pdf);
+    }
+
+    if (level >= TRIM_STORE && pdf->xref && pdf->xref->store) {
+        pdf_age_store(pdf->xref->store, 0);
+        pdf->prefetch_pageno = -1;
+    }
+
+    /* fonts dropped by store are kept in face cache for other documents, and free arena chunks
+     * for next page runs, unless memory is short */
+    if (level >= TRIM_STORE) {
+        fz_trim_font_cache(0);
+        fz_trim_arena_pool();
+    }
+
+    if (level >= TRIM_PAGES && pdf->pages) {
+        pagecount = pdf_count_pages(pdf->xref);
+        for(i = 0; i < pagecount; ++i) {
+            if (pdf->pages[i] && i != pdf->last_pageno) {
+                pdf_free_page(pdf->pages[i]);
+                pdf->pages[i] = NULL;
+            }
+        }
+    }
+}
+
+
 /**
  * Get part of page as bitmap.
  * Parameters left, top, width and height are interprted after scalling, so if we have 100x200 page scalled by 25% and
  * request 0x0 x 25x50 tile, we should get 25x50 bitmap of whole page content.
  * pageno is 0-based.
+ * Draft renders use lower anti-aliasing and skip shadings; they are meant for tiles shown during motion.
+ * If reuse array is large enough, bitmap is returned in it instead of newly allocated array.
+ * Tiles that don't intersect page content are not rendered, empty array is returned for them.
  */
 static jintArray get_page_image_bitmap(JNIEnv *env,
       pdf_t *pdf, int pageno, int zoom_pmil, int left, int top, int rotation,
-      int gray, int skipImages,
-      int *width, int *height) {
+      int gray, int skipImages, int draft,
+      jintArray reuse, int *width, int *height) {
     unsigned char *bytes = NULL;
     fz_matrix ctm;
     double zoom;
@@ -1063,6 +1944,10 @@ static jintArray get_page_image_bitmap(JNIEnv *env,
     fz_obj *pageobj;
     fz_obj *trimobj;
     fz_rect trimbox;
+    fz_bbox content;
+    fz_display_list *list = NULL;
+    float image_zoom;
+    int aa_level = 0;
 
     zoom = (double)zoom_pmil / 1000.0;
 
@@ -1074,10 +1959,14 @@ static jintArray get_page_image_bitmap(JNIEnv *env,
             __android_log_print(ANDROID_LOG_ERROR, PDFVIEW_LOG_TAG, "failed to create glyphcache");
             return NULL;
         }
+        fz_set_glyph_cache_budget(pdf->glyph_cache, pdf->glyph_cache_budget);
     }
 
     if (pdf->last_pageno != pageno && NULL != pdf->xref->store) {
-        pdf_age_store(pdf->xref->store, BITMAP_STORE_MAX_AGE);
+        int max_age = BITMAP_STORE_MAX_AGE;
+        if (pdf->prefetch_pageno >= 0)
+            max_age += PREFETCH_STORE_MAX_AGE_PER_PAGE * ABS(pdf->prefetch_pageno - pageno);
+        pdf_age_store(pdf->xref->store, max_age);
         pdf->last_pageno = pageno;
     }
 
@@ -1105,6 +1994,29 @@ static jintArray get_page_image_bitmap(JNIEnv *env,
     bbox.x1 = bbox.x0 + *width;
     bbox.y1 = bbox.y0 + *height;
 
+    /* images are decoded for zoom rounded up to power of two, so small zoom changes reuse the list */
+    image_zoom = 1.0f / 8;
+    while (image_zoom < zoom)
+        image_zoom *= 2;
+
+    /* recorded before content bbox is needed, so that page is interpreted only once */
+    list = get_page_list(pdf, pageno, page, skipImages, image_zoom);
+
+    if (get_content_bbox(pdf, pageno, page, list, skipImages, &content) == 0) {
+        if (!fz_is_empty_bbox(content)) {
+            content = fz_transform_bbox(ctm, content);
+            /* anti-aliasing may touch one more pixel */
+            content.x0 -= 1;
+            content.y0 -= 1;
+            content.x1 += 1;
+            content.y1 += 1;
+        }
+        if (fz_is_empty_bbox(content) || fz_is_empty_bbox(fz_intersect_bbox(content, fz_round_rect(bbox)))) {
+            __android_log_print(ANDROID_LOG_DEBUG, PDFVIEW_LOG_TAG, "tile at %d, %d of page %d is blank", left, top, pageno);
+            return (*env)->NewIntArray(env, 0);
+        }
+    }
+
 
 #if 0
     error = fz_rendertree(&image, pdf->renderer, page->tree, ctm, fz_roundrect(bbox), 1);
@@ -1115,17 +2027,38 @@ static jintArray get_page_image_bitmap(JNIEnv *env,
     }
 #endif
 
-    image = fz_new_pixmap(gray ? fz_device_gray : fz_device_bgr, *width, *height);
+    /* tiles are mostly of the same size, so samples buffer is reused instead of allocated for every tile */
+    image = fz_new_pixmap_with_data(gray ? fz_device_gray : fz_device_bgr, *width, *height,
+            get_render_buf(pdf, *width * *height * (gray ? 2 : 4)));
     image->x = bbox.x0;
     image->y = bbox.y0;
     fz_clear_pixmap_with_color(image, gray ? 0 : 0xff);
     memset(image->samples, gray ? 0 : 0xff, image->h * image->w * image->n);
+
+    /* scanned pages don't need interpreter nor draw device */
+    if (list && !skipImages && is_scanned_page(pdf, pageno, list)
+            && paint_scanned_page(pdf, pageno, image, ctm) == 0) {
+        goto rendered;
+    }
+
     dev = fz_new_draw_device(pdf->glyph_cache, image);
 
     if (skipImages)
         dev->hints |= FZ_IGNORE_IMAGE;
 
-    error = pdf_run_page(pdf->xref, page, dev, ctm);
+    if (draft) {
+        dev->hints |= FZ_IGNORE_SHADE;
+        aa_level = fz_get_aa_level();
+        fz_set_aa_level(DRAFT_AA_LEVEL);
+    }
+
+    if (list)
+        fz_execute_display_list(list, dev, ctm, fz_round_rect(bbox));
+    else
+        error = pdf_run_page(pdf->xref, page, dev, ctm);
+
+    if (draft)
+        fz_set_aa_level(aa_level);
 
     if (error)
     {
@@ -1136,6 +2069,7 @@ static jintArray get_page_image_bitmap(JNIEnv *env,
 
     fz_free_device(dev);
 
+rendered:
     __android_log_print(ANDROID_LOG_DEBUG, PDFVIEW_LOG_TAG, "got image %d x %d, asked for %d x %d",
             (int)(image->w), (int)(image->h),
             *width, *height);
@@ -1143,8 +2077,11 @@ static jintArray get_page_image_bitmap(JNIEnv *env,
     /* TODO: learn jni and avoid copying bytes ;) */
     num_pixels = image->w * image->h;
 
-    jints = (*env)->NewIntArray(env, num_pixels);
-	jbuf = (*env)->GetIntArrayElements(env, jints, NULL);
+    if (reuse != NULL && (*env)->GetArrayLength(env, reuse) >= num_pixels)
+        jints = reuse;
+    else
+        jints = (*env)->NewIntArray(env, num_pixels);
+    jbuf = (*env)->GetIntArrayElements(env, jints, NULL);
     if (gray) {
         copy_alpha((unsigned char*)jbuf, image->samples, image->w, image->h);
     }
@@ -1162,6 +2099,21 @@ static jintArray get_page_image_bitmap(JNIEnv *env,
 }
 
 
+/**
+ * Get buffer of at least size bytes for pixmap samples.
+ * Buffer is owned by pdf_t and grows as needed, so it's not reallocated for tiles of the same size.
+ */
+static unsigned char* get_render_buf(pdf_t *pdf, int size) {
+    if (pdf->render_buf_size < size) {
+        if (pdf->render_buf)
+            fz_free(pdf->render_buf);
+        pdf->render_buf = fz_malloc(size);
+        pdf->render_buf_size = size;
+    }
+    return pdf->render_buf;
+}
+
+
 void copy_alpha(unsigned char* out, unsigned char *in, unsigned int w, unsigned int h) {
         unsigned int count = w*h;
         while(count--) {
@@ -12,6 +12,36 @@
 
 #define MAX_BOX_NAME 8
 
+/* indexes of memory usage array filled by get_memory_usage */
+#define MEMORY_PAGES 0
+#define MEMORY_STORE 1
+#define MEMORY_GLYPHS 2
+#define MEMORY_FONTS 3 /* font face cache, shared by all documents */
+#define MEMORY_USAGE_COUNT 4
+
+/* indexes of glyph cache stats array returned by getGlyphCacheStats */
+#define GLYPH_CACHE_HITS 0
+#define GLYPH_CACHE_MISSES 1
+#define GLYPH_CACHE_STATS_COUNT 2
+
+/* trim_memory levels, each level frees also everything freed by lower levels */
+#define TRIM_OLD 0 /* only what wasn't used for page rendered last */
+#define TRIM_GLYPHS 1
+#define TRIM_STORE 2
+#define TRIM_PAGES 3
+
+/* bits of content_bboxes_valid: page's bbox with images is computed, bbox without images is computed */
+#define CONTENT_BBOX_IMAGES 1
+#define CONTENT_BBOX_NO_IMAGES 2
+
+/* number of pages whose display lists are kept */
+#define PAGE_LIST_CACHE_SIZE 2
+
+/* kinds of pages, detected on first render */
+#define PAGE_KIND_UNKNOWN 0
+#define PAGE_KIND_NORMAL 1
+#define PAGE_KIND_SCANNED 2 /* page is just one image, rendered without draw device */
+
 /**
  * Holds pdf info.
  */
@@ -24,6 +54,22 @@ typedef struct {
     int invalid_password;
     pdf_page **pages; /* lazy-loaded pages */
     fz_glyph_cache *glyph_cache;
+    int glyph_cache_budget; /* bytes glyph_cache may hold, 0 for default */
+    int prefetch_pageno; /* last page warmed up by prefetch_page, -1 if none */
+    unsigned char *render_buf; /* pixmap samples reused by get_page_image_bitmap */
+    int render_buf_size;
+    fz_bbox *content_bboxes; /* lazy-computed bboxes of page contents in page space, with and without images for each page */
+    unsigned char *content_bboxes_valid; /* which content_bboxes are computed, CONTENT_BBOX_* bits for each page */
+    fz_display_list *page_lists[PAGE_LIST_CACHE_SIZE]; /* display lists of recently rendered pages, most recent first */
+    int page_list_pagenos[PAGE_LIST_CACHE_SIZE];
+    int page_list_skip_images[PAGE_LIST_CACHE_SIZE]; /* list was recorded without images */
+    float page_list_image_zooms[PAGE_LIST_CACHE_SIZE]; /* zoom images of list were decoded for */
+    unsigned char *page_kinds; /* PAGE_KIND_* of each page */
+    int scan_pageno; /* scanned page whose image is held in scan_image, -1 if none */
+    fz_pixmap *scan_image; /* the only image of scanned page */
+    fz_matrix scan_ctm; /* scan_image matrix in page space */
+    fz_pixmap *scan_scaled; /* scan_image in render colorspace, scaled to render size */
+    int scan_scaled_w, scan_scaled_h; /* size scan_scaled was requested for */
     char box[MAX_BOX_NAME + 1];
 } pdf_t;
 
@@ -52,6 +98,16 @@ int convert_point_pdf_to_apv(pdf_t *pdf, int page, int *x, int *y);
 int convert_box_pdf_to_apv(pdf_t *pdf, int page, fz_bbox *bbox);
 int find_next(JNIEnv *env, jobject this, int direction);
 pdf_page* get_page(pdf_t *pdf, int pageno);
+int prefetch_page(pdf_t *pdf, int pageno);
+int get_content_bbox(pdf_t *pdf, int pageno, pdf_page *page, fz_display_list *list, int skip_images, fz_bbox *bbox);
+fz_display_list* get_page_list(pdf_t *pdf, int pageno, pdf_page *page, int skip_images, float image_zoom);
+void free_page_lists(pdf_t *pdf);
+void free_old_page_lists(pdf_t *pdf);
+int is_scanned_page(pdf_t *pdf, int pageno, fz_display_list *list);
+int paint_scanned_page(pdf_t *pdf, int pageno, fz_pixmap *dest, fz_matrix ctm);
+void free_scanned_page(pdf_t *pdf);
+void get_memory_usage(pdf_t *pdf, int *usage);
+void trim_memory(pdf_t *pdf, int level);
 
 
 // #ifdef pro
@@ -0,0 +1,25 @@
+/*
+ * Stand-in for the NDK cpufeatures library in the host tests.
+ * NEON is reported unless NO_NEON is set in the environment, so the same
+ * test binary can be run through both the NEON and the C code paths.
+ */
+
+#ifndef APV_TEST_CPU_FEATURES_H
+#define APV_TEST_CPU_FEATURES_H
+
+#include <stdlib.h>
+
+#define ANDROID_CPU_FAMILY_ARM 1
+#define ANDROID_CPU_ARM_FEATURE_NEON (1 << 2)
+
+static int android_getCpuFamily(void)
+{
+	return ANDROID_CPU_FAMILY_ARM;
+}
+
+static unsigned long long android_getCpuFeatures(void)
+{
+	return getenv("NO_NEON") ? 0 : ANDROID_CPU_ARM_FEATURE_NEON;
+}
+
+#endif
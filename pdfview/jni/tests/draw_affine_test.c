@@ -0,0 +1,200 @@
+/*
+ * Host test for image painting in mupdf/draw/apv_draw_affine.c, including
+ * the row painters used for axis-aligned images and their NEON versions in
+ * mupdf/draw/apv_draw_neon.c.
+ *
+ * Paints 4000 random images with and without colour, alpha and
+ * interpolation, at unit, integer and arbitrary scales, flipped, rotated
+ * by 90 degrees and skewed, and clipped by random scissors, through APV's
+ * apv_draw_affine.c and through the upstream draw_affine.c, which the
+ * Makefile builds with its functions renamed to ref_*. The results must be
+ * identical. The NEON code is installed unless NO_NEON is set, so the same
+ * test also checks the C code in the modified copy.
+ */
+
+#include "fitz.h"
+
+typedef unsigned char byte;
+
+void fz_accelerate_arch(void);
+
+void ref_paint_image(fz_pixmap *dst, fz_bbox scissor, fz_pixmap *shape, fz_pixmap *img, fz_matrix ctm, int alpha);
+void ref_paint_image_with_color(fz_pixmap *dst, fz_bbox scissor, fz_pixmap *shape, fz_pixmap *img, fz_matrix ctm, byte *color);
+
+#define IMAGES 4000
+
+enum { SAME_SIZE, INTEGER_SCALE, SCALE, SKEW, ROTATE, KINDS };
+
+/* the test only uses the bounding box of the pixmaps */
+fz_bbox
+fz_bound_pixmap(fz_pixmap *pix)
+{
+	fz_bbox bbox;
+	bbox.x0 = pix->x;
+	bbox.y0 = pix->y;
+	bbox.x1 = pix->x + pix->w;
+	bbox.y1 = pix->y + pix->h;
+	return bbox;
+}
+
+static unsigned int seed = 777;
+
+static int
+rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+/* premultiplied pixels, a quarter of them fully opaque */
+static fz_pixmap *
+make_pixmap(int n, int w, int h, int x, int y)
+{
+	fz_pixmap *pix;
+	int i, k, a;
+
+	pix = calloc(1, sizeof(fz_pixmap));
+	pix->n = n;
+	pix->w = w;
+	pix->h = h;
+	pix->x = x;
+	pix->y = y;
+	pix->samples = malloc(w * h * n);
+	for (i = 0; i < w * h; i++)
+	{
+		a = rnd() % 4 == 0 ? 255 : rnd() & 255;
+		for (k = 0; k < n - 1; k++)
+			pix->samples[i * n + k] = a ? rnd() % (a + 1) : 0;
+		pix->samples[i * n + n - 1] = a;
+	}
+	return pix;
+}
+
+static void
+free_pixmap(fz_pixmap *pix)
+{
+	free(pix->samples);
+	free(pix);
+}
+
+int
+main(void)
+{
+	static const int ns[] = { 1, 2, 4, 4 };
+	fz_pixmap *img, *dst1, *dst2;
+	fz_matrix ctm;
+	fz_bbox scissor;
+	byte color[4];
+	float sx, sy;
+	int i, k, dn, sn, sw, sh, dw, dh, with_color, kind, alpha;
+	int fails = 0;
+
+	fz_accelerate_arch();
+
+	for (i = 0; i < IMAGES; i++)
+	{
+		dn = ns[rnd() % 4];
+		with_color = rnd() % 3 == 0;
+		/* colour is painted through a mask; gray images may be painted to rgb */
+		if (with_color)
+		{
+			sn = 1;
+			if (dn == 1)
+				dn = 2;
+		}
+		else
+			sn = dn == 4 && rnd() % 3 == 0 ? 2 : dn;
+
+		sw = 1 + rnd() % 60;
+		sh = 1 + rnd() % 60;
+		img = make_pixmap(sn, sw, sh, 0, 0);
+		img->interpolate = rnd() % 2;
+
+		dw = 10 + rnd() % 100;
+		dh = 10 + rnd() % 100;
+		dst1 = make_pixmap(dn, dw, dh, -5, -3);
+		dst2 = make_pixmap(dn, dw, dh, -5, -3);
+		memcpy(dst2->samples, dst1->samples, dw * dh * dn);
+
+		kind = rnd() % KINDS;
+		if (kind == SAME_SIZE)
+		{
+			sx = sw;
+			sy = sh;
+		}
+		else if (kind == INTEGER_SCALE)
+		{
+			k = 1 + rnd() % 4;
+			sx = sw / (float)k;
+			sy = sh / (float)k;
+		}
+		else
+		{
+			sx = (rnd() % 2000) / 10.0f + 0.5f;
+			sy = (rnd() % 2000) / 10.0f + 0.5f;
+		}
+		if (rnd() % 4 == 0)
+			sx = -sx;
+		if (kind == ROTATE && rnd() % 2)
+		{
+			ctm.a = 0;
+			ctm.b = sy;
+			ctm.c = sx;
+			ctm.d = 0;
+		}
+		else
+		{
+			ctm.a = sx;
+			ctm.b = 0;
+			ctm.c = 0;
+			ctm.d = rnd() % 2 ? -sy : sy;
+		}
+		if (kind == SKEW && rnd() % 2)
+			ctm.b = 3.3f;
+		ctm.e = rnd() % 80 - 20 + (rnd() % 2 ? (rnd() % 100) / 100.0f : 0);
+		ctm.f = rnd() % 80 - 20 + (rnd() % 2 ? (rnd() % 100) / 100.0f : 0);
+
+		scissor.x0 = -100;
+		scissor.y0 = -100;
+		scissor.x1 = 1000;
+		scissor.y1 = 1000;
+		if (rnd() % 3 == 0)
+		{
+			scissor.x0 = rnd() % 40;
+			scissor.y0 = rnd() % 40;
+			scissor.x1 = scissor.x0 + rnd() % 60;
+			scissor.y1 = scissor.y0 + rnd() % 60;
+		}
+		scissor = fz_intersect_bbox(scissor, fz_bound_pixmap(dst1));
+
+		alpha = rnd() % 3 == 0 ? rnd() & 255 : 255;
+		for (k = 0; k < 4; k++)
+			color[k] = rnd() & 255;
+
+		if (with_color)
+		{
+			ref_paint_image_with_color(dst1, scissor, NULL, img, ctm, color);
+			fz_paint_image_with_color(dst2, scissor, NULL, img, ctm, color);
+		}
+		else
+		{
+			ref_paint_image(dst1, scissor, NULL, img, ctm, alpha);
+			fz_paint_image(dst2, scissor, NULL, img, ctm, alpha);
+		}
+
+		if (memcmp(dst1->samples, dst2->samples, dw * dh * dn))
+		{
+			fails++;
+			if (fails <= 10)
+				printf("mismatch: image %d kind=%d color=%d sn=%d dn=%d ctm=[%g %g %g %g %g %g] alpha=%d interpolate=%d\n",
+					i, kind, with_color, sn, dn, ctm.a, ctm.b, ctm.c, ctm.d, ctm.e, ctm.f, alpha, img->interpolate);
+		}
+
+		free_pixmap(img);
+		free_pixmap(dst1);
+		free_pixmap(dst2);
+	}
+
+	printf("%d images, %d mismatches\n", IMAGES, fails);
+	return fails != 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * Host test for the scan converter in mupdf/draw/apv_draw_edge.c.
+ *
+ * Fills 3000 random paths through APV's apv_draw_edge.c and through the
+ * upstream draw_edge.c, which the Makefile builds with its functions
+ * renamed to ref_*. Paths are small random polygons, star-like polygons
+ * with many self-crossings, page-spanning random edges and long polylines
+ * with short steps. They are filled with every anti-aliasing level, both
+ * nonzero and even-odd rules, into masks and colour pixmaps, with and
+ * without a clip. The bounding boxes and pixels must be identical.
+ */
+
+#include "fitz.h"
+
+void ref_set_aa_level(int level);
+fz_gel *ref_new_gel(void);
+void ref_reset_gel(fz_gel *gel, fz_bbox clip);
+void ref_free_gel(fz_gel *gel);
+fz_bbox ref_bound_gel(fz_gel *gel);
+void ref_insert_gel(fz_gel *gel, float x0, float y0, float x1, float y1);
+void ref_sort_gel(fz_gel *gel);
+void ref_scan_convert(fz_gel *gel, int eofill, fz_bbox clip, fz_pixmap *pix, unsigned char *colorbv);
+
+#define PATHS 3000
+#define MAXPOINTS 3000
+
+enum { POLYGON, STAR, RANDOM_EDGES, POLYLINE, KINDS };
+
+/* the test only uses the bounding box of the pixmaps */
+fz_bbox
+fz_bound_pixmap(fz_pixmap *pix)
+{
+	fz_bbox bbox;
+	bbox.x0 = pix->x;
+	bbox.y0 = pix->y;
+	bbox.x1 = pix->x + pix->w;
+	bbox.y1 = pix->y + pix->h;
+	return bbox;
+}
+
+static unsigned int seed = 4242;
+
+static int
+rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+static float pts[MAXPOINTS * 2];
+static int npts;
+
+static void
+make_path(int kind, int w, int h)
+{
+	float cx, cy, a, r;
+	int i;
+
+	cx = rnd() % w;
+	cy = rnd() % h;
+	switch (kind)
+	{
+	case POLYGON:
+		npts = 3 + rnd() % 20;
+		break;
+	case STAR:
+		npts = 3 + rnd() % 400;
+		break;
+	case RANDOM_EDGES:
+		npts = 2000;
+		break;
+	case POLYLINE:
+		npts = MAXPOINTS;
+		break;
+	}
+
+	for (i = 0; i < npts; i++)
+	{
+		if (kind == POLYGON || kind == RANDOM_EDGES)
+		{
+			/* may go well outside of pixmap */
+			pts[2 * i] = (rnd() % (w * 40)) / 20.0f - w / 2;
+			pts[2 * i + 1] = (rnd() % (h * 40)) / 20.0f - h / 2;
+		}
+		else if (kind == STAR)
+		{
+			a = i * 6.2831f / npts * (1 + rnd() % 7);
+			r = (rnd() % 1000) / 1000.0f * w / 2;
+			pts[2 * i] = cx + r * cosf(a);
+			pts[2 * i + 1] = cy + r * sinf(a);
+		}
+		else if (i == 0)
+		{
+			pts[0] = cx;
+			pts[1] = cy;
+		}
+		else
+		{
+			pts[2 * i] = pts[2 * i - 2] + (rnd() % 21 - 10) / 3.0f;
+			pts[2 * i + 1] = pts[2 * i - 1] + (rnd() % 21 - 10) / 3.0f;
+		}
+	}
+}
+
+static void
+fill_gel(fz_gel *gel, int ref, fz_bbox clip)
+{
+	int i, j;
+
+	if (ref)
+		ref_reset_gel(gel, clip);
+	else
+		fz_reset_gel(gel, clip);
+	for (i = 0; i < npts; i++)
+	{
+		j = (i + 1) % npts;
+		if (ref)
+			ref_insert_gel(gel, pts[2 * i], pts[2 * i + 1], pts[2 * j], pts[2 * j + 1]);
+		else
+			fz_insert_gel(gel, pts[2 * i], pts[2 * i + 1], pts[2 * j], pts[2 * j + 1]);
+	}
+	if (ref)
+		ref_sort_gel(gel);
+	else
+		fz_sort_gel(gel);
+}
+
+static fz_pixmap *
+make_pixmap(int n, int w, int h)
+{
+	fz_pixmap *pix;
+	pix = calloc(1, sizeof(fz_pixmap));
+	pix->n = n;
+	pix->w = w;
+	pix->h = h;
+	pix->samples = calloc(w * h, n);
+	return pix;
+}
+
+static void
+free_pixmap(fz_pixmap *pix)
+{
+	free(pix->samples);
+	free(pix);
+}
+
+int
+main(void)
+{
+	static const int aa_levels[] = { 0, 2, 4, 6, 8 };
+	static const int ns[] = { 1, 2, 4 };
+	fz_gel *gel1, *gel2;
+	fz_pixmap *dst1, *dst2;
+	fz_bbox clip, bbox1, bbox2;
+	unsigned char color[4];
+	int i, k, w, h, n, aa, kind, eofill, with_color;
+	int fails = 0;
+
+	gel1 = ref_new_gel();
+	gel2 = fz_new_gel();
+
+	for (i = 0; i < PATHS; i++)
+	{
+		aa = aa_levels[rnd() % 5];
+		ref_set_aa_level(aa);
+		fz_set_aa_level(aa);
+
+		w = 20 + rnd() % 200;
+		h = 20 + rnd() % 200;
+		/* big paths are slow, so they are rarer */
+		kind = rnd() % KINDS;
+		if (kind >= RANDOM_EDGES && rnd() % 8)
+			kind = rnd() % RANDOM_EDGES;
+		make_path(kind, w, h);
+
+		/* masks are filled with coverage, colour pixmaps with a colour */
+		n = ns[rnd() % 3];
+		with_color = n > 1;
+		eofill = rnd() % 2;
+
+		dst1 = make_pixmap(n, w, h);
+		dst2 = make_pixmap(n, w, h);
+		for (k = 0; k < w * h * n; k++)
+			dst1->samples[k] = dst2->samples[k] = rnd() % 3 ? 0 : rnd();
+		for (k = 0; k < 4; k++)
+			color[k] = rnd();
+
+		clip.x0 = 0;
+		clip.y0 = 0;
+		clip.x1 = w;
+		clip.y1 = h;
+		if (rnd() % 3 == 0)
+		{
+			clip.x0 = rnd() % w;
+			clip.y0 = rnd() % h;
+			clip.x1 = clip.x0 + rnd() % (w - clip.x0 + 1);
+			clip.y1 = clip.y0 + rnd() % (h - clip.y0 + 1);
+		}
+
+		fill_gel(gel1, 1, clip);
+		fill_gel(gel2, 0, clip);
+		bbox1 = fz_intersect_bbox(ref_bound_gel(gel1), clip);
+		bbox2 = fz_intersect_bbox(fz_bound_gel(gel2), clip);
+		if (memcmp(&bbox1, &bbox2, sizeof bbox1))
+		{
+			fails++;
+			printf("bbox mismatch: path %d kind=%d\n", i, kind);
+		}
+		else if (!fz_is_empty_rect(bbox1))
+		{
+			ref_scan_convert(gel1, eofill, bbox1, dst1, with_color ? color : NULL);
+			fz_scan_convert(gel2, eofill, bbox2, dst2, with_color ? color : NULL);
+			if (memcmp(dst1->samples, dst2->samples, w * h * n))
+			{
+				fails++;
+				if (fails <= 10)
+					printf("mismatch: path %d aa=%d kind=%d eofill=%d n=%d color=%d\n",
+						i, aa, kind, eofill, n, with_color);
+			}
+		}
+
+		free_pixmap(dst1);
+		free_pixmap(dst2);
+	}
+
+	ref_free_gel(gel1);
+	fz_free_gel(gel2);
+
+	printf("%d paths, %d mismatches\n", PATHS, fails);
+	return fails != 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * Host test for the NEON span painters and blend modes in
+ * mupdf/draw/apv_draw_neon.c.
+ *
+ * Paints 20000 random spans with every painter, component count,
+ * separable blend mode and tail length through APV's apv_draw_paint.c and
+ * apv_draw_blend.c, and through the upstream draw_paint.c and draw_blend.c,
+ * which the Makefile builds with their functions renamed to ref_*. The
+ * results must be identical. The NEON code is installed unless NO_NEON is
+ * set, so the same test also checks the C code in the modified copies.
+ */
+
+#include "fitz.h"
+
+typedef unsigned char byte;
+
+void fz_accelerate_arch(void);
+
+void ref_paint_solid_color(byte * restrict dp, int n, int w, byte *color);
+void ref_paint_span(byte * restrict dp, byte * restrict sp, int n, int w, int alpha);
+void ref_paint_span_with_color(byte * restrict dp, byte * restrict mp, int n, int w, byte *color);
+void ref_paint_pixmap_with_mask(fz_pixmap *dst, fz_pixmap *src, fz_pixmap *msk);
+void ref_blend_pixmap(fz_pixmap *dst, fz_pixmap *src, int alpha, int blendmode, int isolated, fz_pixmap *shape);
+
+#define SPANS 20000
+#define MAXW 40
+
+enum { SOLID_COLOR, SPAN, SPAN_WITH_COLOR, PIXMAP_WITH_MASK, BLEND_ISOLATED, BLEND_NONISOLATED, OPS };
+
+/* the test only uses the bounding box of the pixmaps */
+fz_bbox
+fz_bound_pixmap(fz_pixmap *pix)
+{
+	fz_bbox bbox;
+	bbox.x0 = pix->x;
+	bbox.y0 = pix->y;
+	bbox.x1 = pix->x + pix->w;
+	bbox.y1 = pix->y + pix->h;
+	return bbox;
+}
+
+static unsigned int seed = 12345;
+
+static int
+rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+/* premultiplied pixels, with many fully opaque and fully transparent ones */
+static void
+fill_pixels(byte *p, int n, int w)
+{
+	int i, k, a;
+
+	for (i = 0; i < w; i++)
+	{
+		a = rnd() % 6 == 0 ? 255 : rnd() % 6 == 0 ? 0 : rnd() & 255;
+		for (k = 0; k < n - 1; k++)
+			p[i * n + k] = a ? rnd() % (a + 1) : 0;
+		p[i * n + n - 1] = a;
+	}
+}
+
+static void
+fill_bytes(byte *p, int len)
+{
+	int i, r;
+
+	for (i = 0; i < len; i++)
+	{
+		r = rnd() % 5;
+		p[i] = r == 0 ? 0 : r == 1 ? 255 : rnd() & 255;
+	}
+}
+
+static fz_pixmap
+make_span(int n, int w, byte *samples)
+{
+	fz_pixmap pix;
+	memset(&pix, 0, sizeof pix);
+	pix.n = n;
+	pix.w = w;
+	pix.h = 1;
+	pix.samples = samples;
+	return pix;
+}
+
+int
+main(void)
+{
+	static const int ns[] = { 1, 2, 4 };
+	byte d1[(MAXW + 1) * 4], d2[(MAXW + 1) * 4];
+	byte s1[(MAXW + 1) * 4], s2[(MAXW + 1) * 4];
+	byte mask[MAXW + 1], color[4];
+	fz_pixmap dst1, dst2, src1, src2, msk;
+	int i, k, n, w, len, op, alpha, blendmode = 0;
+	int fails = 0;
+
+	fz_accelerate_arch();
+
+	for (i = 0; i < SPANS; i++)
+	{
+		n = ns[rnd() % 3];
+		w = rnd() % MAXW;
+		alpha = rnd() % 4 == 0 ? 255 : rnd() & 255;
+		op = rnd() % OPS;
+
+		/* one extra pixel past the span, which must be left alone */
+		len = (w + 1) * n;
+		fill_pixels(d1, n, w + 1);
+		memcpy(d2, d1, len);
+		fill_pixels(s1, n, w + 1);
+		memcpy(s2, s1, len);
+		fill_bytes(mask, w + 1);
+		fill_bytes(color, n);
+
+		dst1 = make_span(n, w, d1);
+		dst2 = make_span(n, w, d2);
+		src1 = make_span(n, w, s1);
+		src2 = make_span(n, w, s2);
+		msk = make_span(1, w, mask);
+
+		switch (op)
+		{
+		case SOLID_COLOR:
+			ref_paint_solid_color(d1, n, w, color);
+			fz_paint_solid_color(d2, n, w, color);
+			break;
+		case SPAN:
+			ref_paint_span(d1, s1, n, w, alpha);
+			fz_paint_span(d2, s2, n, w, alpha);
+			break;
+		case SPAN_WITH_COLOR:
+			ref_paint_span_with_color(d1, mask, n, w, color);
+			fz_paint_span_with_color(d2, mask, n, w, color);
+			break;
+		case PIXMAP_WITH_MASK:
+			ref_paint_pixmap_with_mask(&dst1, &src1, &msk);
+			fz_paint_pixmap_with_mask(&dst2, &src2, &msk);
+			break;
+		case BLEND_ISOLATED:
+		case BLEND_NONISOLATED:
+			/* the non-separable modes have no NEON version */
+			blendmode = rnd() % (FZ_BLEND_EXCLUSION + 1);
+			ref_blend_pixmap(&dst1, &src1, alpha, blendmode, op == BLEND_ISOLATED, &msk);
+			fz_blend_pixmap(&dst2, &src2, alpha, blendmode, op == BLEND_ISOLATED, &msk);
+			break;
+		}
+
+		if (memcmp(d1, d2, len) || memcmp(s1, s2, len))
+		{
+			fails++;
+			if (fails <= 10)
+			{
+				printf("mismatch: op=%d blendmode=%d n=%d w=%d alpha=%d\n", op, blendmode, n, w, alpha);
+				for (k = 0; k < len; k++)
+					if (d1[k] != d2[k] || s1[k] != s2[k])
+					{
+						printf("  at byte %d: %d/%d vs %d/%d\n", k, d1[k], s1[k], d2[k], s2[k]);
+						break;
+					}
+			}
+		}
+	}
+
+	printf("%d spans, %d mismatches\n", SPANS, fails);
+	return fails != 0;
+}
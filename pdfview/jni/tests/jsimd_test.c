@@ -0,0 +1,156 @@
+/*
+ * jsimd_test.c
+ *
+ * Host test for the NEON decoder routines in jpeg/apv_jsimd_neon.c.
+ * Compresses synthetic images with several sampling factors and sizes,
+ * decodes them with the float IDCT, plain and fancy upsampling, RGB and
+ * YCbCr output and a few scales, and writes all decoded samples to stdout.
+ * The Makefile runs it with and without NO_NEON set and compares the two
+ * outputs, which must be identical.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jpeglib.h"
+
+
+static unsigned int seed = 12345;
+
+static int
+rnd (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) & 0x7fff;
+}
+
+
+/* Gradients with some hard edges and noise, so that the IDCT sees both
+ * smooth blocks and blocks that overshoot the sample range.
+ */
+static void
+make_image (JSAMPLE * buf, int w, int h, int n)
+{
+  int x, y, k, v;
+
+  for (y = 0; y < h; y++) {
+    for (x = 0; x < w; x++) {
+      for (k = 0; k < n; k++) {
+	v = (x * (k + 1) * 255 / w + y * (3 - k) * 255 / h) / 3;
+	if (((x / 13) + (y / 7)) % 5 == k)
+	  v = (v & 1) ? 0 : 255;
+	v += rnd() % 17 - 8;
+	buf[(y * w + x) * n + k] = (JSAMPLE) (v < 0 ? 0 : v > 255 ? 255 : v);
+      }
+    }
+  }
+}
+
+
+static void
+compress (JSAMPLE * pixels, int w, int h, int n, int hsamp, int vsamp,
+	  int quality, unsigned char ** out, unsigned long * outsize)
+{
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  JSAMPROW row;
+
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  jpeg_mem_dest(&cinfo, out, outsize);
+  cinfo.image_width = w;
+  cinfo.image_height = h;
+  cinfo.input_components = n;
+  cinfo.in_color_space = n == 3 ? JCS_RGB : JCS_GRAYSCALE;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, quality, TRUE);
+  if (n == 3) {
+    cinfo.comp_info[0].h_samp_factor = hsamp;
+    cinfo.comp_info[0].v_samp_factor = vsamp;
+  }
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    row = pixels + cinfo.next_scanline * w * n;
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+}
+
+
+static void
+decompress (unsigned char * data, unsigned long size, boolean fancy,
+	    boolean ycc, int scale_num)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  JSAMPARRAY row;
+  int stride;
+
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, data, size);
+  jpeg_read_header(&cinfo, TRUE);
+  /* Plain upsampling to RGB goes through jdmerge.c, which has no NEON
+   * version. Keep YCbCr to get jdsample.c instead.
+   */
+  if (ycc)
+    cinfo.out_color_space = JCS_YCbCr;
+  cinfo.dct_method = JDCT_FLOAT;
+  cinfo.do_fancy_upsampling = fancy;
+  cinfo.scale_num = scale_num;
+  cinfo.scale_denom = 8;
+  jpeg_start_decompress(&cinfo);
+  stride = cinfo.output_width * cinfo.output_components;
+  row = (*cinfo.mem->alloc_sarray) ((j_common_ptr) &cinfo, JPOOL_IMAGE,
+				    stride, 1);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    jpeg_read_scanlines(&cinfo, row, 1);
+    fwrite(row[0], 1, stride, stdout);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+}
+
+
+int
+main (void)
+{
+  static const int sizes[][2] = {
+    { 1, 1 }, { 7, 5 }, { 8, 8 }, { 17, 300 }, { 37, 29 }, { 64, 64 },
+    { 333, 211 }
+  };
+  static const int samp[][2] = { { 1, 1 }, { 2, 1 }, { 2, 2 }, { 1, 2 } };
+  static const int quality[] = { 30, 75, 100 };
+  int s, f, q, n, fancy, ycc, scale, w, h, images = 0;
+  JSAMPLE * pixels;
+  unsigned char * data;
+  unsigned long size;
+
+  for (s = 0; s < (int) (sizeof(sizes) / sizeof(sizes[0])); s++) {
+    w = sizes[s][0];
+    h = sizes[s][1];
+    pixels = (JSAMPLE *) malloc(w * h * 3);
+    for (n = 1; n <= 3; n += 2) {
+      make_image(pixels, w, h, n);
+      for (f = 0; f < (n == 3 ? 4 : 1); f++) {
+	for (q = 0; q < 3; q++) {
+	  data = NULL;
+	  size = 0;
+	  compress(pixels, w, h, n, samp[f][0], samp[f][1], quality[q],
+		   &data, &size);
+	  for (fancy = 0; fancy <= 1; fancy++)
+	    for (ycc = 0; ycc <= (n == 3); ycc++)
+	      for (scale = 8; scale >= 2; scale /= 2) {
+		decompress(data, size, (boolean) fancy, (boolean) ycc, scale);
+		images++;
+	      }
+	  free(data);
+	}
+      }
+    }
+    free(pixels);
+  }
+  fprintf(stderr, "%d images decoded\n", images);
+  return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Scalar emulation of the NEON intrinsics used by apv_jsimd_neon.c and
+ * apv_draw_neon.c, so the host tests can run them on a non-ARM machine.
+ * Each intrinsic works lane by lane with the wrapping, saturation and
+ * rounding rules of the instruction it stands for.
+ * Needs -std=gnu99 (statement expressions for the shift-by-immediate forms).
+ */
+
+#ifndef APV_TEST_ARM_NEON_H
+#define APV_TEST_ARM_NEON_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+typedef struct { float v[4]; } float32x4_t;
+typedef struct { float v[2]; } float32x2_t;
+typedef struct { float32x4_t val[2]; } float32x4x2_t;
+typedef struct { int16_t v[8]; } int16x8_t;
+typedef struct { int16_t v[4]; } int16x4_t;
+typedef struct { int32_t v[4]; } int32x4_t;
+typedef struct { uint16_t v[8]; } uint16x8_t;
+typedef struct { uint16_t v[4]; } uint16x4_t;
+typedef struct { uint8_t v[8]; } uint8x8_t;
+typedef struct { uint8_t v[16]; } uint8x16_t;
+typedef struct { uint8x8_t val[3]; } uint8x8x3_t;
+typedef struct { uint8x16_t val[2]; } uint8x16x2_t;
+#define NEON_LANES(n) for (int i=0;i<n;i++)
+static inline float32x4_t vaddq_f32(float32x4_t a, float32x4_t b){float32x4_t r; NEON_LANES(4) r.v[i]=a.v[i]+b.v[i]; return r;}
+static inline float32x4_t vsubq_f32(float32x4_t a, float32x4_t b){float32x4_t r; NEON_LANES(4) r.v[i]=a.v[i]-b.v[i]; return r;}
+static inline float32x4_t vmulq_f32(float32x4_t a, float32x4_t b){float32x4_t r; NEON_LANES(4) r.v[i]=a.v[i]*b.v[i]; return r;}
+static inline float32x4_t vdupq_n_f32(float a){float32x4_t r; NEON_LANES(4) r.v[i]=a; return r;}
+static inline float32x4_t vld1q_f32(const float *p){float32x4_t r; NEON_LANES(4) r.v[i]=p[i]; return r;}
+static inline float32x4x2_t vtrnq_f32(float32x4_t a, float32x4_t b){float32x4x2_t r;
+ r.val[0].v[0]=a.v[0]; r.val[0].v[1]=b.v[0]; r.val[0].v[2]=a.v[2]; r.val[0].v[3]=b.v[2];
+ r.val[1].v[0]=a.v[1]; r.val[1].v[1]=b.v[1]; r.val[1].v[2]=a.v[3]; r.val[1].v[3]=b.v[3]; return r;}
+static inline float32x2_t vget_low_f32(float32x4_t a){float32x2_t r={{a.v[0],a.v[1]}};return r;}
+static inline float32x2_t vget_high_f32(float32x4_t a){float32x2_t r={{a.v[2],a.v[3]}};return r;}
+static inline float32x4_t vcombine_f32(float32x2_t a, float32x2_t b){float32x4_t r={{a.v[0],a.v[1],b.v[0],b.v[1]}};return r;}
+static inline int16x8_t vld1q_s16(const int16_t *p){int16x8_t r; NEON_LANES(8) r.v[i]=p[i]; return r;}
+static inline int16x4_t vget_low_s16(int16x8_t a){int16x4_t r; NEON_LANES(4) r.v[i]=a.v[i]; return r;}
+static inline int16x4_t vget_high_s16(int16x8_t a){int16x4_t r; NEON_LANES(4) r.v[i]=a.v[i+4]; return r;}
+static inline int32x4_t vmovl_s16(int16x4_t a){int32x4_t r; NEON_LANES(4) r.v[i]=a.v[i]; return r;}
+static inline float32x4_t vcvtq_f32_s32(int32x4_t a){float32x4_t r; NEON_LANES(4) r.v[i]=(float)a.v[i]; return r;}
+static inline int32x4_t vcvtq_s32_f32(float32x4_t a){int32x4_t r; NEON_LANES(4) { float f=a.v[i]; r.v[i]= f>=2147483647.f?2147483647: f<=-2147483648.f?(-2147483647-1):(int32_t)f;} return r;}
+static inline uint16x4_t vqmovun_s32(int32x4_t a){uint16x4_t r; NEON_LANES(4) r.v[i]= a.v[i]<0?0: a.v[i]>65535?65535:a.v[i]; return r;}
+static inline uint16x8_t vcombine_u16(uint16x4_t a, uint16x4_t b){uint16x8_t r; NEON_LANES(4){r.v[i]=a.v[i]; r.v[i+4]=b.v[i];} return r;}
+static inline uint8x8_t vqmovn_u16(uint16x8_t a){uint8x8_t r; NEON_LANES(8) r.v[i]= a.v[i]>255?255:a.v[i]; return r;}
+static inline void vst1_u8(uint8_t *p, uint8x8_t a){NEON_LANES(8) p[i]=a.v[i];}
+static inline uint8x8_t vld1_u8(const uint8_t *p){uint8x8_t r; NEON_LANES(8) r.v[i]=p[i]; return r;}
+static inline uint16x8_t vmovl_u8(uint8x8_t a){uint16x8_t r; NEON_LANES(8) r.v[i]=a.v[i]; return r;}
+static inline int16x8_t vreinterpretq_s16_u16(uint16x8_t a){int16x8_t r; NEON_LANES(8) r.v[i]=(int16_t)a.v[i]; return r;}
+static inline int16x8_t vdupq_n_s16(int16_t a){int16x8_t r; NEON_LANES(8) r.v[i]=a; return r;}
+static inline int16x8_t vsubq_s16(int16x8_t a, int16x8_t b){int16x8_t r; NEON_LANES(8) r.v[i]=a.v[i]-b.v[i]; return r;}
+static inline int32x4_t vdupq_n_s32(int32_t a){int32x4_t r; NEON_LANES(4) r.v[i]=a; return r;}
+static inline int32x4_t vaddq_s32(int32x4_t a, int32x4_t b){int32x4_t r; NEON_LANES(4) r.v[i]=a.v[i]+b.v[i]; return r;}
+static inline int32x4_t vmulq_n_s32(int32x4_t a, int32_t b){int32x4_t r; NEON_LANES(4) r.v[i]=a.v[i]*b; return r;}
+#define vshrq_n_s32(a,n) ({int32x4_t _r; NEON_LANES(4) _r.v[i]=(a).v[i]>>(n); _r;})
+static inline void vst3_u8(uint8_t *p, uint8x8x3_t a){NEON_LANES(8){p[3*i]=a.val[0].v[i];p[3*i+1]=a.val[1].v[i];p[3*i+2]=a.val[2].v[i];}}
+static inline uint8x16_t vld1q_u8(const uint8_t *p){uint8x16_t r; NEON_LANES(16) r.v[i]=p[i]; return r;}
+static inline void vst2q_u8(uint8_t *p, uint8x16x2_t a){NEON_LANES(16){p[2*i]=a.val[0].v[i];p[2*i+1]=a.val[1].v[i];}}
+typedef struct { uint8x8_t val[2]; } uint8x8x2_t;
+typedef struct { uint8x8_t val[4]; } uint8x8x4_t;
+typedef struct { uint32_t v[4]; } uint32x4_t;
+typedef struct { uint32_t v[2]; } uint32x2_t;
+#define U8(name, expr) static inline uint8x8_t name(uint8x8_t a, uint8x8_t b){uint8x8_t r; NEON_LANES(8) r.v[i]=(uint8_t)(expr); return r;}
+U8(vsub_u8, a.v[i]-b.v[i]) U8(vadd_u8, a.v[i]+b.v[i]) U8(vmin_u8, a.v[i]<b.v[i]?a.v[i]:b.v[i]) U8(vmax_u8, a.v[i]>b.v[i]?a.v[i]:b.v[i])
+U8(vabd_u8, a.v[i]>b.v[i]?a.v[i]-b.v[i]:b.v[i]-a.v[i]) U8(vcle_u8, a.v[i]<=b.v[i]?255:0) U8(vceq_u8, a.v[i]==b.v[i]?255:0) U8(vand_u8, a.v[i]&b.v[i])
+static inline uint8x8_t vmvn_u8(uint8x8_t a){uint8x8_t r; NEON_LANES(8) r.v[i]=~a.v[i]; return r;}
+static inline uint8x8_t vbsl_u8(uint8x8_t m, uint8x8_t a, uint8x8_t b){uint8x8_t r; NEON_LANES(8) r.v[i]=(m.v[i]&a.v[i])|(~m.v[i]&b.v[i]); return r;}
+static inline uint8x8_t vdup_n_u8(uint8_t a){uint8x8_t r; NEON_LANES(8) r.v[i]=a; return r;}
+#define vshr_n_u8(a,n) ({uint8x8_t _r; NEON_LANES(8) _r.v[i]=(a).v[i]>>(n); _r;})
+#define vshl_n_u8(a,n) ({uint8x8_t _r; NEON_LANES(8) _r.v[i]=(uint8_t)((a).v[i]<<(n)); _r;})
+#define vshrq_n_u16(a,n) ({uint16x8_t _r; NEON_LANES(8) _r.v[i]=(a).v[i]>>(n); _r;})
+#define vrshrq_n_u16(a,n) ({uint16x8_t _r; NEON_LANES(8) _r.v[i]=((uint32_t)(a).v[i]+(1<<((n)-1)))>>(n); _r;})
+#define vshll_n_u8(a,n) ({uint16x8_t _r; NEON_LANES(8) _r.v[i]=(uint16_t)((a).v[i]<<(n)); _r;})
+#define vshrn_n_u16(a,n) ({uint8x8_t _r; NEON_LANES(8) _r.v[i]=(uint8_t)((a).v[i]>>(n)); _r;})
+#define vshrn_n_u32(a,n) ({uint16x4_t _r; NEON_LANES(4) _r.v[i]=(uint16_t)((a).v[i]>>(n)); _r;})
+static inline uint16x8_t vaddl_u8(uint8x8_t a, uint8x8_t b){uint16x8_t r; NEON_LANES(8) r.v[i]=a.v[i]+b.v[i]; return r;}
+static inline uint16x8_t vsubl_u8(uint8x8_t a, uint8x8_t b){uint16x8_t r; NEON_LANES(8) r.v[i]=(uint16_t)(a.v[i]-b.v[i]); return r;}
+static inline uint16x8_t vmull_u8(uint8x8_t a, uint8x8_t b){uint16x8_t r; NEON_LANES(8) r.v[i]=a.v[i]*b.v[i]; return r;}
+static inline uint16x8_t vaddw_u8(uint16x8_t a, uint8x8_t b){uint16x8_t r; NEON_LANES(8) r.v[i]=(uint16_t)(a.v[i]+b.v[i]); return r;}
+static inline uint16x8_t vaddq_u16(uint16x8_t a, uint16x8_t b){uint16x8_t r; NEON_LANES(8) r.v[i]=(uint16_t)(a.v[i]+b.v[i]); return r;}
+static inline uint16x8_t vmulq_u16(uint16x8_t a, uint16x8_t b){uint16x8_t r; NEON_LANES(8) r.v[i]=(uint16_t)(a.v[i]*b.v[i]); return r;}
+static inline uint16x8_t vmlaq_u16(uint16x8_t a, uint16x8_t b, uint16x8_t c){uint16x8_t r; NEON_LANES(8) r.v[i]=(uint16_t)(a.v[i]+(uint32_t)b.v[i]*c.v[i]); return r;}
+static inline uint8x8_t vraddhn_u16(uint16x8_t a, uint16x8_t b){uint8x8_t r; NEON_LANES(8) r.v[i]=(uint8_t)(((uint32_t)a.v[i]+b.v[i]+128)>>8); return r;}
+static inline uint8x8_t vmovn_u16(uint16x8_t a){uint8x8_t r; NEON_LANES(8) r.v[i]=(uint8_t)a.v[i]; return r;}
+static inline uint16x8_t vdupq_n_u16(uint16_t a){uint16x8_t r; NEON_LANES(8) r.v[i]=a; return r;}
+static inline uint16x4_t vdup_n_u16(uint16_t a){uint16x4_t r; NEON_LANES(4) r.v[i]=a; return r;}
+static inline uint16x4_t vget_low_u16(uint16x8_t a){uint16x4_t r; NEON_LANES(4) r.v[i]=a.v[i]; return r;}
+static inline uint16x4_t vget_high_u16(uint16x8_t a){uint16x4_t r; NEON_LANES(4) r.v[i]=a.v[i+4]; return r;}
+static inline uint32x4_t vmull_u16(uint16x4_t a, uint16x4_t b){uint32x4_t r; NEON_LANES(4) r.v[i]=(uint32_t)a.v[i]*b.v[i]; return r;}
+static inline uint32x4_t vmovl_u16(uint16x4_t a){uint32x4_t r; NEON_LANES(4) r.v[i]=a.v[i]; return r;}
+static inline int32x4_t vreinterpretq_s32_u32(uint32x4_t a){int32x4_t r; NEON_LANES(4) r.v[i]=(int32_t)a.v[i]; return r;}
+static inline int32x4_t vmulq_s32(int32x4_t a, int32x4_t b){int32x4_t r; NEON_LANES(4) r.v[i]=a.v[i]*b.v[i]; return r;}
+static inline int16x4_t vqmovn_s32(int32x4_t a){int16x4_t r; NEON_LANES(4) r.v[i]=a.v[i]>32767?32767:a.v[i]<-32768?-32768:a.v[i]; return r;}
+static inline int16x8_t vcombine_s16(int16x4_t a, int16x4_t b){int16x8_t r; NEON_LANES(4){r.v[i]=a.v[i]; r.v[i+4]=b.v[i];} return r;}
+static inline uint8x8_t vqmovun_s16(int16x8_t a){uint8x8_t r; NEON_LANES(8) r.v[i]=a.v[i]<0?0:a.v[i]>255?255:a.v[i]; return r;}
+static inline uint16x8_t vld1q_u16(const uint16_t *p){uint16x8_t r; NEON_LANES(8) r.v[i]=p[i]; return r;}
+static inline uint32x2_t vreinterpret_u32_u8(uint8x8_t a){uint32x2_t r; memcpy(r.v,a.v,8); return r;}
+#define vget_lane_u32(a,l) ((a).v[l])
+static inline uint8x8x2_t vld2_u8(const uint8_t *p){uint8x8x2_t r; NEON_LANES(8){r.val[0].v[i]=p[2*i]; r.val[1].v[i]=p[2*i+1];} return r;}
+static inline uint8x8x4_t vld4_u8(const uint8_t *p){uint8x8x4_t r; NEON_LANES(8){for(int k=0;k<4;k++) r.val[k].v[i]=p[4*i+k];} return r;}
+static inline void vst2_u8(uint8_t *p, uint8x8x2_t a){NEON_LANES(8){p[2*i]=a.val[0].v[i]; p[2*i+1]=a.val[1].v[i];}}
+static inline void vst4_u8(uint8_t *p, uint8x8x4_t a){NEON_LANES(8){for(int k=0;k<4;k++) p[4*i+k]=a.val[k].v[i];}}
+
+#endif
@@ -28,6 +28,10 @@ done
 cp -r $MUPDF/fonts ../jni/mupdf/
 cp -r $FREETYPE/{src,include} ../jni/freetype/
 gcc -o ../scripts/fontdump $MUPDF/scripts/fontdump.c
+gcc -o ../scripts/cjkpack -I$MUPDF/fitz -I$MUPDF/pdf -I../jni/mupdf/pdf ../scripts/cjkpack.c -lm
+mkdir ../assets 2> /dev/null
+# .jet makes aapt store the pack uncompressed, so it can be mapped from apk
+../scripts/cjkpack ../assets/cjk.pack.jet $MUPDF/fonts/droid/DroidSansFallback.ttf $MUPDF/cmaps/*/*
 cd ../jni/mupdf
 mkdir generated 2> /dev/null
 ../../scripts/fontdump generated/font_base14.h fonts/*.cff
@@ -0,0 +1,240 @@
+/* cjkpack.c -- pack CJK fonts and CMaps into one file read by jni/mupdf/pdf/apv_pdf_cjk.c */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "fitz.h"
+#include "mupdf.h"
+#include "apv_pdf_cjk.h"
+
+#include "base_error.c"
+#include "base_memory.c"
+#include "base_string.c"
+#include "stm_buffer.c"
+#include "stm_open.c"
+#include "stm_read.c"
+
+#include "pdf_lex.c"
+#include "pdf_cmap.c"
+#include "pdf_cmap_parse.c"
+
+/* pack is read in place on little-endian ARM */
+static void
+put32(unsigned char *p, int v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static void
+put16(unsigned char *p, int v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+struct item
+{
+	pdf_cjk_entry entry;
+	unsigned char *data;
+};
+
+static int
+cmpitem(const void *a, const void *b)
+{
+	return strncmp(((struct item*)a)->entry.name, ((struct item*)b)->entry.name, sizeof ((struct item*)a)->entry.name);
+}
+
+static char *
+basename_of(char *path)
+{
+	char *p = strrchr(path, '/');
+	return p ? p + 1 : path;
+}
+
+/* serialize cmap as pdf_cjk_cmap followed by ranges and table */
+static unsigned char *
+pack_cmap(pdf_cmap *cmap, int *lenp)
+{
+	pdf_cjk_cmap hdr;
+	unsigned char *data, *p;
+	int len, k;
+
+	len = sizeof hdr + cmap->rlen * 6 + cmap->tlen * 2;
+	data = fz_malloc(len);
+	memset(&hdr, 0, sizeof hdr);
+
+	p = data;
+	memcpy(p + offsetof(pdf_cjk_cmap, cmap_name), cmap->cmap_name, sizeof hdr.cmap_name);
+	memcpy(p + offsetof(pdf_cjk_cmap, usecmap_name), cmap->usecmap_name, sizeof hdr.usecmap_name);
+	put32(p + offsetof(pdf_cjk_cmap, wmode), cmap->wmode);
+	put32(p + offsetof(pdf_cjk_cmap, codespace_len), cmap->codespace_len);
+	memset(p + offsetof(pdf_cjk_cmap, codespace), 0, sizeof hdr.codespace);
+	for (k = 0; k < cmap->codespace_len; k++)
+	{
+		unsigned char *cs = p + offsetof(pdf_cjk_cmap, codespace) + k * sizeof hdr.codespace[0];
+		put16(cs, cmap->codespace[k].n);
+		put16(cs + 2, cmap->codespace[k].low);
+		put16(cs + 4, cmap->codespace[k].high);
+	}
+	put32(p + offsetof(pdf_cjk_cmap, rlen), cmap->rlen);
+	put32(p + offsetof(pdf_cjk_cmap, tlen), cmap->tlen);
+
+	p += sizeof hdr;
+	for (k = 0; k < cmap->rlen; k++, p += 6)
+	{
+		put16(p, cmap->ranges[k].low);
+		put16(p + 2, cmap->ranges[k].extent_flags);
+		put16(p + 4, cmap->ranges[k].offset);
+	}
+	for (k = 0; k < cmap->tlen; k++, p += 2)
+		put16(p, cmap->table[k]);
+
+	*lenp = len;
+	return data;
+}
+
+static unsigned char *
+read_font_file(char *path, int *lenp)
+{
+	unsigned char *data;
+	FILE *fi;
+	int len;
+
+	fi = fopen(path, "rb");
+	if (!fi)
+		return NULL;
+	fseek(fi, 0, SEEK_END);
+	len = ftell(fi);
+	fseek(fi, 0, SEEK_SET);
+	data = fz_malloc(len);
+	if (fread(data, 1, len, fi) != (size_t)len)
+	{
+		fclose(fi);
+		fz_free(data);
+		return NULL;
+	}
+	fclose(fi);
+
+	*lenp = len;
+	return data;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct item *items;
+	unsigned char hdr[sizeof(pdf_cjk_header)];
+	unsigned char ent[sizeof(pdf_cjk_entry)];
+	static const unsigned char zeros[4];
+	pdf_cmap *cmap;
+	fz_error error;
+	fz_stream *fi;
+	FILE *fo;
+	char *name, *dot;
+	int count, offset;
+	int i;
+
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: cjkpack output.pack font.ttf ... cmap files\n");
+		return 1;
+	}
+
+	count = argc - 2;
+	items = fz_calloc(count, sizeof(struct item));
+	memset(items, 0, count * sizeof(struct item));
+
+	for (i = 0; i < count; i++)
+	{
+		name = basename_of(argv[i + 2]);
+		dot = strrchr(name, '.');
+		if (strlen(name) > sizeof items[i].entry.name - 1)
+		{
+			fprintf(stderr, "cjkpack: file name too long: '%s'\n", name);
+			return 1;
+		}
+		strcpy(items[i].entry.name, name);
+
+		if (dot && (!strcmp(dot, ".ttf") || !strcmp(dot, ".otf") || !strcmp(dot, ".cff")))
+		{
+			/* fonts are looked up by name without extension */
+			items[i].entry.name[dot - name] = 0;
+			items[i].entry.kind = PDF_CJK_FONT;
+			items[i].data = read_font_file(argv[i + 2], &items[i].entry.length);
+			if (!items[i].data)
+			{
+				fprintf(stderr, "cjkpack: could not read font '%s'\n", argv[i + 2]);
+				return 1;
+			}
+		}
+		else
+		{
+			fi = fz_open_file(argv[i + 2]);
+			if (!fi)
+			{
+				fprintf(stderr, "cjkpack: could not open input file '%s'\n", argv[i + 2]);
+				return 1;
+			}
+			error = pdf_parse_cmap(&cmap, fi);
+			if (error)
+			{
+				fz_catch(error, "cjkpack: could not parse input cmap '%s'\n", argv[i + 2]);
+				return 1;
+			}
+			fz_close(fi);
+			items[i].entry.kind = PDF_CJK_CMAP;
+			items[i].data = pack_cmap(cmap, &items[i].entry.length);
+			pdf_drop_cmap(cmap);
+		}
+	}
+
+	/* entries are searched by name */
+	qsort(items, count, sizeof(struct item), cmpitem);
+
+	offset = sizeof(pdf_cjk_header) + count * sizeof(pdf_cjk_entry);
+	for (i = 0; i < count; i++)
+	{
+		items[i].entry.offset = offset;
+		offset += (items[i].entry.length + 3) & ~3;
+	}
+
+	fo = fopen(argv[1], "wb");
+	if (!fo)
+	{
+		fprintf(stderr, "cjkpack: could not open output file '%s'\n", argv[1]);
+		return 1;
+	}
+
+	memset(hdr, 0, sizeof hdr);
+	memcpy(hdr, PDF_CJK_MAGIC, strlen(PDF_CJK_MAGIC));
+	put32(hdr + offsetof(pdf_cjk_header, count), count);
+	fwrite(hdr, 1, sizeof hdr, fo);
+
+	for (i = 0; i < count; i++)
+	{
+		memset(ent, 0, sizeof ent);
+		memcpy(ent, items[i].entry.name, sizeof items[i].entry.name);
+		put32(ent + offsetof(pdf_cjk_entry, kind), items[i].entry.kind);
+		put32(ent + offsetof(pdf_cjk_entry, offset), items[i].entry.offset);
+		put32(ent + offsetof(pdf_cjk_entry, length), items[i].entry.length);
+		fwrite(ent, 1, sizeof ent, fo);
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		fwrite(items[i].data, 1, items[i].entry.length, fo);
+		fwrite(zeros, 1, ((items[i].entry.length + 3) & ~3) - items[i].entry.length, fo);
+	}
+
+	if (fclose(fo))
+	{
+		fprintf(stderr, "cjkpack: could not write output file '%s'\n", argv[1]);
+		return 1;
+	}
+
+	return 0;
+}
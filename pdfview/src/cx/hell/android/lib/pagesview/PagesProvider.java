@@ -1,6 +1,7 @@
 package cx.hell.android.lib.pagesview;
 
 import java.util.Collection;
+import java.util.Map;
 
 import android.graphics.Bitmap;
 
@@ -15,6 +16,45 @@ public abstract class PagesProvider {
 	 */
 	public abstract Bitmap getPageBitmap(Tile tile);
 	
+	/**
+	 * Get tiles of other zoom levels that cover the same area as given tile.
+	 * Used to show something scaled while exact tile is being rendered.
+	 * Default implementation returns null.
+	 * @return bitmaps keyed by tiles they were rendered for, or null if there are none
+	 */
+	public Map<Tile,Bitmap> getFallbackBitmaps(Tile tile) {
+		return null;
+	}
+	
+	/**
+	 * View informs provider whether it's moving too fast to be read (fling).
+	 * Tiles requested while moving fast may be rendered in draft quality,
+	 * and should be rendered again in full quality once motion stops.
+	 * Default implementation ignores this.
+	 */
+	public void setDraftMode(boolean draftMode) {
+	}
+	
+	/**
+	 * View informs provider that it finished drawing a frame.
+	 * Bitmaps that were not returned by getPageBitmap or getFallbackBitmaps during
+	 * the whole frame are not on screen anymore, so their memory can be reused.
+	 * Default implementation ignores this.
+	 */
+	public void onFrameDrawn() {
+	}
+	
+	/**
+	 * Get multiplier of default tile pixel count for given page.
+	 * Provider that measures render cost can ask for larger tiles on cheap pages
+	 * and smaller tiles on expensive ones. Tiles are keyed by their size, so factor
+	 * of page should not change while its tiles are cached.
+	 * Default implementation returns 1.
+	 */
+	public float getTileSizeFactor(int page) {
+		return 1f;
+	}
+	
 	/**
 	 * Get page count.
 	 * This cannot change between executions - PagesView assumes (for now) that docuement doesn't change.
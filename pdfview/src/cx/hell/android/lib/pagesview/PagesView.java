@@ -1,5 +1,6 @@
 package cx.hell.android.lib.pagesview;
 
+import java.util.Collections;
 import java.util.Iterator;
 import java.util.LinkedList;
 import java.util.List;
@@ -16,6 +17,7 @@ import android.graphics.ColorMatrixColorFilter;
 import android.graphics.Paint;
 import android.graphics.Point;
 import android.graphics.Rect;
+import android.graphics.RectF;
 import android.os.SystemClock;
 import android.util.Log;
 import android.view.GestureDetector;
@@ -49,7 +51,18 @@ public class PagesView extends View implements
 	private static final int MIN_TILE_WIDTH = 256;
 	private static final int MAX_TILE_WIDTH = 640;
 	private static final int MIN_TILE_HEIGHT = 128;
-	private static final int MAX_TILE_PIXELS = 640*360;
+	public static final int MAX_TILE_PIXELS = 640*360;
+	
+	/**
+	 * Tiles are rendered only at zoom levels from a fixed ladder, this many steps per doubling of zoom.
+	 * Pages are scaled on screen between ladder steps, so tiles can be reused after zoom changes.
+	 */
+	private static final int RENDER_ZOOM_STEPS_PER_DOUBLING = 4;
+	
+	/**
+	 * Page previews are rendered this many render zoom ladder steps below render zoom (1/4 scale).
+	 */
+	private static final int PREVIEW_ZOOM_STEPS = 2 * RENDER_ZOOM_STEPS_PER_DOUBLING;
 	
 //	private final static int MAX_ZOOM = 4000;
 //	private final static int MIN_ZOOM = 100;
@@ -160,6 +173,17 @@ public class PagesView extends View implements
 	 */
 	private Rect r1 = new Rect();
 	
+	/**
+	 * Predicts where viewport goes, so we know which tiles to render ahead.
+	 */
+	private RenderAheadPredictor renderAheadPredictor = new RenderAheadPredictor();
+	
+	/**
+	 * Area that should be rendered in screen coordinates, includes screen and tiles rendered ahead.
+	 * Updated in drawPages.
+	 */
+	private Rect renderAheadRect = new Rect();
+	
 
 	/**
 	 * Bookmarked page to go to.
@@ -413,6 +437,8 @@ public class PagesView extends View implements
 		}
 		this.drawPages(canvas);
 		if (this.findMode) this.drawFindResults(canvas);
+		if (this.pagesProvider != null)
+			this.pagesProvider.onFrameDrawn();
 	}
 	
 	/**
@@ -451,6 +477,88 @@ public class PagesView extends View implements
 		return (int)currentpagewidth;
 	}
 	
+	/**
+	 * Get page width in pixels when rendered at given zoom, taking into account rotation.
+	 * @param pageno 0-based page number
+	 * @param zoom render zoom, 1000 is 100%
+	 */
+	private int getPageWidthAtZoom(int pageno, int zoom) {
+		return (int)(this.pageSizes[pageno][this.rotation % 2 == 0 ? 0 : 1] * zoom * 0.001f);
+	}
+	
+	/**
+	 * Get page height in pixels when rendered at given zoom, taking into account rotation.
+	 * @param pageno 0-based page number
+	 * @param zoom render zoom, 1000 is 100%
+	 */
+	private int getPageHeightAtZoom(int pageno, int zoom) {
+		return (int)(this.pageSizes[pageno][this.rotation % 2 == 0 ? 1 : 0] * zoom * 0.001f);
+	}
+	
+	/**
+	 * Snap zoom up to step of render zoom ladder, so tiles are only ever scaled down on screen.
+	 * @param zoom zoom at which pages are displayed, 1000 is 100%
+	 * @return zoom at which tiles should be rendered
+	 */
+	private static int getRenderZoom(float zoom) {
+		if (zoom <= 1)
+			return 1;
+		/* epsilon keeps zooms sitting right on a step from going one step up due to rounding errors */
+		return getRenderZoomAtStep((int)Math.ceil(getRenderZoomSteps(zoom) - 0.01));
+	}
+	
+	/**
+	 * Get index of render zoom ladder step nearest to given zoom; step 0 is 100%.
+	 */
+	private static int getRenderZoomStep(float zoom) {
+		return (int)Math.round(getRenderZoomSteps(zoom));
+	}
+	
+	/**
+	 * Get position of given zoom on render zoom ladder, in steps from 100%.
+	 */
+	private static double getRenderZoomSteps(float zoom) {
+		return RENDER_ZOOM_STEPS_PER_DOUBLING * Math.log(zoom / 1000.0) / Math.log(2);
+	}
+	
+	/**
+	 * Get zoom of given render zoom ladder step.
+	 */
+	private static int getRenderZoomAtStep(int step) {
+		int renderZoom = (int)Math.round(1000.0 * Math.pow(2, (double)step / RENDER_ZOOM_STEPS_PER_DOUBLING));
+		return renderZoom < 1 ? 1 : renderZoom;
+	}
+	
+	/**
+	 * Get low resolution tile covering whole page, used as a placeholder
+	 * until tiles at render zoom are ready.
+	 * Preview is rendered at about 1/4 of render zoom, or less if it would be too large
+	 * for a single tile. Previews stay on the zoom ladder, so they are used
+	 * as fallback for missing tiles after zooming out.
+	 * @param pageno 0-based page number
+	 * @param renderZoom zoom at which tiles of this page are rendered
+	 * @param renderPageWidth page width at render zoom
+	 * @param renderPageHeight page height at render zoom
+	 * @return preview tile or null if page at render zoom is small enough not to need one
+	 */
+	private Tile getPreviewTile(int pageno, int renderZoom, int renderPageWidth, int renderPageHeight) {
+		if (renderPageWidth * renderPageHeight <= MAX_TILE_PIXELS)
+			return null;
+		int step = getRenderZoomStep(renderZoom) - PREVIEW_ZOOM_STEPS;
+		int zoom = getRenderZoomAtStep(step);
+		int w = this.getPageWidthAtZoom(pageno, zoom);
+		int h = this.getPageHeightAtZoom(pageno, zoom);
+		while (w * h > MAX_TILE_PIXELS && zoom > 1) {
+			step -= RENDER_ZOOM_STEPS_PER_DOUBLING;
+			zoom = getRenderZoomAtStep(step);
+			w = this.getPageWidthAtZoom(pageno, zoom);
+			h = this.getPageHeightAtZoom(pageno, zoom);
+		}
+		if (w <= 0 || h <= 0)
+			return null;
+		return new Tile(pageno, zoom, 0, 0, this.rotation, w, h);
+	}
+	
 	private float scale(float unscaled) {
 		return unscaled * scaling0 * this.zoomLevel * 0.001f;
 	}
@@ -545,6 +653,8 @@ public class PagesView extends View implements
 		int x, y; // on screen
 		int viewx0, viewy0; // view over doc
 		LinkedList<Tile> visibleTiles = new LinkedList<Tile>();
+		LinkedList<Tile> aheadTiles = new LinkedList<Tile>();
+		LinkedList<Tile> previewTiles = new LinkedList<Tile>();
 		float currentMarginX = this.getCurrentMarginX();
 		float currentMarginY = this.getCurrentMarginY();
 		
@@ -561,14 +671,14 @@ public class PagesView extends View implements
 			int adjScreenTop;
 			int adjScreenWidth;
 			int adjScreenHeight;
-			float renderAhead;
+			long now = SystemClock.uptimeMillis();
 			
 			if (mtZoomActive) {
 				adjScreenWidth = (int)(this.width / mtZoomValue);
 				adjScreenLeft = this.width/2 - adjScreenWidth/2;
 				adjScreenHeight = (int)(this.height / mtZoomValue);
 				adjScreenTop = this.height/2 - adjScreenHeight/2;
-				renderAhead = 1f;
+				this.renderAheadRect.set(0, 0, adjScreenWidth, adjScreenHeight);
 				Log.v(TAG, "adj:"+ adjScreenLeft+" "+adjScreenTop+" "+adjScreenWidth+" "+adjScreenHeight);
 			}
 			else {
@@ -591,7 +701,13 @@ public class PagesView extends View implements
 				adjScreenHeight = this.height;
 				adjScreenTop = 0;
 				
-				renderAhead = this.pagesProvider.getRenderAhead();
+				this.renderAheadPredictor.onPosition(this.left, this.top, this.width, this.height, now);
+				this.renderAheadPredictor.getRenderAheadRect(this.renderAheadRect, adjScreenWidth, adjScreenHeight,
+						this.pagesProvider.getRenderAhead(), now);
+				if (this.renderAheadPredictor.isMoving(now)) {
+					/* redraw once movement stops, so render ahead goes back to reading direction */
+					postInvalidateDelayed(RenderAheadPredictor.IDLE_MILLIS);
+				}
 			}
 
 			float currpageoff = currentMarginY;
@@ -600,6 +716,9 @@ public class PagesView extends View implements
 			
 			pagey0 = 0;
 			int[] tileSizes = new int[2];
+			float displayZoom = this.zoomLevel * scaling0;
+			int renderZoom = getRenderZoom(displayZoom);
+			float tileScale = displayZoom / renderZoom;
 			
 			for(int i = 0; i < pageCount; ++i) {
 				// is page i visible?
@@ -614,13 +733,16 @@ public class PagesView extends View implements
 				
 				if (rectsintersect(
 							(int)pagex0, (int)pagey0, (int)pagex1, (int)pagey1, // page rect in doc
-							viewx0 + adjScreenLeft, 
-							viewy0 + adjScreenTop, 
-							viewx0 + adjScreenLeft + adjScreenWidth, 
-							viewy0 + adjScreenTop + (int)(renderAhead*adjScreenHeight) // viewport rect in doc, or close enough to it
+							viewx0 + adjScreenLeft + this.renderAheadRect.left, 
+							viewy0 + adjScreenTop + this.renderAheadRect.top, 
+							viewx0 + adjScreenLeft + this.renderAheadRect.right, 
+							viewy0 + adjScreenTop + this.renderAheadRect.bottom // viewport rect in doc, or close enough to it
 						))
 				{
-					if (this.currentPage == -1)  {
+					if (this.currentPage == -1 && rectsintersect(
+								(int)pagex0, (int)pagey0, (int)pagex1, (int)pagey1,
+								viewx0 + adjScreenLeft, viewy0 + adjScreenTop,
+								viewx0 + adjScreenLeft + adjScreenWidth, viewy0 + adjScreenTop + adjScreenHeight))  {
 						// remember the currently displayed page
 						this.currentPage = i;
 					}
@@ -628,26 +750,31 @@ public class PagesView extends View implements
 					x = (int)pagex0 - viewx0 - adjScreenLeft;
 					y = (int)pagey0 - viewy0 - adjScreenTop;
 					
-					getGoodTileSizes(tileSizes, pageWidth, pageHeight);
+					int renderPageWidth = this.getPageWidthAtZoom(i, renderZoom);
+					int renderPageHeight = this.getPageHeightAtZoom(i, renderZoom);
+					
+					getGoodTileSizes(tileSizes, i, renderPageWidth, renderPageHeight);
+					boolean pageOnScreen = false;
 					
-					for(int tileix = 0; tileix < (pageWidth + tileSizes[0]-1) / tileSizes[0]; ++tileix)
-						for(int tileiy = 0; tileiy < (pageHeight + tileSizes[1]-1) / tileSizes[1]; ++tileiy) {
+					for(int tileix = 0; tileix < (renderPageWidth + tileSizes[0]-1) / tileSizes[0]; ++tileix)
+						for(int tileiy = 0; tileiy < (renderPageHeight + tileSizes[1]-1) / tileSizes[1]; ++tileiy) {
 							
-							dst.left = (int)(x + tileix*tileSizes[0]);
-							dst.top = (int)(y + tileiy*tileSizes[1]);
-							dst.right = dst.left + tileSizes[0];
-							dst.bottom = dst.top + tileSizes[1];	
+							dst.left = x + (int)(tileix*tileSizes[0]*tileScale);
+							dst.top = y + (int)(tileiy*tileSizes[1]*tileScale);
+							dst.right = x + (int)((tileix+1)*tileSizes[0]*tileScale);
+							dst.bottom = y + (int)((tileiy+1)*tileSizes[1]*tileScale);
 						
-							if (dst.intersects(0, 0, adjScreenWidth, 
-									(int)(renderAhead*adjScreenHeight))) {
+							if (dst.intersects(this.renderAheadRect.left, this.renderAheadRect.top,
+									this.renderAheadRect.right, this.renderAheadRect.bottom)) {
 
-								Tile tile = new Tile(i, (int)(this.zoomLevel * scaling0), 
+								Tile tile = new Tile(i, renderZoom, 
 										tileix*tileSizes[0], tileiy*tileSizes[1], this.rotation,
 										tileSizes[0], tileSizes[1]);
 								
-								if (dst.intersects(0, 0, 
+								boolean onScreen = dst.intersects(0, 0, 
 										adjScreenWidth,
-										adjScreenHeight)) {
+										adjScreenHeight);
+								if (onScreen) {
 									Bitmap b = this.pagesProvider.getPageBitmap(tile);
 									if (b != null) {
 										//Log.d(TAG, "  have bitmap: " + b + ", size: " + b.getWidth() + " x " + b.getHeight());
@@ -657,39 +784,127 @@ public class PagesView extends View implements
 										src.bottom = b.getHeight();
 										
 										if (dst.right > x + pageWidth) {
-											src.right = (int)(b.getWidth() * (float)((x+pageWidth)-dst.left) / (float)(dst.right - dst.left));
+											src.right = Math.max(1, (int)(b.getWidth() * (float)((x+pageWidth)-dst.left) / (float)(dst.right - dst.left)));
 											dst.right = (int)(x + pageWidth);
 										}
 										
 										if (dst.bottom > y + pageHeight) {
-											src.bottom = (int)(b.getHeight() * (float)((y+pageHeight)-dst.top) / (float)(dst.bottom - dst.top));
+											src.bottom = Math.max(1, (int)(b.getHeight() * (float)((y+pageHeight)-dst.top) / (float)(dst.bottom - dst.top)));
 											dst.bottom = (int)(y + pageHeight);
 										}
 										
-										if (mtZoomActive) {
-											dst.left = (int) ((dst.left-adjScreenWidth/2) * mtZoomValue + this.width/2); 
-											dst.right = (int) ((dst.right-adjScreenWidth/2) * mtZoomValue + this.width/2); 
-											dst.top = (int) ((dst.top-adjScreenHeight/2) * mtZoomValue + this.height/2); 
-											dst.bottom = (int) ((dst.bottom-adjScreenHeight/2) * mtZoomValue + this.height/2); 
-										}
+										if (mtZoomActive)
+											mtZoomTransform(dst, adjScreenWidth, adjScreenHeight);
 										
 										drawBitmap(canvas, b, src, dst);
 									}
+									else {
+										drawFallbackBitmaps(canvas, tile, dst, x, y, pageWidth, pageHeight,
+												displayZoom, adjScreenWidth, adjScreenHeight);
+									}
+								}
+								if (!mtZoomActive) {
+									pageOnScreen |= onScreen;
+									if (onScreen)
+										visibleTiles.add(tile);
+									else
+										aheadTiles.add(tile);
 								}
-								if (!mtZoomActive)
-									visibleTiles.add(tile);
 							}
 						}
+					
+					if (pageOnScreen) {
+						Tile preview = this.getPreviewTile(i, renderZoom, renderPageWidth, renderPageHeight);
+						if (preview != null)
+							previewTiles.add(preview);
+					}
 				}
 				
 				
 				/* move to next page */
 				currpageoff += currentMarginY + this.getCurrentPageHeight(i);
 			}
-			this.pagesProvider.setVisibleTiles(visibleTiles);
+			/* previews of visible pages go first, then visible tiles, then tiles ahead, closest to the screen first */
+			if (this.renderAheadPredictor.isBackward(now))
+				Collections.reverse(aheadTiles);
+			previewTiles.addAll(visibleTiles);
+			previewTiles.addAll(aheadTiles);
+			this.pagesProvider.setDraftMode(this.renderAheadPredictor.isFast(now));
+			this.pagesProvider.setVisibleTiles(previewTiles);
 		}
 	}
 		
+	/**
+	 * Move rect drawn at adjusted screen to its place on screen while multitouch zoom is in progress.
+	 */
+	private void mtZoomTransform(Rect r, int adjScreenWidth, int adjScreenHeight) {
+		r.left = (int) ((r.left-adjScreenWidth/2) * mtZoomValue + this.width/2); 
+		r.right = (int) ((r.right-adjScreenWidth/2) * mtZoomValue + this.width/2); 
+		r.top = (int) ((r.top-adjScreenHeight/2) * mtZoomValue + this.height/2); 
+		r.bottom = (int) ((r.bottom-adjScreenHeight/2) * mtZoomValue + this.height/2); 
+	}
+	
+	/**
+	 * Draw bitmaps of other zoom levels scaled in place of tile that's not rendered yet.
+	 * Bitmaps rendered before page was rotated are turned to current rotation.
+	 * Exact tile is rendered in background and replaces them once it's ready.
+	 * @param tile missing tile
+	 * @param tileDst where missing tile would be drawn
+	 * @param x page position on screen
+	 * @param y page position on screen
+	 */
+	private void drawFallbackBitmaps(Canvas canvas, Tile tile, Rect tileDst, int x, int y, 
+			int pageWidth, int pageHeight, float displayZoom, int adjScreenWidth, int adjScreenHeight) {
+		Map<Tile,Bitmap> fallback = this.pagesProvider.getFallbackBitmaps(tile);
+		if (fallback == null)
+			return;
+		
+		Rect clip = new Rect(tileDst);
+		if (!clip.intersect(x, y, x + pageWidth, y + pageHeight))
+			return;
+		if (mtZoomActive)
+			mtZoomTransform(clip, adjScreenWidth, adjScreenHeight);
+		
+		Rect src = new Rect();
+		Rect dst = new Rect();
+		RectF r = new RectF();
+		int[] pageSize = this.pageSizes[tile.getPage()];
+		canvas.save();
+		canvas.clipRect(clip);
+		for(Map.Entry<Tile,Bitmap> e: fallback.entrySet()) {
+			Tile t = e.getKey();
+			Bitmap b = e.getValue();
+			float f = displayZoom / t.getZoom();
+			src.set(0, 0, b.getWidth(), b.getHeight());
+			t.getRectInRotation(tile.getRotation(), pageSize[0], pageSize[1], r);
+			dst.left = x + (int)(r.left * f);
+			dst.top = y + (int)(r.top * f);
+			dst.right = x + (int)(r.right * f);
+			dst.bottom = y + (int)(r.bottom * f);
+			if (mtZoomActive)
+				mtZoomTransform(dst, adjScreenWidth, adjScreenHeight);
+			int degrees = t.getDegreesToRotation(tile.getRotation());
+			if (degrees == 0) {
+				drawBitmap(canvas, b, src, dst);
+			}
+			else {
+				/* draw unrotated around the same center, then turn it into place */
+				canvas.save();
+				canvas.rotate(degrees, dst.exactCenterX(), dst.exactCenterY());
+				if (degrees % 180 != 0) {
+					int cx = dst.centerX();
+					int cy = dst.centerY();
+					int hw = dst.height() / 2;
+					int hh = dst.width() / 2;
+					dst.set(cx - hw, cy - hh, cx + hw, cy + hh);
+				}
+				drawBitmap(canvas, b, src, dst);
+				canvas.restore();
+			}
+		}
+		canvas.restore();
+	}
+	
 	private void drawBitmap(Canvas canvas, Bitmap b, Rect src, Rect dst) {
 		if (colorMode != Options.COLOR_MODE_NORMAL) {
 			Paint paint = new Paint();
@@ -983,7 +1198,7 @@ public class PagesView extends View implements
 				(int)getCurrentDocumentHeight());
 		
 		float currpageoff = currentMarginY;
-		float renderAhead = this.pagesProvider.getRenderAhead();
+		float displayZoom = this.zoomLevel * scaling0;
 
 		float pagex0;
 		float pagex1;
@@ -1017,13 +1232,15 @@ public class PagesView extends View implements
 				for (Tile tile: renderedTiles.keySet()) {
 					if (tile.getPage() == i) {
 						Bitmap b = renderedTiles.get(tile); 
+						float f = displayZoom / tile.getZoom();
 						
-						rect.left = (int)(x + tile.getX());
-						rect.top = (int)(y + tile.getY());
-						rect.right = rect.left + b.getWidth();
-						rect.bottom = rect.top + b.getHeight();	
+						rect.left = (int)(x + tile.getX() * f);
+						rect.top = (int)(y + tile.getY() * f);
+						rect.right = rect.left + (int)(tile.getPrefXSize() * f);
+						rect.bottom = rect.top + (int)(tile.getPrefYSize() * f);	
 					
-						if (rect.intersects(0, 0, this.width, (int)(renderAhead*this.height))) {
+						if (rect.intersects(this.renderAheadRect.left, this.renderAheadRect.top,
+								this.renderAheadRect.right, this.renderAheadRect.bottom)) {
 							Log.v(TAG, "New bitmap forces redraw");
 							postInvalidate();
 							return;
@@ -1103,6 +1320,7 @@ public class PagesView extends View implements
 
 		this.top = (int)top;
 		this.currentPage = page;
+		this.renderAheadPredictor.reset();
 		this.invalidate();
 	}
 	
@@ -1286,6 +1504,7 @@ public class PagesView extends View implements
 		int maxy = this.height/2 + getUpperBound(this.height, marginY,
 				  getCurrentDocumentHeight());
 
+		this.renderAheadPredictor.onFling(-vx, -vy, SystemClock.uptimeMillis());
 		this.scroller = new Scroller(activity);
 		this.scroller.fling(this.left, this.top, 
 				(int)-vx, (int)-vy,
@@ -1309,6 +1528,7 @@ public class PagesView extends View implements
 		this.top *= value;
 		Log.d(TAG, "zoom level changed to " + this.zoomLevel);
 		zoomToRestore = 0;
+		this.renderAheadPredictor.reset();
 		this.invalidate();		
 	}
 
@@ -1320,6 +1540,7 @@ public class PagesView extends View implements
 		this.zoomLevel = this.zoomLevel * (this.width - 2*marginX) / pageWidth;
 		this.left = (int) (this.width/2);
 		zoomToRestore = 0;
+		this.renderAheadPredictor.reset();
 		this.invalidate();		
 	}
 
@@ -1333,6 +1554,7 @@ public class PagesView extends View implements
 		this.left = this.width/2 + pos.x;
 		this.top = this.height/2 + pos.y;
 		zoomToRestore = 0;
+		this.renderAheadPredictor.reset();
 		this.invalidate();		
 	}
 
@@ -1345,6 +1567,7 @@ public class PagesView extends View implements
 		this.zoomLevel = zoomLevel;
 		Log.d(TAG, "zoom level changed to " + this.zoomLevel);
 		zoomToRestore = 0;
+		this.renderAheadPredictor.reset();
 		this.invalidate();
 	}
 	
@@ -1381,9 +1604,16 @@ public class PagesView extends View implements
 	}
 	
 
-	private void getGoodTileSizes(int[] sizes, int pageWidth, int pageHeight) {
-		sizes[0] = getGoodTileSize(pageWidth, MIN_TILE_WIDTH, MAX_TILE_WIDTH);		
-		sizes[1] = getGoodTileSize(pageHeight, MIN_TILE_HEIGHT, MAX_TILE_PIXELS / sizes[0]); 
+	/**
+	 * Choose tile size for page. Default limits are scaled by factor from
+	 * pages provider, which depends on how expensive the page is to render.
+	 */
+	private void getGoodTileSizes(int[] sizes, int page, int pageWidth, int pageHeight) {
+		float factor = this.pagesProvider.getTileSizeFactor(page);
+		int maxWidth = Math.max(MIN_TILE_WIDTH, (int)(MAX_TILE_WIDTH * (float)Math.sqrt(factor)));
+		int maxPixels = (int)(MAX_TILE_PIXELS * factor);
+		sizes[0] = getGoodTileSize(pageWidth, MIN_TILE_WIDTH, maxWidth);		
+		sizes[1] = getGoodTileSize(pageHeight, MIN_TILE_HEIGHT, Math.max(MIN_TILE_HEIGHT, maxPixels / sizes[0])); 
 	}
 	
 	private int getGoodTileSize(int pageSize, int minSize, int maxSize) {
@@ -0,0 +1,214 @@
+package cx.hell.android.lib.pagesview;
+
+import android.graphics.Rect;
+
+/**
+ * Predicts where viewport is going, so that renderer can prepare tiles that will
+ * be needed next instead of tiles that are simply below the screen.
+ * Fed with viewport positions (scroll, fling animation) and fling velocity by PagesView.
+ * Velocities are in document pixels per second, positive values move viewport right or down.
+ */
+public class RenderAheadPredictor {
+
+	/**
+	 * Viewport that didn't move for this long is considered to be at rest.
+	 */
+	public static final long IDLE_MILLIS = 300;
+
+	/**
+	 * Velocity below this is treated as no movement.
+	 */
+	private static final float MIN_VELOCITY = 50f;
+
+	/**
+	 * Viewport moving faster than this many screens per second is moving too fast to be read.
+	 */
+	private static final float FAST_SCREENS_PER_SECOND = 2f;
+
+	/**
+	 * How far into the future we look when moving.
+	 */
+	private static final float LOOKAHEAD_SECONDS = 0.75f;
+
+	/**
+	 * Weight of newest sample in smoothed velocity.
+	 */
+	private static final float SMOOTHING = 0.5f;
+
+	/**
+	 * Position change larger than this many screens at once is a jump, not a scroll.
+	 */
+	private static final int JUMP_SCREENS = 2;
+
+	private float vx = 0;
+	private float vy = 0;
+
+	private int lastLeft = 0;
+	private int lastTop = 0;
+	private long lastMillis = 0;
+	private long lastMoveMillis = 0;
+	private int lastWidth = 0;
+	private int lastHeight = 0;
+
+	/**
+	 * Vertical reading direction, used when viewport is at rest: 1 for down, -1 for up.
+	 */
+	private int readingDirection = 1;
+
+	/**
+	 * Forget everything about movement, for example after zoom or jump to page.
+	 */
+	public synchronized void reset() {
+		this.vx = 0;
+		this.vy = 0;
+		this.lastMillis = 0;
+		this.lastMoveMillis = 0;
+	}
+
+	/**
+	 * Fling started - we know velocity before viewport even moves.
+	 * @param vx horizontal viewport velocity
+	 * @param vy vertical viewport velocity
+	 * @param millis current uptime millis
+	 */
+	public synchronized void onFling(float vx, float vy, long millis) {
+		this.updateVelocity(vx, vy);
+		this.lastMoveMillis = millis;
+	}
+
+	/**
+	 * Viewport is at given position now.
+	 * @param left viewport position over document
+	 * @param top viewport position over document
+	 * @param width viewport width
+	 * @param height viewport height
+	 * @param millis current uptime millis
+	 */
+	public synchronized void onPosition(int left, int top, int width, int height, long millis) {
+		this.lastWidth = width;
+		this.lastHeight = height;
+		if (this.lastMillis == 0) {
+			this.lastLeft = left;
+			this.lastTop = top;
+			this.lastMillis = millis;
+			return;
+		}
+		int dx = left - this.lastLeft;
+		int dy = top - this.lastTop;
+		long dt = millis - this.lastMillis;
+		if (dx == 0 && dy == 0)
+			return;
+		this.lastLeft = left;
+		this.lastTop = top;
+		this.lastMillis = millis;
+		if (Math.abs(dx) > JUMP_SCREENS * width || Math.abs(dy) > JUMP_SCREENS * height) {
+			this.vx = 0;
+			this.vy = 0;
+			return;
+		}
+		if (dt <= 0) dt = 1;
+		this.updateVelocity(dx * 1000f / dt, dy * 1000f / dt);
+		this.lastMoveMillis = millis;
+	}
+
+	/**
+	 * Mix new velocity sample into smoothed velocity.
+	 * When direction changes, old velocity is dropped, so that speculative work
+	 * in old direction is not requested anymore.
+	 */
+	private void updateVelocity(float vx, float vy) {
+		if (this.vx * vx < 0 || this.vy * vy < 0) {
+			this.vx = vx;
+			this.vy = vy;
+		} else {
+			this.vx = SMOOTHING * vx + (1 - SMOOTHING) * this.vx;
+			this.vy = SMOOTHING * vy + (1 - SMOOTHING) * this.vy;
+		}
+		if (Math.abs(this.vy) >= MIN_VELOCITY)
+			this.readingDirection = this.vy > 0 ? 1 : -1;
+	}
+
+	/**
+	 * Check if viewport is moving.
+	 * @param millis current uptime millis
+	 * @return true if viewport moved recently with significant velocity
+	 */
+	public synchronized boolean isMoving(long millis) {
+		return millis - this.lastMoveMillis < IDLE_MILLIS
+			&& (Math.abs(this.vx) >= MIN_VELOCITY || Math.abs(this.vy) >= MIN_VELOCITY);
+	}
+
+	/**
+	 * Check if viewport is moving too fast to be read, like during fling.
+	 * Slow scrolls while reading are not fast.
+	 * @param millis current uptime millis
+	 */
+	public synchronized boolean isFast(long millis) {
+		return this.isMoving(millis) && this.lastHeight > 0
+			&& (Math.abs(this.vx) >= FAST_SCREENS_PER_SECOND * this.lastWidth
+				|| Math.abs(this.vy) >= FAST_SCREENS_PER_SECOND * this.lastHeight);
+	}
+
+	/**
+	 * Check if tiles ahead are before the viewport (above or to the left),
+	 * so they should be rendered in reverse order.
+	 */
+	public synchronized boolean isBackward(long millis) {
+		if (!this.isMoving(millis))
+			return this.readingDirection < 0;
+		if (Math.abs(this.vy) >= Math.abs(this.vx))
+			return this.vy < 0;
+		else
+			return this.vx < 0;
+	}
+
+	/**
+	 * Compute area that should be rendered, in screen coordinates.
+	 * Result contains the screen and extends it in the direction of movement.
+	 * Extra area never exceeds (renderAhead - 1) screens, so cache budget stays the same
+	 * as with fixed render ahead below the screen.
+	 * @param rect output
+	 * @param width screen width
+	 * @param height screen height
+	 * @param renderAhead how many screens worth of tiles may be kept
+	 * @param millis current uptime millis
+	 */
+	public synchronized void getRenderAheadRect(Rect rect, int width, int height, float renderAhead, long millis) {
+		rect.set(0, 0, width, height);
+		float extra = renderAhead - 1f;
+		if (extra <= 0)
+			return;
+		if (!this.isMoving(millis)) {
+			/* at rest: prepare next screen in reading direction */
+			if (this.readingDirection > 0)
+				rect.bottom += (int)(extra * height);
+			else
+				rect.top -= (int)(extra * height);
+			return;
+		}
+		float avx = Math.abs(this.vx);
+		float avy = Math.abs(this.vy);
+		float shareX = avx / (avx + avy);
+		float shareY = avy / (avx + avy);
+		int aheadX = getAhead(extra * shareX * width, avx);
+		int aheadY = getAhead(extra * shareY * height, avy);
+		if (this.vx > 0)
+			rect.right += aheadX;
+		else
+			rect.left -= aheadX;
+		if (this.vy > 0)
+			rect.bottom += aheadY;
+		else
+			rect.top -= aheadY;
+	}
+
+	/**
+	 * Decide how far ahead to render along one axis.
+	 * Fast movement gets whole budget, slow movement at least half of it.
+	 * @param budget max distance in pixels
+	 * @param velocity absolute velocity along this axis
+	 */
+	private static int getAhead(float budget, float velocity) {
+		return (int)Math.min(budget, Math.max(budget / 2, velocity * LOOKAHEAD_SECONDS));
+	}
+}
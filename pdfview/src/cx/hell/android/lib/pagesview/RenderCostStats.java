@@ -0,0 +1,167 @@
+package cx.hell.android.lib.pagesview;
+
+import android.util.Log;
+
+/**
+ * Measured cost of rendering pages, used to choose tile size per page.
+ * Cheap pages (mostly text or mostly empty) get larger tiles, so there's less per-tile overhead;
+ * expensive pages (complex vector graphics) get smaller tiles, so each tile shows up sooner
+ * and rendering can be cancelled at finer granularity when view moves.
+ * Blank tiles count as rendered for free, so sparse pages come out cheap.
+ * Tile size of page follows its measured cost, or document average before page has enough
+ * samples, but only while none of its tiles are cached; then it's frozen, so that cached tiles
+ * stay valid and aren't rendered again in new grid.
+ */
+public class RenderCostStats {
+
+	private final static String TAG = "cx.hell.android.pdfview.stats";
+
+	/**
+	 * Page needs this many rendered tiles before its tile size is decided.
+	 */
+	private static final int MIN_SAMPLES = 3;
+
+	/**
+	 * Tile size is chosen so that rendering tile takes about this long.
+	 */
+	private static final float TARGET_TILE_MILLIS = 120f;
+
+	/**
+	 * Tile pixel count stays within these multiples of default.
+	 */
+	private static final float MIN_FACTOR = 0.5f;
+	private static final float MAX_FACTOR = 2f;
+
+	private int defaultTilePixels;
+
+	private long[] millis;
+	private long[] pixels;
+	private int[] tiles;
+	private int[] blankTiles;
+
+	/**
+	 * Tile size factors last used by pages, 0 if page didn't ask for one yet.
+	 */
+	private float[] factors;
+
+	private long totalMillis = 0;
+	private long totalPixels = 0;
+	private int totalTiles = 0;
+
+	/**
+	 * @param pageCount number of pages in document
+	 * @param defaultTilePixels pixel count of tiles of page with unknown cost
+	 */
+	public RenderCostStats(int pageCount, int defaultTilePixels) {
+		this.defaultTilePixels = defaultTilePixels;
+		this.millis = new long[pageCount];
+		this.pixels = new long[pageCount];
+		this.tiles = new int[pageCount];
+		this.blankTiles = new int[pageCount];
+		this.factors = new float[pageCount];
+	}
+
+	/**
+	 * Record full quality render of tile.
+	 * @param millis cpu time spent rendering
+	 */
+	public synchronized void onTileRendered(int page, int pixels, long millis) {
+		if (page < 0 || page >= this.tiles.length)
+			return;
+		this.millis[page] += millis;
+		this.pixels[page] += pixels;
+		this.tiles[page] += 1;
+		this.totalMillis += millis;
+		this.totalPixels += pixels;
+		this.totalTiles += 1;
+		if (this.totalTiles % 100 == 0)
+			this.logStats();
+	}
+
+	/**
+	 * Record tile that had no content and wasn't rendered.
+	 */
+	public synchronized void onBlankTile(int page, int pixels) {
+		if (page < 0 || page >= this.tiles.length)
+			return;
+		this.blankTiles[page] += 1;
+		this.onTileRendered(page, pixels, 0);
+	}
+
+	/**
+	 * Get render cost of page in milliseconds per megapixel, or -1 if page wasn't rendered yet.
+	 */
+	public synchronized float getPageCost(int page) {
+		if (page < 0 || page >= this.tiles.length || this.pixels[page] == 0)
+			return -1;
+		return this.millis[page] * 1000000f / this.pixels[page];
+	}
+
+	/**
+	 * Get share of tiles of page that were blank, or -1 if page wasn't rendered yet.
+	 */
+	public synchronized float getPageDensity(int page) {
+		if (page < 0 || page >= this.tiles.length || this.tiles[page] == 0)
+			return -1;
+		return 1f - (float)this.blankTiles[page] / this.tiles[page];
+	}
+
+	/**
+	 * Get multiplier of default tile pixel count for page.
+	 * Pages without enough samples use document average, if there's one.
+	 * @param frozen page has tiles cached, so it keeps factor it used last
+	 */
+	public synchronized float getTileSizeFactor(int page, boolean frozen) {
+		if (page < 0 || page >= this.tiles.length)
+			return 1f;
+		if (frozen && this.factors[page] > 0)
+			return this.factors[page];
+		float factor = 1f;
+		if (this.tiles[page] >= MIN_SAMPLES) {
+			float cost = this.getPageCost(page);
+			factor = this.getFactor(cost);
+			if (factor != this.factors[page])
+				Log.d(TAG, "page " + page + ": cost " + cost + " ms/Mpx, density " + this.getPageDensity(page) +
+						", tile size factor " + factor);
+		}
+		else if (this.totalTiles >= MIN_SAMPLES && this.totalPixels > 0) {
+			factor = this.getFactor(this.totalMillis * 1000000f / this.totalPixels);
+		}
+		this.factors[page] = factor;
+		return factor;
+	}
+
+	/**
+	 * Choose power of two factor that brings tile render time closest to target.
+	 */
+	private float getFactor(float cost) {
+		float tileMillis = cost * this.defaultTilePixels / 1000000f;
+		float factor = 1f;
+		if (tileMillis <= 0)
+			return MAX_FACTOR;
+		while (factor < MAX_FACTOR && tileMillis * factor * 2 <= TARGET_TILE_MILLIS)
+			factor *= 2;
+		while (factor > MIN_FACTOR && tileMillis * factor > TARGET_TILE_MILLIS * 2)
+			factor /= 2;
+		return factor;
+	}
+
+	public synchronized void logStats() {
+		int measured = 0;
+		int larger = 0;
+		int smaller = 0;
+		for(int i = 0; i < this.factors.length; ++i) {
+			if (this.factors[i] > 0) {
+				if (this.tiles[i] >= MIN_SAMPLES)
+					measured += 1;
+				if (this.factors[i] > 1f)
+					larger += 1;
+				else if (this.factors[i] < 1f)
+					smaller += 1;
+			}
+		}
+		Log.d(TAG, "tiles: " + this.totalTiles + ", avg cost: " +
+				(this.totalPixels > 0 ? this.totalMillis * 1000000f / this.totalPixels : 0) + " ms/Mpx" +
+				", pages measured: " + measured + ", larger tiles: " + larger + ", smaller tiles: " + smaller);
+	}
+}
@@ -1,5 +1,6 @@
 package cx.hell.android.lib.pagesview;
 
+import android.graphics.RectF;
 
 /**
  * Tile definition.
@@ -34,6 +35,15 @@ public class Tile {
 		this.x = x;
 		this.y = y;
 		this.rotation = rotation;
+		/* tile size is part of the key: page preview starts at 0,0 like regular tiles, but is larger */
+		int h = page;
+		h = 31 * h + zoom;
+		h = 31 * h + x;
+		h = 31 * h + y;
+		h = 31 * h + rotation;
+		h = 31 * h + prefXSize;
+		h = 31 * h + prefYSize;
+		this._hashCode = h;
 	}
 	
 	public String toString() {
@@ -42,7 +52,8 @@ public class Tile {
 			this.zoom + ", " +
 			this.x + ", " +
 			this.y + ", " +
-			this.rotation + ")";
+			this.rotation + ", " +
+			this.prefXSize + "x" + this.prefYSize + ")";
 	}
 	
 	@Override
@@ -61,6 +72,8 @@ public class Tile {
 					&& this.x == t.x
 					&& this.y == t.y
 					&& this.rotation == t.rotation
+					&& this.prefXSize == t.prefXSize
+					&& this.prefYSize == t.prefYSize
 				);
 	}
 	
@@ -91,4 +104,70 @@ public class Tile {
 	public int getPrefYSize() {
 		return this.prefYSize;
 	}
+	
+	/**
+	 * Check if this tile covers (at least partially) the same part of the same page as other tile.
+	 * Tiles may have different zoom levels and rotations, positions are compared at zoom independent
+	 * scale in this tile's rotation.
+	 * @param other other tile
+	 * @param pageWidth width of page at zoom 1000 and rotation 0
+	 * @param pageHeight height of page at zoom 1000 and rotation 0
+	 * @return true if tiles overlap
+	 */
+	public boolean overlaps(Tile other, int pageWidth, int pageHeight) {
+		if (this.page != other.page)
+			return false;
+		RectF o = new RectF();
+		other.getRectInRotation(this.rotation, pageWidth, pageHeight, o);
+		float x0 = (float)this.x / this.zoom;
+		float y0 = (float)this.y / this.zoom;
+		float x1 = (float)(this.x + this.prefXSize) / this.zoom;
+		float y1 = (float)(this.y + this.prefYSize) / this.zoom;
+		float ox0 = o.left / other.zoom;
+		float oy0 = o.top / other.zoom;
+		float ox1 = o.right / other.zoom;
+		float oy1 = o.bottom / other.zoom;
+		return x0 < ox1 && ox0 < x1 && y0 < oy1 && oy0 < y1;
+	}
+	
+	/**
+	 * Get part of page covered by this tile as it would be positioned if page was rotated
+	 * to given rotation, in pixels at this tile's zoom.
+	 * This is the only place that knows how rotation moves tiles: each step of rotation
+	 * turns page 90 degrees counter clockwise, so point (x, y) of w x h page goes to (y, w - x).
+	 * @param rotation target rotation
+	 * @param pageWidth width of page at zoom 1000 and rotation 0
+	 * @param pageHeight height of page at zoom 1000 and rotation 0
+	 * @param out output rect
+	 */
+	public void getRectInRotation(int rotation, int pageWidth, int pageHeight, RectF out) {
+		int r = normalizeRotation(this.rotation);
+		int steps = normalizeRotation(rotation - this.rotation);
+		/* page size in pixels at current step */
+		float w = (r % 2 == 0 ? pageWidth : pageHeight) * this.zoom * 0.001f;
+		float h = (r % 2 == 0 ? pageHeight : pageWidth) * this.zoom * 0.001f;
+		out.set(this.x, this.y, this.x + this.prefXSize, this.y + this.prefYSize);
+		for(int i = 0; i < steps; ++i) {
+			out.set(out.top, w - out.right, out.bottom, w - out.left);
+			float t = w;
+			w = h;
+			h = t;
+		}
+	}
+	
+	/**
+	 * Get angle by which this tile's bitmap has to be turned on screen to show it in given rotation.
+	 * @param rotation target rotation
+	 * @return angle in degrees, clockwise as in Canvas.rotate
+	 */
+	public int getDegreesToRotation(int rotation) {
+		return -90 * normalizeRotation(rotation - this.rotation);
+	}
+	
+	/**
+	 * Rotations are counted modulo 4, but may be negative after rotating left.
+	 */
+	private static int normalizeRotation(int rotation) {
+		return ((rotation % 4) + 4) % 4;
+	}
 }
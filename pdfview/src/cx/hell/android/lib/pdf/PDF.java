@@ -21,6 +21,29 @@ public class PDF {
 	
 	private final static String TAG = "cx.hell.android.pdfview";
 	
+	/**
+	 * Indexes of array returned by getMemoryUsage. Must match MEMORY_* in pdfview2.h.
+	 */
+	public final static int MEMORY_PAGES = 0;
+	public final static int MEMORY_STORE = 1;
+	public final static int MEMORY_GLYPHS = 2;
+	public final static int MEMORY_FONTS = 3;
+	
+	/**
+	 * Indexes of array returned by getGlyphCacheStats. Must match GLYPH_CACHE_* in pdfview2.h.
+	 */
+	public final static int GLYPH_CACHE_HITS = 0;
+	public final static int GLYPH_CACHE_MISSES = 1;
+	
+	/**
+	 * Levels of trimMemory. Must match TRIM_* in pdfview2.h.
+	 * Each level frees also everything freed by lower levels.
+	 */
+	public final static int TRIM_OLD = 0;
+	public final static int TRIM_GLYPHS = 1;
+	public final static int TRIM_STORE = 2;
+	public final static int TRIM_PAGES = 3;
+	
 	static {
         System.loadLibrary("pdfview2");
 	}
@@ -186,6 +209,16 @@ public class PDF {
 		return invalid_password != 0;
 	}
 
+	/**
+	 * Set where CJK pack (CJK CMaps and font) is. It's mapped only when a document needs it.
+	 * Native code guards the pack with its own lock, so this may be called from any thread,
+	 * also while documents are open.
+	 * @param path file containing the pack, may be an apk
+	 * @param offset offset of the pack in the file
+	 * @param length length of the pack
+	 */
+	synchronized public static native void setCJKPack(String path, int offset, int length);
+	
 	/**
 	 * Parse bytes as PDF file and store resulting pdf_t struct in pdf_ptr.
 	 * @return error code
@@ -239,11 +272,13 @@ public class PDF {
 	 * @param zoom page size scaling
 	 * @param left left edge
 	 * @param right right edge
+	 * @param draft render faster at lower quality: less anti-aliasing, no shadings
+	 * @param reuse array returned by previous call, reused if it's large enough; may be null
 	 * @param passes requested size, used for size of resulting bitmap
 	 * @return bytes of bitmap in Androids format
 	 */
 	synchronized public native int[] renderPage(int n, int zoom, int left, int top, 
-			int rotation, boolean gray, boolean skipImages, PDF.Size rect);
+			int rotation, boolean gray, boolean skipImages, boolean draft, int[] reuse, PDF.Size rect);
 	
 	/**
 	 * Get PDF page size, store it in size struct, return error code.
@@ -253,6 +288,38 @@ public class PDF {
 	 */
 	synchronized public native int getPageSize(int n, PDF.Size size);
 	
+	/**
+	 * Load page and its fonts and images into native caches without rendering it.
+	 * @param n 0-based page number
+	 * @return error code
+	 */
+	synchronized public native int prefetchPage(int n);
+	
+	/**
+	 * Get estimated memory held by native caches.
+	 * @return byte counts indexed by MEMORY_* constants, null on error
+	 */
+	synchronized public native int[] getMemoryUsage();
+	
+	/**
+	 * Free native caches that can be rebuilt.
+	 * @param level one of TRIM_* constants
+	 */
+	synchronized public native void trimMemory(int level);
+	
+	/**
+	 * Get number of glyphs found in native glyph cache and number of glyphs rendered.
+	 * @return counts indexed by GLYPH_CACHE_* constants, null on error
+	 */
+	synchronized public native int[] getGlyphCacheStats();
+	
+	/**
+	 * Set how many bytes of rendered glyphs native glyph cache may keep.
+	 * Least recently used glyphs are dropped when it's full.
+	 * @param budget size in bytes, 0 for default
+	 */
+	synchronized public native void setGlyphCacheBudget(int budget);
+	
 	/**
 	 * Export PDF to a text file.
 	 */
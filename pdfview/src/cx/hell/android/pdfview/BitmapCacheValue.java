@@ -7,6 +7,10 @@ public class BitmapCacheValue {
 	/* public long millisAdded; */
 	public long millisAccessed;
 	public long priority;
+	/* bitmap was rendered in draft quality and should be rendered again once view is at rest */
+	public boolean draft;
+	/* bitmap is shared blank sentinel, it must not be recycled or reused */
+	public boolean blank;
 	
 	public BitmapCacheValue(Bitmap bitmap, long millisAdded, long priority) {
 		this.bitmap = bitmap;
@@ -0,0 +1,90 @@
+package cx.hell.android.pdfview;
+
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+
+import android.content.Context;
+import android.content.res.AssetFileDescriptor;
+import android.util.Log;
+import cx.hell.android.lib.pdf.PDF;
+
+/**
+ * Tells native code where CJK pack is. It's a file with CJK CMaps and font built
+ * by scripts/cjkpack.c and shipped as asset, which native code maps only when
+ * a document needs it.
+ * Asset is named .jet, one of extensions aapt stores uncompressed, so it's
+ * mapped straight from apk. If it's compressed anyway, it's copied to files dir
+ * once, in background, and documents opened before that's done are rendered
+ * without CJK support.
+ */
+public class CJKPack {
+
+	private final static String TAG = "cx.hell.android.pdfview";
+	
+	private final static String ASSET_NAME = "cjk.pack.jet";
+	
+	private static boolean initialized = false;
+	
+	public static synchronized void init(Context context) {
+		if (initialized)
+			return;
+		initialized = true;
+		
+		String apkPath = context.getApplicationInfo().sourceDir;
+		try {
+			AssetFileDescriptor afd = context.getAssets().openFd(ASSET_NAME);
+			PDF.setCJKPack(apkPath, (int)afd.getStartOffset(), (int)afd.getLength());
+			afd.close();
+			return;
+		} catch (IOException e) {
+			/* asset is compressed (or missing) */
+		}
+		
+		final File file = new File(context.getFilesDir(), ASSET_NAME);
+		if (file.exists() && file.lastModified() >= new File(apkPath).lastModified()) {
+			PDF.setCJKPack(file.getAbsolutePath(), 0, (int)file.length());
+			return;
+		}
+		
+		final Context appContext = context.getApplicationContext();
+		new Thread(new Runnable() {
+			public void run() {
+				copyAsset(appContext, file);
+			}
+		}).start();
+	}
+	
+	private static void copyAsset(Context context, File file) {
+		File tmp = new File(file.getPath() + ".tmp");
+		InputStream in = null;
+		OutputStream out = null;
+		try {
+			in = context.getAssets().open(ASSET_NAME);
+			out = new FileOutputStream(tmp);
+			byte[] buf = new byte[64*1024];
+			int n;
+			while ((n = in.read(buf)) > 0)
+				out.write(buf, 0, n);
+			out.close();
+			out = null;
+			if (!tmp.renameTo(file))
+				throw new IOException("cannot rename " + tmp);
+			Log.i(TAG, "CJK pack copied to " + file);
+			PDF.setCJKPack(file.getAbsolutePath(), 0, (int)file.length());
+		} catch (IOException e) {
+			Log.w(TAG, "CJK pack is not available: " + e);
+			tmp.delete();
+		} finally {
+			try {
+				if (in != null)
+					in.close();
+				if (out != null)
+					out.close();
+			} catch (IOException e) {
+			}
+		}
+	}
+}
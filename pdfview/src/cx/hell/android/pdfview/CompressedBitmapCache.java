@@ -0,0 +1,318 @@
+package cx.hell.android.pdfview;
+
+import java.nio.ByteBuffer;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.Map;
+
+import android.graphics.Bitmap;
+import android.util.Log;
+import cx.hell.android.lib.pagesview.Tile;
+
+/**
+ * Second tier of bitmap cache.
+ * Tiles evicted from bitmap cache are kept here run-length encoded. Document tiles are
+ * mostly runs of background color, so they take a fraction of bitmap size, and decoding
+ * tile is much faster than rendering it again.
+ * Oldest tiles are dropped when cache grows beyond its max size.
+ * Pixels are copied through scratch buffers kept by cache, so put and take
+ * don't allocate tile-sized arrays apart from compressed data.
+ */
+public class CompressedBitmapCache {
+
+	/**
+	 * Longest run or literal sequence that fits in one header.
+	 */
+	private static final int MAX_RUN = Short.MAX_VALUE;
+
+	/**
+	 * Shorter runs of equal values are stored as literals.
+	 */
+	private static final int MIN_RUN = 3;
+
+	private static class CompressedBitmap {
+		int width;
+		int height;
+		Bitmap.Config config;
+		/**
+		 * Size of pixel buffer in bytes, as used by copyPixelsToBuffer.
+		 */
+		int rawSize;
+		short[] data;
+	}
+
+	/**
+	 * Compressed tiles in access order, oldest first.
+	 */
+	private LinkedHashMap<Tile, CompressedBitmap> bitmaps = new LinkedHashMap<Tile, CompressedBitmap>(16, 0.75f, true);
+
+	private int maxSizeBytes = 0;
+	private int sizeBytes = 0;
+	private long rawSizeBytes = 0;
+
+	/**
+	 * Scratch buffers of put and take, guarded by scratchLock.
+	 * They grow to the largest tile seen and are kept until cache is cleared or trimmed.
+	 */
+	private final Object scratchLock = new Object();
+	private ByteBuffer scratchBuffer = null;
+	private short[] scratchPixels = null;
+	private short[] scratchData = null;
+	
+	/**
+	 * Bytes held by scratch buffers, counted in getSizeBytes.
+	 */
+	private volatile int scratchBytes = 0;
+
+	/**
+	 * Stats logging.
+	 */
+	private long hits = 0;
+	private long misses = 0;
+	private long rejected = 0;
+
+	public synchronized void setMaxSizeBytes(int maxSizeBytes) {
+		this.maxSizeBytes = maxSizeBytes;
+		this.removeOldest(0);
+	}
+
+	/**
+	 * Get estimated bytes used by compressed tiles and scratch buffers.
+	 */
+	public synchronized int getSizeBytes() {
+		return this.sizeBytes + this.scratchBytes;
+	}
+
+	/**
+	 * Compress and store bitmap evicted from bitmap cache.
+	 * Bitmaps that don't compress are not stored.
+	 * Bitmap is not modified and may be reused by caller.
+	 */
+	public void put(Tile tile, Bitmap bitmap) {
+		if (this.maxSizeBytes <= 0)
+			return;
+		int rawSize = bitmap.getRowBytes() * bitmap.getHeight();
+		int n = (rawSize + rawSize % 2) / 2;
+		short[] data = null;
+		synchronized(this.scratchLock) {
+			ByteBuffer buffer = this.getScratchBuffer(n * 2);
+			bitmap.copyPixelsToBuffer(buffer);
+			buffer.rewind();
+			short[] pixels = this.getScratchPixels(n);
+			buffer.asShortBuffer().get(pixels, 0, n);
+			int length = encode(pixels, n, this.scratchData);
+			if (length >= 0) {
+				data = new short[length];
+				System.arraycopy(this.scratchData, 0, data, 0, length);
+			}
+		}
+		synchronized(this) {
+			if (data == null) {
+				this.rejected += 1;
+				return;
+			}
+			CompressedBitmap c = new CompressedBitmap();
+			c.width = bitmap.getWidth();
+			c.height = bitmap.getHeight();
+			c.config = bitmap.getConfig();
+			c.rawSize = rawSize;
+			c.data = data;
+			this.remove(tile);
+			this.removeOldest(data.length * 2);
+			this.bitmaps.put(tile, c);
+			this.sizeBytes += data.length * 2;
+			this.rawSizeBytes += rawSize;
+		}
+	}
+
+	/**
+	 * Check if cache contains any tile of page.
+	 */
+	public synchronized boolean hasPage(int page) {
+		for(Tile tile: this.bitmaps.keySet()) {
+			if (tile.getPage() == page)
+				return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Take tile out of cache, decoding it into bitmap from pool.
+	 * @return decoded bitmap or null if tile is not in cache
+	 */
+	public Bitmap take(Tile tile, PDFPagesProvider.BitmapPool pool) {
+		CompressedBitmap c;
+		synchronized(this) {
+			c = this.remove(tile);
+			if (c == null)
+				this.misses += 1;
+			else
+				this.hits += 1;
+			if ((this.hits + this.misses) % 100 == 0) {
+				Log.d("cx.hell.android.pdfview.pagecache", "compressed hits: " + hits + ", misses: " + misses +
+						", hit ratio: " + (float)(hits) / (float)(hits+misses) +
+						", compression ratio: " + (this.sizeBytes > 0 ? (float)this.rawSizeBytes / this.sizeBytes : 0) +
+						", rejected: " + rejected + ", size: " + this.bitmaps.size());
+			}
+		}
+		if (c == null)
+			return null;
+
+		int n = (c.rawSize + c.rawSize % 2) / 2;
+		Bitmap b = pool.get(c.width, c.height, c.config);
+		synchronized(this.scratchLock) {
+			short[] pixels = this.getScratchPixels(n);
+			decode(c.data, pixels);
+			ByteBuffer buffer = this.getScratchBuffer(n * 2);
+			buffer.asShortBuffer().put(pixels, 0, n);
+			buffer.rewind();
+			b.copyPixelsFromBuffer(buffer);
+		}
+		return b;
+	}
+
+	public void clear() {
+		synchronized(this) {
+			this.bitmaps.clear();
+			this.sizeBytes = 0;
+			this.rawSizeBytes = 0;
+		}
+		this.releaseScratch();
+	}
+
+	/**
+	 * Free scratch buffers, they are allocated again by next put or take.
+	 */
+	public void releaseScratch() {
+		synchronized(this.scratchLock) {
+			this.scratchBuffer = null;
+			this.scratchPixels = null;
+			this.scratchData = null;
+			this.scratchBytes = 0;
+		}
+	}
+
+	private void updateScratchBytes() {
+		this.scratchBytes = (this.scratchBuffer != null ? this.scratchBuffer.capacity() : 0) +
+				(this.scratchPixels != null ? this.scratchPixels.length * 4 : 0);
+	}
+
+	/**
+	 * Get scratch byte buffer with position 0 and limit of given size.
+	 * Must be called with scratchLock held.
+	 */
+	private ByteBuffer getScratchBuffer(int size) {
+		if (this.scratchBuffer == null || this.scratchBuffer.capacity() < size) {
+			this.scratchBuffer = ByteBuffer.allocate(size);
+			this.updateScratchBytes();
+		}
+		this.scratchBuffer.clear();
+		this.scratchBuffer.limit(size);
+		return this.scratchBuffer;
+	}
+
+	/**
+	 * Get scratch pixel array of at least given size, and encode output array of the same size.
+	 * Must be called with scratchLock held.
+	 */
+	private short[] getScratchPixels(int size) {
+		if (this.scratchPixels == null || this.scratchPixels.length < size) {
+			this.scratchPixels = new short[size];
+			this.scratchData = new short[size];
+			this.updateScratchBytes();
+		}
+		return this.scratchPixels;
+	}
+
+	private CompressedBitmap remove(Tile tile) {
+		CompressedBitmap c = this.bitmaps.remove(tile);
+		if (c != null) {
+			this.sizeBytes -= c.data.length * 2;
+			this.rawSizeBytes -= c.rawSize;
+		}
+		return c;
+	}
+
+	/**
+	 * Drop oldest tiles until there's room for extra bytes.
+	 */
+	private void removeOldest(int extra) {
+		Iterator<Map.Entry<Tile, CompressedBitmap>> i = this.bitmaps.entrySet().iterator();
+		while (i.hasNext() && this.sizeBytes + extra > this.maxSizeBytes) {
+			CompressedBitmap c = i.next().getValue();
+			this.sizeBytes -= c.data.length * 2;
+			this.rawSizeBytes -= c.rawSize;
+			i.remove();
+		}
+	}
+
+	/**
+	 * Run-length encode pixels.
+	 * Each sequence starts with header: negative -n means next value repeated n times,
+	 * positive n means n literal values follow.
+	 * @param in input pixels
+	 * @param n number of input pixels
+	 * @param out encoded data, at least n long
+	 * @return length of encoded data or -1 if it wouldn't be smaller than input
+	 */
+	static int encode(short[] in, int n, short[] out) {
+		int i = 0;
+		int o = 0;
+		while (i < n) {
+			int run = 1;
+			while (i + run < n && run < MAX_RUN && in[i + run] == in[i])
+				run++;
+			if (run >= MIN_RUN) {
+				if (o + 2 >= n)
+					return -1;
+				out[o++] = (short)-run;
+				out[o++] = in[i];
+				i += run;
+			}
+			else {
+				int start = i;
+				int len = 0;
+				while (i < n && len < MAX_RUN) {
+					if (i + 2 < n && in[i] == in[i + 1] && in[i] == in[i + 2])
+						break;
+					i++;
+					len++;
+				}
+				if (o + 1 + len >= n)
+					return -1;
+				out[o++] = (short)len;
+				System.arraycopy(in, start, out, o, len);
+				o += len;
+			}
+		}
+		return o;
+	}
+
+	/**
+	 * Decode data produced by encode.
+	 */
+	static void decode(short[] in, short[] out) {
+		decode(in, in.length, out);
+	}
+
+	/**
+	 * Decode first n shorts of data produced by encode.
+	 */
+	static void decode(short[] in, int n, short[] out) {
+		int i = 0;
+		int o = 0;
+		while (i < n) {
+			int h = in[i++];
+			if (h < 0) {
+				short v = in[i++];
+				for(int end = o - h; o < end; ++o)
+					out[o] = v;
+			}
+			else {
+				System.arraycopy(in, i, out, o, h);
+				i += h;
+				o += h;
+			}
+		}
+	}
+}
@@ -0,0 +1,522 @@
+package cx.hell.android.pdfview;
+
+import java.io.BufferedInputStream;
+import java.io.BufferedOutputStream;
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.File;
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.FileChannel;
+import java.util.LinkedList;
+
+import android.graphics.Bitmap;
+import android.util.Log;
+
+/**
+ * Rendered tiles stored on disk, so they survive closing document and activity restarts.
+ * Tiles are run-length encoded, one file per tile. Index of all tiles is a hash table
+ * in memory-mapped file, with size and last access time of each tile; when cache grows
+ * beyond MAX_SIZE_BYTES, least recently used tiles are deleted.
+ * There's one instance per process, shared by all documents; keys should identify
+ * both document and tile.
+ * Tiles are encoded and written by background writer thread, so renderer doesn't wait for disk,
+ * and read and decoded outside cache lock, so lookups don't wait for each other or for writer.
+ * Index header holds format and render version; when either changes, all tiles are deleted,
+ * so tiles rendered by older code are not shown. Tile files missing from index, left by
+ * process killed before index was updated, are deleted when cache is opened.
+ */
+public class DiskTileCache {
+
+	private final static String TAG = "cx.hell.android.pdfview";
+
+	/**
+	 * Tile files take at most this much space.
+	 */
+	private static final int MAX_SIZE_BYTES = 32*1024*1024;
+
+	/**
+	 * Number of index slots. At most half of them hold tiles, and index is rebuilt
+	 * when more than 3/4 of them are used by tiles and deleted entries.
+	 */
+	private static final int SLOTS = 2048;
+
+	/**
+	 * Slot layout: long key, int size, int unused, long last access millis.
+	 */
+	private static final int SLOT_SIZE = 24;
+
+	private static final long EMPTY = 0;
+	private static final long DELETED = -1;
+
+	private static final int MAGIC = 0x41505654; /* "APVT" */
+
+	/**
+	 * Version of tile file and index layout.
+	 */
+	private static final int FORMAT_VERSION = 1;
+
+	/**
+	 * Index header: int magic, int format version, int render version, int unused.
+	 */
+	private static final int HEADER_SIZE = 16;
+
+	private static final String INDEX_NAME = "index";
+
+	/**
+	 * At most this many tiles wait to be written; tiles put while queue is full are not stored.
+	 */
+	private static final int MAX_PENDING_WRITES = 8;
+
+	/**
+	 * Tile pixels copied by put, waiting for writer thread.
+	 */
+	private static class PendingWrite {
+		String key;
+		long hash;
+		int width;
+		int height;
+		Bitmap.Config config;
+		int rawSize;
+		ByteBuffer pixels;
+	}
+
+	private static DiskTileCache instance = null;
+
+	private File dir;
+	private MappedByteBuffer index;
+	private int sizeBytes = 0;
+	private int usedSlots = 0;
+	private int liveSlots = 0;
+
+	private LinkedList<PendingWrite> pendingWrites = new LinkedList<PendingWrite>();
+
+	/**
+	 * Scratch buffers of get, guarded by scratchLock.
+	 * They grow to the largest tile read and are kept for next reads.
+	 */
+	private final Object scratchLock = new Object();
+	private byte[] scratchBytes = null;
+	private short[] scratchData = null;
+	private short[] scratchPixels = null;
+	private ByteBuffer scratchBuffer = null;
+
+	/**
+	 * Writer thread, null if there's none.
+	 */
+	private Thread writerThread = null;
+
+	/**
+	 * Get cache stored in given directory.
+	 * @param renderVersion version of rendering code, such as app version code; tiles stored
+	 * with different version are deleted
+	 * @return cache or null if it can't be opened
+	 */
+	public static synchronized DiskTileCache open(File dir, int renderVersion) {
+		if (instance != null)
+			return instance;
+		try {
+			instance = new DiskTileCache(dir, renderVersion);
+		} catch (IOException e) {
+			Log.e(TAG, "failed to open tile cache in " + dir + ": " + e);
+		}
+		return instance;
+	}
+
+	private DiskTileCache(File dir, int renderVersion) throws IOException {
+		this.dir = dir;
+		if (!dir.isDirectory() && !dir.mkdirs())
+			throw new IOException("can't create " + dir);
+		RandomAccessFile f = new RandomAccessFile(new File(dir, INDEX_NAME), "rw");
+		try {
+			this.index = f.getChannel().map(FileChannel.MapMode.READ_WRITE, 0, HEADER_SIZE + SLOTS * SLOT_SIZE);
+		} finally {
+			f.close();
+		}
+		if (this.index.getInt(0) != MAGIC || this.index.getInt(4) != FORMAT_VERSION ||
+				this.index.getInt(8) != renderVersion) {
+			Log.i(TAG, "tile cache version changed, deleting all tiles");
+			this.index.position(0);
+			this.index.put(new byte[HEADER_SIZE + SLOTS * SLOT_SIZE]);
+			this.index.putInt(0, MAGIC);
+			this.index.putInt(4, FORMAT_VERSION);
+			this.index.putInt(8, renderVersion);
+		}
+		for(int slot = 0; slot < SLOTS; ++slot) {
+			long key = this.index.getLong(HEADER_SIZE + slot * SLOT_SIZE);
+			if (key != EMPTY) {
+				this.usedSlots += 1;
+				if (key != DELETED) {
+					this.liveSlots += 1;
+					this.sizeBytes += this.index.getInt(HEADER_SIZE + slot * SLOT_SIZE + 8);
+				}
+			}
+		}
+		this.sweep();
+		Log.d(TAG, "tile cache: " + this.liveSlots + " tiles, " + this.sizeBytes + " bytes");
+	}
+
+	/**
+	 * Delete tile files that are not in index and drop index entries whose files are gone.
+	 */
+	private void sweep() {
+		String[] names = this.dir.list();
+		if (names == null)
+			return;
+		for(String name: names) {
+			if (name.equals(INDEX_NAME))
+				continue;
+			boolean known = false;
+			try {
+				known = this.findSlot(parseHash(name)) >= 0;
+			} catch (NumberFormatException e) {
+			}
+			if (!known && new File(this.dir, name).delete())
+				Log.d(TAG, "deleted stale cached tile " + name);
+		}
+		for(int slot = 0; slot < SLOTS; ++slot) {
+			long key = this.index.getLong(HEADER_SIZE + slot * SLOT_SIZE);
+			if (key != EMPTY && key != DELETED && !this.getFile(key).exists())
+				this.remove(slot);
+		}
+	}
+
+	/**
+	 * Parse tile file name written by getFile.
+	 */
+	private static long parseHash(String name) {
+		if (name.length() == 0 || name.length() > 16)
+			throw new NumberFormatException(name);
+		long h = 0;
+		for(int i = 0; i < name.length(); ++i) {
+			int d = Character.digit(name.charAt(i), 16);
+			if (d < 0)
+				throw new NumberFormatException(name);
+			h = (h << 4) | d;
+		}
+		return h;
+	}
+
+	/**
+	 * 64-bit FNV-1a hash of key, never EMPTY or DELETED.
+	 */
+	private static long hash(String key) {
+		long h = 0xcbf29ce484222325L;
+		for(int i = 0; i < key.length(); ++i) {
+			h ^= key.charAt(i);
+			h *= 0x100000001b3L;
+		}
+		if (h == EMPTY || h == DELETED)
+			h = 1;
+		return h;
+	}
+
+	/**
+	 * Find slot holding hash, or -1.
+	 */
+	private int findSlot(long h) {
+		int start = (int)((h & 0x7fffffffffffffffL) % SLOTS);
+		for(int i = 0; i < SLOTS; ++i) {
+			int slot = (start + i) % SLOTS;
+			long key = this.index.getLong(HEADER_SIZE + slot * SLOT_SIZE);
+			if (key == h)
+				return slot;
+			if (key == EMPTY)
+				return -1;
+		}
+		return -1;
+	}
+
+	/**
+	 * Find slot for new hash, reusing deleted slots.
+	 */
+	private int findFreeSlot(long h) {
+		int start = (int)((h & 0x7fffffffffffffffL) % SLOTS);
+		for(int i = 0; i < SLOTS; ++i) {
+			int slot = (start + i) % SLOTS;
+			long key = this.index.getLong(HEADER_SIZE + slot * SLOT_SIZE);
+			if (key == EMPTY || key == DELETED)
+				return slot;
+		}
+		return -1;
+	}
+
+	private File getFile(long h) {
+		return new File(this.dir, Long.toHexString(h));
+	}
+
+	/**
+	 * Load tile stored under given key into bitmap from pool.
+	 * File is read and decoded without cache lock held, through scratch buffers of cache.
+	 * @return bitmap or null if tile is not cached
+	 */
+	public Bitmap get(String key, PDFPagesProvider.BitmapPool pool) {
+		long h = hash(key);
+		synchronized(this) {
+			if (this.findSlot(h) < 0)
+				return null;
+		}
+
+		File file = this.getFile(h);
+		DataInputStream in = null;
+		Bitmap b = null;
+		try {
+			in = new DataInputStream(new BufferedInputStream(new FileInputStream(file), 8192));
+			if (in.readInt() != MAGIC || !key.equals(in.readUTF()))
+				return null;
+			int width = in.readInt();
+			int height = in.readInt();
+			Bitmap.Config config = Bitmap.Config.valueOf(in.readUTF());
+			int rawSize = in.readInt();
+			int length = in.readInt();
+			int n = (rawSize + rawSize % 2) / 2;
+			if (length < 0 || length > n)
+				throw new IOException("bad length " + length);
+
+			synchronized(this.scratchLock) {
+				this.ensureScratch(n);
+				in.readFully(this.scratchBytes, 0, length * 2);
+				ByteBuffer.wrap(this.scratchBytes, 0, length * 2).asShortBuffer().get(this.scratchData, 0, length);
+				CompressedBitmapCache.decode(this.scratchData, length, this.scratchPixels);
+				this.scratchBuffer.clear();
+				this.scratchBuffer.limit(n * 2);
+				this.scratchBuffer.asShortBuffer().put(this.scratchPixels, 0, n);
+				b = pool.get(width, height, config);
+				b.copyPixelsFromBuffer(this.scratchBuffer);
+			}
+		} catch (Exception e) {
+			Log.w(TAG, "failed to read cached tile " + file + ": " + e);
+			synchronized(this) {
+				int slot = this.findSlot(h);
+				if (slot >= 0)
+					this.remove(slot);
+			}
+			return null;
+		} finally {
+			if (in != null) {
+				try {
+					in.close();
+				} catch (IOException e) {
+				}
+			}
+		}
+
+		synchronized(this) {
+			int slot = this.findSlot(h);
+			if (slot >= 0)
+				this.index.putLong(HEADER_SIZE + slot * SLOT_SIZE + 16, System.currentTimeMillis());
+		}
+		return b;
+	}
+
+	/**
+	 * Make scratch buffers big enough for tile of n pixel shorts.
+	 * Must be called with scratchLock held.
+	 */
+	private void ensureScratch(int n) {
+		if (this.scratchPixels == null || this.scratchPixels.length < n) {
+			this.scratchBytes = new byte[n * 2];
+			this.scratchData = new short[n];
+			this.scratchPixels = new short[n];
+			this.scratchBuffer = ByteBuffer.allocate(n * 2);
+		}
+	}
+
+	/**
+	 * Store tile under given key. Tiles that don't compress are not stored.
+	 * Pixels are copied, so bitmap may be reused by caller; they are encoded
+	 * and written to disk later by writer thread.
+	 */
+	public void put(String key, Bitmap bitmap) {
+		long h = hash(key);
+		synchronized(this) {
+			if (this.findSlot(h) >= 0 || this.isPending(h) || this.pendingWrites.size() >= MAX_PENDING_WRITES)
+				return;
+		}
+
+		PendingWrite w = new PendingWrite();
+		w.key = key;
+		w.hash = h;
+		w.width = bitmap.getWidth();
+		w.height = bitmap.getHeight();
+		w.config = bitmap.getConfig();
+		w.rawSize = bitmap.getRowBytes() * bitmap.getHeight();
+		w.pixels = ByteBuffer.allocate(w.rawSize + w.rawSize % 2);
+		bitmap.copyPixelsToBuffer(w.pixels);
+		w.pixels.rewind();
+
+		synchronized(this) {
+			this.pendingWrites.add(w);
+			if (this.writerThread == null) {
+				Thread t = new Thread(new Runnable() {
+					public void run() {
+						writePending();
+					}
+				});
+				t.setPriority(Thread.MIN_PRIORITY);
+				t.setName("DiskTileCacheWriterThread");
+				this.writerThread = t;
+				t.start();
+			}
+		}
+	}
+
+	/**
+	 * Check if tile with given hash waits to be written.
+	 */
+	private boolean isPending(long h) {
+		for(PendingWrite w: this.pendingWrites) {
+			if (w.hash == h)
+				return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Writer thread's main routine: write pending tiles until there are none.
+	 * Tile stays in pending list until it's in index, so put doesn't queue it again.
+	 */
+	private void writePending() {
+		while(true) {
+			PendingWrite w;
+			synchronized(this) {
+				if (this.pendingWrites.isEmpty()) {
+					this.writerThread = null;
+					return;
+				}
+				w = this.pendingWrites.getFirst();
+			}
+			this.write(w);
+			synchronized(this) {
+				this.pendingWrites.removeFirst();
+			}
+		}
+	}
+
+	/**
+	 * Encode tile and write it to its file, then add it to index.
+	 * Called by writer thread; cache lock is held only while index is updated.
+	 */
+	private void write(PendingWrite w) {
+		short[] pixels = new short[w.pixels.capacity() / 2];
+		w.pixels.asShortBuffer().get(pixels);
+		w.pixels = null;
+		short[] data = new short[pixels.length];
+		int length = CompressedBitmapCache.encode(pixels, pixels.length, data);
+		if (length < 0)
+			return;
+		byte[] bytes = new byte[length * 2];
+		ByteBuffer.wrap(bytes).asShortBuffer().put(data, 0, length);
+
+		File file = this.getFile(w.hash);
+		DataOutputStream out = null;
+		try {
+			out = new DataOutputStream(new BufferedOutputStream(new FileOutputStream(file), 8192));
+			out.writeInt(MAGIC);
+			out.writeUTF(w.key);
+			out.writeInt(w.width);
+			out.writeInt(w.height);
+			out.writeUTF(w.config.name());
+			out.writeInt(w.rawSize);
+			out.writeInt(length);
+			out.write(bytes);
+			out.close();
+			out = null;
+		} catch (IOException e) {
+			Log.w(TAG, "failed to write cached tile " + file + ": " + e);
+			file.delete();
+			return;
+		} finally {
+			if (out != null) {
+				try {
+					out.close();
+				} catch (IOException e) {
+				}
+				file.delete();
+			}
+		}
+
+		synchronized(this) {
+			int size = (int)file.length();
+			while (this.sizeBytes + size > MAX_SIZE_BYTES || this.liveSlots >= SLOTS / 2) {
+				if (!this.removeOldest()) {
+					file.delete();
+					return;
+				}
+			}
+			if (this.usedSlots >= SLOTS * 3 / 4)
+				this.rebuildIndex();
+
+			int slot = this.findFreeSlot(w.hash);
+			if (this.index.getLong(HEADER_SIZE + slot * SLOT_SIZE) == EMPTY)
+				this.usedSlots += 1;
+			this.liveSlots += 1;
+			this.index.putLong(HEADER_SIZE + slot * SLOT_SIZE, w.hash);
+			this.index.putInt(HEADER_SIZE + slot * SLOT_SIZE + 8, size);
+			this.index.putLong(HEADER_SIZE + slot * SLOT_SIZE + 16, System.currentTimeMillis());
+			this.sizeBytes += size;
+		}
+	}
+
+	/**
+	 * Delete tile in slot. Slot is marked as deleted, so lookups of other keys can go past it.
+	 */
+	private void remove(int slot) {
+		long h = this.index.getLong(HEADER_SIZE + slot * SLOT_SIZE);
+		this.getFile(h).delete();
+		this.sizeBytes -= this.index.getInt(HEADER_SIZE + slot * SLOT_SIZE + 8);
+		this.index.putLong(HEADER_SIZE + slot * SLOT_SIZE, DELETED);
+		this.index.putInt(HEADER_SIZE + slot * SLOT_SIZE + 8, 0);
+		this.liveSlots -= 1;
+	}
+
+	/**
+	 * Delete least recently used tile.
+	 * @return false if there's nothing to delete
+	 */
+	private boolean removeOldest() {
+		int oldest = -1;
+		long oldestMillis = 0;
+		for(int slot = 0; slot < SLOTS; ++slot) {
+			long key = this.index.getLong(HEADER_SIZE + slot * SLOT_SIZE);
+			if (key == EMPTY || key == DELETED)
+				continue;
+			long millis = this.index.getLong(HEADER_SIZE + slot * SLOT_SIZE + 16);
+			if (oldest < 0 || millis < oldestMillis) {
+				oldest = slot;
+				oldestMillis = millis;
+			}
+		}
+		if (oldest < 0)
+			return false;
+		this.remove(oldest);
+		return true;
+	}
+
+	/**
+	 * Drop deleted slots by inserting all live entries again.
+	 */
+	private void rebuildIndex() {
+		byte[] old = new byte[SLOTS * SLOT_SIZE];
+		this.index.position(HEADER_SIZE);
+		this.index.get(old);
+		ByteBuffer entries = ByteBuffer.wrap(old);
+		this.index.position(HEADER_SIZE);
+		this.index.put(new byte[SLOTS * SLOT_SIZE]);
+		this.usedSlots = 0;
+		for(int slot = 0; slot < SLOTS; ++slot) {
+			long key = entries.getLong(slot * SLOT_SIZE);
+			if (key == EMPTY || key == DELETED)
+				continue;
+			int newSlot = this.findFreeSlot(key);
+			this.index.putLong(HEADER_SIZE + newSlot * SLOT_SIZE, key);
+			this.index.putInt(HEADER_SIZE + newSlot * SLOT_SIZE + 8, entries.getInt(slot * SLOT_SIZE + 8));
+			this.index.putLong(HEADER_SIZE + newSlot * SLOT_SIZE + 16, entries.getLong(slot * SLOT_SIZE + 16));
+			this.usedSlots += 1;
+		}
+	}
+}
@@ -15,6 +15,7 @@ import android.content.DialogInterface;
 import android.content.Intent;
 import android.content.SharedPreferences;
 import android.content.pm.ActivityInfo;
+import android.content.pm.PackageManager;
 import android.content.res.Configuration;
 import android.graphics.Color;
 import android.hardware.Sensor;
@@ -335,6 +336,22 @@ public class OpenFileActivity extends Activity implements SensorEventListener {
 		}		
 	}
 	
+	@Override
+	public void onLowMemory() {
+		super.onLowMemory();
+		
+		if (this.pdfPagesProvider != null)
+			this.pdfPagesProvider.trimMemory(PDFPagesProvider.TRIM_MEMORY_COMPLETE);
+	}
+	
+	/**
+	 * Called by Android 4.0 and later, no @Override since we build against older SDK.
+	 */
+	public void onTrimMemory(int level) {
+		if (this.pdfPagesProvider != null)
+			this.pdfPagesProvider.trimMemory(level);
+	}
+	
 	@Override
 	protected void onResume() {
 		super.onResume();
@@ -402,6 +419,7 @@ public class OpenFileActivity extends Activity implements SensorEventListener {
         this.pageNumberTextView.setTextColor(Options.getForeColor(colorMode));
         this.pdfPagesProvider.setGray(Options.isGray(this.colorMode));
         this.pdfPagesProvider.setExtraCache(1024*1024*Options.getIntFromString(options, Options.PREF_EXTRA_CACHE, 0));
+        this.pdfPagesProvider.setCompressCache(options.getBoolean(Options.PREF_COMPRESS_CACHE, true));
         this.pdfPagesProvider.setOmitImages(options.getBoolean(Options.PREF_OMIT_IMAGES, false));
 		this.pagesView.setColorMode(this.colorMode);		
 		
@@ -502,6 +520,7 @@ public class OpenFileActivity extends Activity implements SensorEventListener {
     }
 
     private void startPDF(SharedPreferences options) {
+	    CJKPack.init(this);
 	    this.pdf = this.getPDF();
 	    if (!this.pdf.isValid()) {
 	    	Log.v(TAG, "Invalid PDF");
@@ -518,12 +537,34 @@ public class OpenFileActivity extends Activity implements SensorEventListener {
 	    		Options.isGray(this.colorMode), 
 	    		options.getBoolean(Options.PREF_OMIT_IMAGES, false),
 	    		options.getBoolean(Options.PREF_RENDER_AHEAD, true));
+	    if (getIntent().getData().getScheme().equals("file")) {
+	    	/* rendered tiles are reused when the same file is opened again */
+	    	DiskTileCache diskCache = DiskTileCache.open(new File(getCacheDir(), "tiles"), this.getVersionCode());
+	    	if (diskCache != null) {
+	    		File file = new File(filePath);
+	    		this.pdfPagesProvider.setDiskCache(diskCache, 
+	    				filePath + "|" + file.length() + "|" + file.lastModified() + "|" + this.box);
+	    	}
+	    }
 	    pagesView.setPagesProvider(pdfPagesProvider);
 	    Bookmark b = new Bookmark(this.getApplicationContext()).open();
 	    pagesView.setStartBookmark(b, filePath);
 	    b.close();
     }
 
+    /**
+     * Get version code of installed app, so caches of rendered tiles can tell
+     * tiles rendered by other versions.
+     * @return version code or 0 if it's unknown
+     */
+    private int getVersionCode() {
+    	try {
+    		return this.getPackageManager().getPackageInfo(this.getPackageName(), 0).versionCode;
+    	} catch (PackageManager.NameNotFoundException e) {
+    		return 0;
+    	}
+    }
+
     /**
      * Return PDF instance wrapping file referenced by Intent.
      * Currently reads all bytes to memory, in future local files
@@ -31,6 +31,7 @@ public class Options extends PreferenceActivity implements OnSharedPreferenceCha
 	public final static String PREF_SIDE_MARGINS = "sideMargins2"; // sideMargins was boolean
 	public final static String PREF_TOP_MARGIN = "topMargin";
 	public final static String PREF_EXTRA_CACHE = "extraCache";
+	public final static String PREF_COMPRESS_CACHE = "compressCache";
 	public final static String PREF_DOUBLE_TAP = "doubleTap";
 	public final static String PREF_VOLUME_PAIR = "volumePair";
 	public final static String PREF_ZOOM_PAIR = "zoomPair";
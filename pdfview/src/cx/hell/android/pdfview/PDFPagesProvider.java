@@ -3,17 +3,27 @@ package cx.hell.android.pdfview;
 import java.util.Collection;
 import java.util.Collections;
 import java.util.HashMap;
+import java.util.HashSet;
 import java.util.Iterator;
+import java.util.LinkedHashMap;
 import java.util.LinkedList;
 import java.util.List;
 import java.util.Map;
+import java.util.Set;
 
 import android.app.Activity;
 import android.graphics.Bitmap;
+import android.graphics.Canvas;
+import android.graphics.Color;
+import android.graphics.Paint;
+import android.graphics.PorterDuff;
+import android.graphics.PorterDuffXfermode;
 import android.os.SystemClock;
 import android.util.Log;
 import cx.hell.android.lib.pagesview.OnImageRenderedListener;
 import cx.hell.android.lib.pagesview.PagesProvider;
+import cx.hell.android.lib.pagesview.PagesView;
+import cx.hell.android.lib.pagesview.RenderCostStats;
 import cx.hell.android.lib.pagesview.RenderingException;
 import cx.hell.android.lib.pagesview.Tile;
 import cx.hell.android.lib.pdf.PDF;
@@ -34,8 +44,88 @@ public class PDFPagesProvider extends PagesProvider {
 	private boolean gray;
 	private int extraCache = 0;
 	private boolean omitImages;
+	private boolean compressCache = false;
+	private volatile boolean draftMode = false;
 	Activity activity = null;
 	private static final int MB = 1024*1024;
+	
+	/**
+	 * Android's ComponentCallbacks2.TRIM_MEMORY_* levels, not available in SDK we build against.
+	 */
+	public static final int TRIM_MEMORY_RUNNING_MODERATE = 5;
+	public static final int TRIM_MEMORY_RUNNING_LOW = 10;
+	public static final int TRIM_MEMORY_RUNNING_CRITICAL = 15;
+	public static final int TRIM_MEMORY_UI_HIDDEN = 20;
+	public static final int TRIM_MEMORY_COMPLETE = 80;
+	
+	/**
+	 * Size of bitmap shared by blank tiles.
+	 */
+	private static final int BLANK_BITMAP_SIZE = 16;
+	
+	/**
+	 * Compressed cache gets this part of bitmap cache size on top of it.
+	 */
+	private static final float COMPRESSED_CACHE_SHARE = 0.25f;
+	
+	/**
+	 * Native caches may use at most this part of memory budget before they are trimmed.
+	 */
+	private static final float MAX_NATIVE_MEMORY_SHARE = 0.5f;
+	
+	/**
+	 * Native caches that had to be trimmed are trimmed again only after they grow by this part
+	 * over what was left after trimming, so pages that need more native memory than their share
+	 * don't get their caches dropped after every tile.
+	 */
+	private static final float NATIVE_MEMORY_HYSTERESIS = 0.25f;
+	
+	/**
+	 * Memory usage is checked at most this often while renderer worker has tiles to render,
+	 * and always after it runs out of them.
+	 */
+	private static final long MEMORY_CHECK_MILLIS = 2000;
+	
+	/**
+	 * Bitmap cache is never limited below this, no matter how much native memory is used.
+	 */
+	private static final int MIN_BITMAP_CACHE_SIZE = 4*MB;
+	
+	/**
+	 * Memory available for native caches and bitmap cache together.
+	 */
+	private int memoryBudget = 0;
+	
+	/**
+	 * Bitmap cache size computed by setMaxCacheSize, before native memory is taken into account.
+	 */
+	private int bitmapCacheBudget = MIN_BITMAP_CACHE_SIZE;
+	
+	/**
+	 * Native glyph cache gets this part of memory budget, within MIN_GLYPH_CACHE_SIZE and MAX_GLYPH_CACHE_SIZE.
+	 */
+	private static final float GLYPH_CACHE_SHARE = 1.0f / 32;
+	private static final int MIN_GLYPH_CACHE_SIZE = 1*MB;
+	private static final int MAX_GLYPH_CACHE_SIZE = 4*MB;
+	
+	/**
+	 * Glyph cache size computed by setMaxCacheSize, and size last passed to native code (0 if none yet).
+	 * It's passed by renderer worker, so UI thread doesn't wait for pdf lock.
+	 */
+	private int glyphCacheBudget = MIN_GLYPH_CACHE_SIZE;
+	private int appliedGlyphCacheBudget = 0;
+	
+	/**
+	 * Native caches are trimmed when they use more than this, see NATIVE_MEMORY_HYSTERESIS; 0 if not known yet.
+	 * Used only by renderer worker.
+	 */
+	private int nativeTrimThreshold = 0;
+	private long lastMemoryCheckMillis = 0;
+	
+	/**
+	 * PDF.TRIM_* level requested by system and not yet applied by renderer worker, -1 if none.
+	 */
+	private int pendingTrimLevel = -1;
 
 	public void setGray(boolean gray) {
 		if (this.gray == gray)
@@ -112,7 +202,172 @@ public class PDFPagesProvider extends PagesProvider {
 		
 		Log.v(TAG, "Setting cache size="+m+ " renderAhead="+renderAhead+" for "+screenWidth+"x"+screenHeight+" (avail="+avail+")");
 		
-		this.bitmapCache.setMaxCacheSizeBytes((int)m);
+		this.memoryBudget = avail;
+		this.bitmapCacheBudget = m;
+		this.glyphCacheBudget = Math.max(MIN_GLYPH_CACHE_SIZE,
+				Math.min(MAX_GLYPH_CACHE_SIZE, (int)(avail * GLYPH_CACHE_SHARE)));
+		this.setCacheLimits(m);
+	}
+	
+	/**
+	 * Set size of bitmap cache, and of compressed cache if it's enabled.
+	 */
+	private void setCacheLimits(int bitmapCacheSize) {
+		this.bitmapCache.setMaxCacheSizeBytes(bitmapCacheSize);
+		this.compressedCache.setMaxSizeBytes(this.compressCache ? (int)(bitmapCacheSize * COMPRESSED_CACHE_SHARE) : 0);
+	}
+	
+	/**
+	 * Keep rendered tiles in disk cache, so they are available after document is opened again.
+	 * @param diskCache disk cache or null to disable it
+	 * @param documentId string that identifies document contents, such as path with size and modification time
+	 */
+	public void setDiskCache(DiskTileCache diskCache, String documentId) {
+		this.diskCache = diskCache;
+		this.documentId = documentId;
+	}
+	
+	/**
+	 * Get disk cache key of tile: document, tile and everything else that affects rendering.
+	 */
+	private String getDiskCacheKey(Tile tile) {
+		return this.documentId + "|" + tile.getPage() + "|" + tile.getZoom() + "|" + tile.getX() + "|" + tile.getY() +
+				"|" + tile.getRotation() + "|" + tile.getPrefXSize() + "x" + tile.getPrefYSize() +
+				"|" + (this.gray ? "gray" : "color") + (this.omitImages ? "|noimages" : "");
+	}
+	
+	/**
+	 * Enable second cache tier that keeps evicted tiles compressed.
+	 */
+	public void setCompressCache(boolean compressCache) {
+		if (this.compressCache == compressCache)
+			return;
+		this.compressCache = compressCache;
+		this.bitmapCache.setCompressedCache(compressCache ? this.compressedCache : null);
+		if (!compressCache)
+			this.compressedCache.clear();
+		setMaxCacheSize();
+	}
+	
+	/**
+	 * Keep native caches and bitmap cache within common memory budget.
+	 * Native caches are trimmed when they take more than their share, what current page
+	 * doesn't use first, and bitmap cache gets whatever native caches leave.
+	 * Called by renderer worker after rendered tiles, so it doesn't wait for pdf lock;
+	 * usage is checked after batch of tiles is done, or every MEMORY_CHECK_MILLIS during long batches.
+	 * @param batchDone renderer worker has no more tiles to render
+	 */
+	private void enforceMemoryBudget(boolean batchDone) {
+		long now = SystemClock.uptimeMillis();
+		if (!batchDone && now - this.lastMemoryCheckMillis < MEMORY_CHECK_MILLIS)
+			return;
+		this.lastMemoryCheckMillis = now;
+		if (this.appliedGlyphCacheBudget != this.glyphCacheBudget) {
+			this.appliedGlyphCacheBudget = this.glyphCacheBudget;
+			this.pdf.setGlyphCacheBudget(this.appliedGlyphCacheBudget);
+		}
+		int[] usage = this.pdf.getMemoryUsage();
+		if (usage == null)
+			return;
+		int nativeSize = getNativeSize(usage);
+		int maxNativeSize = (int)(this.memoryBudget * MAX_NATIVE_MEMORY_SHARE);
+		if (nativeSize <= maxNativeSize) {
+			this.nativeTrimThreshold = maxNativeSize;
+		}
+		else if (nativeSize > Math.max(this.nativeTrimThreshold, maxNativeSize)) {
+			int[] glyphStats = this.pdf.getGlyphCacheStats();
+			Log.i(TAG, "Native caches use " + nativeSize + " bytes, trimming: pages=" + usage[PDF.MEMORY_PAGES] +
+					" store=" + usage[PDF.MEMORY_STORE] + " glyphs=" + usage[PDF.MEMORY_GLYPHS] +
+					" fonts=" + usage[PDF.MEMORY_FONTS] + " budget=" + this.memoryBudget +
+					(glyphStats != null ? " glyphHits=" + glyphStats[PDF.GLYPH_CACHE_HITS] +
+							" glyphMisses=" + glyphStats[PDF.GLYPH_CACHE_MISSES] : ""));
+			/* current page keeps its display list and resources unless that's not enough */
+			this.pdf.trimMemory(PDF.TRIM_OLD);
+			usage = this.pdf.getMemoryUsage();
+			if (usage == null)
+				return;
+			nativeSize = getNativeSize(usage);
+			if (nativeSize > maxNativeSize) {
+				this.pdf.trimMemory(PDF.TRIM_GLYPHS);
+				usage = this.pdf.getMemoryUsage();
+				if (usage == null)
+					return;
+				nativeSize = getNativeSize(usage);
+			}
+			this.nativeTrimThreshold = (int)(nativeSize * (1 + NATIVE_MEMORY_HYSTERESIS));
+		}
+		int bitmapLimit = Math.max(MIN_BITMAP_CACHE_SIZE, 
+				Math.min(this.bitmapCacheBudget, this.memoryBudget - nativeSize - this.compressedCache.getSizeBytes()));
+		this.setCacheLimits(bitmapLimit);
+	}
+	
+	/**
+	 * Sum memory used by native caches.
+	 * @param usage byte counts returned by PDF.getMemoryUsage
+	 */
+	private static int getNativeSize(int[] usage) {
+		return usage[PDF.MEMORY_PAGES] + usage[PDF.MEMORY_STORE] + usage[PDF.MEMORY_GLYPHS] +
+				usage[PDF.MEMORY_FONTS];
+	}
+	
+	/**
+	 * Free memory when system asks for it.
+	 * Called on UI thread, so only Java caches are freed here. Native caches are freed by renderer
+	 * worker before its next tile, since pdf lock may be held by render in progress.
+	 * Native caches go first since they are cheaper to rebuild than rendered tiles;
+	 * bitmaps are dropped only when memory is critically low or UI is hidden.
+	 * @param level one of TRIM_MEMORY_* levels
+	 */
+	public void trimMemory(int level) {
+		Log.i(TAG, "trimMemory(" + level + ")");
+		if (level >= TRIM_MEMORY_UI_HIDDEN) {
+			this.postTrimLevel(PDF.TRIM_PAGES);
+			this.bitmapCache.clearCache();
+		}
+		else if (level >= TRIM_MEMORY_RUNNING_CRITICAL) {
+			this.postTrimLevel(PDF.TRIM_PAGES);
+			this.bitmapCache.trim(this.bitmapCache.getCurrentCacheSize() / 2);
+			this.bitmapPool.clear();
+			this.compressedCache.clear();
+		}
+		else if (level >= TRIM_MEMORY_RUNNING_LOW) {
+			this.postTrimLevel(PDF.TRIM_STORE);
+			this.compressedCache.releaseScratch();
+		}
+		else {
+			this.postTrimLevel(PDF.TRIM_GLYPHS);
+			this.compressedCache.releaseScratch();
+		}
+	}
+	
+	/**
+	 * Ask renderer worker to trim native caches, starting it if it's idle.
+	 * @param level one of PDF.TRIM_* levels
+	 */
+	private void postTrimLevel(int level) {
+		synchronized(this) {
+			if (level > this.pendingTrimLevel)
+				this.pendingTrimLevel = level;
+		}
+		this.rendererWorker.wakeUp();
+	}
+	
+	/**
+	 * Trim native caches as requested by trimMemory. Called by renderer worker between tiles.
+	 */
+	private void applyPendingTrim() {
+		int level;
+		synchronized(this) {
+			level = this.pendingTrimLevel;
+			this.pendingTrimLevel = -1;
+		}
+		if (level < 0)
+			return;
+		this.pdf.trimMemory(level);
+		if (level >= PDF.TRIM_PAGES)
+			this.renderBuffer = null;
+		/* let next check compute threshold from what's left */
+		this.nativeTrimThreshold = 0;
 	}
 	
 
@@ -127,11 +382,137 @@ public class PDFPagesProvider extends PagesProvider {
 	}
 	
 
+	/**
+	 * Pool of mutable bitmaps, grouped by size and config.
+	 * Bitmaps evicted from cache are returned here and reused for new tiles, which are mostly
+	 * of the same size, so rendering doesn't allocate a new bitmap for every tile.
+	 * Evicted bitmap may still be drawn by frame in progress, so it's reused only after
+	 * view finished a frame that started after eviction.
+	 */
+	static class BitmapPool {
+		/**
+		 * At most this many bitmaps are kept in pool, others are recycled or left to GC.
+		 */
+		private static final int MAX_POOLED_BITMAPS = 8;
+		
+		/**
+		 * Bitmap returned to pool is reused after this many frames are drawn: the first one may
+		 * have been in progress when bitmap was evicted, the second one can't draw it.
+		 */
+		private static final int FRAMES_TO_RELEASE = 2;
+		
+		/**
+		 * Bitmap waiting until frames that could draw it are done.
+		 */
+		private static class PendingBitmap {
+			Bitmap bitmap;
+			int frame;
+			
+			PendingBitmap(Bitmap bitmap, int frame) {
+				this.bitmap = bitmap;
+				this.frame = frame;
+			}
+		}
+		
+		private Map<String, LinkedList<Bitmap>> bitmaps = new HashMap<String, LinkedList<Bitmap>>();
+		private LinkedList<PendingBitmap> pending = new LinkedList<PendingBitmap>();
+		private int count = 0;
+		
+		/**
+		 * Number of frames drawn by view, written only by UI thread.
+		 */
+		private volatile int framesDrawn = 0;
+		
+		private static String getKey(int width, int height, Bitmap.Config config) {
+			return width + "x" + height + " " + config;
+		}
+		
+		/**
+		 * Called by UI thread after each frame.
+		 */
+		void onFrameDrawn() {
+			this.framesDrawn += 1;
+		}
+		
+		/**
+		 * Get bitmap from pool or create new one if there's none of such size and config.
+		 * Contents of returned bitmap are undefined.
+		 */
+		synchronized Bitmap get(int width, int height, Bitmap.Config config) {
+			this.releasePending();
+			LinkedList<Bitmap> l = this.bitmaps.get(getKey(width, height, config));
+			if (l != null && !l.isEmpty()) {
+				this.count -= 1;
+				return l.removeFirst();
+			}
+			return Bitmap.createBitmap(width, height, config);
+		}
+		
+		/**
+		 * Return bitmap that may be on screen to pool. Bitmap must not be used by caller after that.
+		 */
+		synchronized void put(Bitmap bitmap) {
+			if (bitmap.isRecycled())
+				return;
+			/* not recycled, since frame in progress may be drawing it */
+			if (!bitmap.isMutable() || this.count >= MAX_POOLED_BITMAPS)
+				return;
+			this.pending.add(new PendingBitmap(bitmap, this.framesDrawn));
+			this.count += 1;
+		}
+		
+		/**
+		 * Return bitmap that was never given to view to pool, it can be reused right away.
+		 * Bitmap must not be used by caller after that.
+		 */
+		synchronized void putUnused(Bitmap bitmap) {
+			if (!bitmap.isMutable() || bitmap.isRecycled() || this.count >= MAX_POOLED_BITMAPS) {
+				bitmap.recycle();
+				return;
+			}
+			this.addReady(bitmap);
+			this.count += 1;
+		}
+		
+		/**
+		 * Move bitmaps that can't be on screen anymore from pending list to pool.
+		 */
+		private void releasePending() {
+			int frames = this.framesDrawn;
+			while (!this.pending.isEmpty() && frames - this.pending.getFirst().frame >= FRAMES_TO_RELEASE)
+				this.addReady(this.pending.removeFirst().bitmap);
+		}
+		
+		private void addReady(Bitmap bitmap) {
+			String key = getKey(bitmap.getWidth(), bitmap.getHeight(), bitmap.getConfig());
+			LinkedList<Bitmap> l = this.bitmaps.get(key);
+			if (l == null) {
+				l = new LinkedList<Bitmap>();
+				this.bitmaps.put(key, l);
+			}
+			l.add(bitmap);
+		}
+		
+		/**
+		 * Recycle all pooled bitmaps.
+		 */
+		synchronized void clear() {
+			for(LinkedList<Bitmap> l: this.bitmaps.values())
+				for(Bitmap b: l)
+					b.recycle();
+			this.bitmaps.clear();
+			for(PendingBitmap p: this.pending)
+				p.bitmap.recycle();
+			this.pending.clear();
+			this.count = 0;
+		}
+	}
+	
 	/**
 	 * Smart page-bitmap cache.
 	 * Stores up to approx maxCacheSizeBytes of images.
 	 * Dynamically drops oldest unused bitmaps.
-	 * TODO: Return high resolution bitmaps if no exact res is available.
+	 * If no exact res is available, bitmaps of nearest zoom level can be returned by getNearest.
 	 * Bitmap images are tiled - tile size is specified in PagesView.TILE_SIZE.
 	 */
 	
@@ -143,6 +524,21 @@ public class PDFPagesProvider extends PagesProvider {
 		
 		private int maxCacheSizeBytes = 4*1024*1024; 
 		
+		/**
+		 * Evicted bitmaps go there.
+		 */
+		private BitmapPool pool;
+		
+		/**
+		 * Evicted bitmaps are compressed there, if not null.
+		 */
+		private CompressedBitmapCache compressedCache = null;
+		
+		/**
+		 * Bitmaps evicted by put, waiting to be compressed by compressEvicted outside of cache lock.
+		 */
+		private LinkedHashMap<Tile, Bitmap> evicted = new LinkedHashMap<Tile, Bitmap>();
+		
 		/**
 		 * Stats logging - number of cache hits.
 		 */
@@ -154,7 +550,8 @@ public class PDFPagesProvider extends PagesProvider {
 		 */
 		private long misses;
 		
-		BitmapCache() {
+		BitmapCache(BitmapPool pool) {
+			this.pool = pool;
 			this.bitmaps = new HashMap<Tile, BitmapCacheValue>();
 			this.hits = 0;
 			this.misses = 0;
@@ -164,6 +561,10 @@ public class PDFPagesProvider extends PagesProvider {
 			this.maxCacheSizeBytes = maxCacheSizeBytes;
 		}
 		
+		synchronized void setCompressedCache(CompressedBitmapCache compressedCache) {
+			this.compressedCache = compressedCache;
+		}
+		
 		/**
 		 * Get cached bitmap. Updates last access timestamp.
 		 * @param k cache key
@@ -191,23 +592,113 @@ public class PDFPagesProvider extends PagesProvider {
 		
 		/**
 		 * Put rendered tile in cache.
+		 * Draft bitmap of the same tile is replaced.
 		 * @param tile tile definition (page, position etc), cache key
 		 * @param bitmap rendered tile contents, cache value
+		 * @param draft bitmap was rendered in draft quality
+		 */
+		synchronized void put(Tile tile, Bitmap bitmap, boolean draft) {
+			BitmapCacheValue v = new BitmapCacheValue(bitmap, System.currentTimeMillis(), 0);
+			v.draft = draft;
+			this.putValue(tile, v);
+		}
+		
+		/**
+		 * Put tile that has nothing on it in cache.
+		 * @param blank shared bitmap, never recycled by cache
 		 */
-		synchronized void put(Tile tile, Bitmap bitmap) {
-			while (this.willExceedCacheSize(bitmap) && !this.bitmaps.isEmpty()) {
+		synchronized void putBlank(Tile tile, Bitmap blank) {
+			BitmapCacheValue v = new BitmapCacheValue(blank, System.currentTimeMillis(), 0);
+			v.blank = true;
+			this.putValue(tile, v);
+		}
+		
+		private void putValue(Tile tile, BitmapCacheValue v) {
+			BitmapCacheValue old = this.bitmaps.remove(tile);
+			if (old != null && !old.blank)
+				this.pool.put(old.bitmap);
+			while (this.willExceedCacheSize(v.bitmap) && !this.bitmaps.isEmpty()) {
 				Log.v(TAG, "Removing oldest");
-				this.removeOldest();
+				this.removeOldest(true);
 			}
-			this.bitmaps.put(tile, new BitmapCacheValue(bitmap, System.currentTimeMillis(), 0));
+			this.bitmaps.put(tile, v);
+		}
+		
+		/**
+		 * Get cached bitmaps of the same page area at zoom level closest to tile's zoom.
+		 * Higher resolutions are preferred over lower ones, and tiles of tile's rotation
+		 * over rotated ones. Doesn't update hit/miss stats.
+		 * @param tile tile that's not in cache
+		 * @param pageSize size of tile's page at zoom 1000 and rotation 0
+		 * @return overlapping tiles of single zoom level and rotation with their bitmaps, or null if there are none
+		 */
+		synchronized Map<Tile,Bitmap> getNearest(Tile tile, int[] pageSize) {
+			int bestZoom = -1;
+			int bestRotation = 0;
+			float bestDistance = 0;
+			for(Tile k: this.bitmaps.keySet()) {
+				if (k.equals(tile) || !k.overlaps(tile, pageSize[0], pageSize[1]))
+					continue;
+				float distance = getZoomDistance(k.getZoom(), tile.getZoom());
+				if (k.getRotation() != tile.getRotation())
+					distance *= ROTATED_DISTANCE;
+				if (bestZoom < 0 || distance < bestDistance) {
+					bestZoom = k.getZoom();
+					bestRotation = k.getRotation();
+					bestDistance = distance;
+				}
+			}
+			if (bestZoom < 0)
+				return null;
+			
+			Map<Tile,Bitmap> nearest = new HashMap<Tile,Bitmap>();
+			long now = System.currentTimeMillis();
+			for(Map.Entry<Tile,BitmapCacheValue> e: this.bitmaps.entrySet()) {
+				Tile k = e.getKey();
+				if (k.getZoom() == bestZoom && k.getRotation() == bestRotation && !k.equals(tile)
+						&& k.overlaps(tile, pageSize[0], pageSize[1])) {
+					e.getValue().millisAccessed = now;
+					nearest.put(k, e.getValue().bitmap);
+				}
+			}
+			return nearest;
+		}
+		
+		/**
+		 * Rotated tiles count as this much further away than tiles of the same zoom and rotation.
+		 */
+		private static final float ROTATED_DISTANCE = 4f;
+		
+		/**
+		 * How far is zoom from target zoom.
+		 * Scaled down bitmaps look better than scaled up ones, so lower zooms count double.
+		 */
+		private static float getZoomDistance(int zoom, int targetZoom) {
+			if (zoom >= targetZoom)
+				return (float)zoom / targetZoom;
+			else
+				return 2f * targetZoom / zoom;
 		}
 		
 		/**
 		 * Check if cache contains specified bitmap tile. Doesn't update last-used timestamp.
-		 * @return true if cache contains specified bitmap tile
+		 * @param draftAllowed if false, draft bitmaps don't count
+		 * @return true if cache contains specified bitmap tile in good enough quality
+		 */
+		synchronized boolean contains(Tile tile, boolean draftAllowed) {
+			BitmapCacheValue v = this.bitmaps.get(tile);
+			return v != null && (draftAllowed || !v.draft);
+		}
+		
+		/**
+		 * Check if cache contains any tile of page, at any zoom.
 		 */
-		synchronized boolean contains(Tile tile) {
-			return this.bitmaps.containsKey(tile);
+		synchronized boolean hasPage(int page) {
+			for(Tile k: this.bitmaps.keySet()) {
+				if (k.getPage() == page)
+					return true;
+			}
+			return false;
 		}
 		
 		/**
@@ -250,8 +741,9 @@ public class PDFPagesProvider extends PagesProvider {
 		
 		/**
 		 * Remove oldest bitmap cache value.
+		 * @param compress keep bitmap for compressEvicted if compressed cache is enabled, instead of just dropping it
 		 */
-		private void removeOldest() {
+		private void removeOldest(boolean compress) {
 			Iterator<Tile> i = this.bitmaps.keySet().iterator();
 			long minmillis = 0;
 			Tile oldest = null;
@@ -270,19 +762,71 @@ public class PDFPagesProvider extends PagesProvider {
 			}
 			if (oldest == null) throw new RuntimeException("couldnt find oldest");
 			BitmapCacheValue v = this.bitmaps.get(oldest);
-			v.bitmap.recycle();
+			if (!v.blank) {
+				if (compress && this.compressedCache != null && !v.draft) {
+					Bitmap old = this.evicted.put(oldest, v.bitmap);
+					if (old != null)
+						this.pool.put(old);
+				}
+				else {
+					this.pool.put(v.bitmap);
+				}
+			}
 			this.bitmaps.remove(oldest);
 		}
 		
+		/**
+		 * Compress bitmaps evicted by put into compressed cache and return them to pool.
+		 * Called by renderer worker after tile is published, so neither cache lock is held
+		 * nor view waits for tile while bitmaps are being compressed.
+		 */
+		void compressEvicted() {
+			while(true) {
+				Tile tile;
+				Bitmap bitmap;
+				CompressedBitmapCache compressedCache;
+				synchronized(this) {
+					if (this.evicted.isEmpty())
+						return;
+					Iterator<Map.Entry<Tile, Bitmap>> i = this.evicted.entrySet().iterator();
+					Map.Entry<Tile, Bitmap> e = i.next();
+					tile = e.getKey();
+					bitmap = e.getValue();
+					i.remove();
+					compressedCache = this.compressedCache;
+				}
+				if (compressedCache != null)
+					compressedCache.put(tile, bitmap);
+				this.pool.put(bitmap);
+			}
+		}
+		
+		/**
+		 * Remove oldest bitmaps until cache takes at most maxBytes.
+		 * Called when memory is short, so bitmaps are not compressed.
+		 */
+		synchronized void trim(int maxBytes) {
+			while (!this.bitmaps.isEmpty() && this.getCurrentCacheSize() > maxBytes)
+				this.removeOldest(false);
+		}
+		
 		synchronized public void clearCache() {
 			Iterator<Tile> i = this.bitmaps.keySet().iterator();
 
 			while(i.hasNext()) {
 				Tile k = i.next();
 				Log.v("Deleting", k.toString());
-				this.bitmaps.get(k).bitmap.recycle();
+				BitmapCacheValue v = this.bitmaps.get(k);
+				if (!v.blank)
+					v.bitmap.recycle();
 				i.remove();
 			}			
+			for(Bitmap b: this.evicted.values())
+				b.recycle();
+			this.evicted.clear();
+			this.pool.clear();
+			if (this.compressedCache != null)
+				this.compressedCache.clear();
 		}
 	}
 	
@@ -326,7 +870,13 @@ public class PDFPagesProvider extends PagesProvider {
 		synchronized void setTiles(Collection<Tile> tiles, BitmapCache bitmapCache) {
 			this.tiles = tiles;
 			this.bitmapCache = bitmapCache;
-			
+			this.wakeUp();
+		}
+		
+		/**
+		 * Start rendering thread if there's none, so pending work like trimming native caches gets done.
+		 */
+		synchronized void wakeUp() {
 			if (this.workerThread == null) {
 				Thread t = new Thread(this);
 				t.setPriority(Thread.MIN_PRIORITY);
@@ -349,6 +899,7 @@ public class PDFPagesProvider extends PagesProvider {
 		synchronized Collection<Tile> popTiles() {
 			if (this.tiles == null || this.tiles.isEmpty()) {
 				this.workerThread = null; /* returning null, so calling thread will finish it's work */
+				this.notifyAll(); /* prefetcher may go on */
 				return null;
 			}
 			Tile tile = this.tiles.iterator().next();
@@ -356,6 +907,23 @@ public class PDFPagesProvider extends PagesProvider {
 			return Collections.singleton(tile);
 		}
 		
+		/**
+		 * Check if there are tiles waiting to be rendered.
+		 */
+		synchronized boolean hasTiles() {
+			return this.tiles != null && !this.tiles.isEmpty();
+		}
+		
+		/**
+		 * Block until there's no thread rendering tiles.
+		 * @return false if worker has failed and will never be idle
+		 */
+		synchronized boolean waitIdle() throws InterruptedException {
+			while (this.workerThread != null && !this.isFailed)
+				this.wait();
+			return !this.isFailed;
+		}
+		
 		/**
 		 * Thread's main routine.
 		 * There might be more than one running, but only one will get new tiles. Others
@@ -365,14 +933,24 @@ public class PDFPagesProvider extends PagesProvider {
 			while(true) {
 				if (this.isFailed) {
 					Log.i(TAG, "RendererWorker is failed, exiting");
+					synchronized (this) {
+						this.notifyAll(); /* prefetcher waiting for idle worker should give up */
+					}
 					break;
 				}
+				this.pdfPagesProvider.applyPendingTrim();
 				Collection<Tile> tiles = this.popTiles(); /* this can't block */
-				if (tiles == null || tiles.size() == 0) break;
+				if (tiles == null || tiles.size() == 0) {
+					/* trim posted before popTiles let this thread go didn't start another one */
+					this.pdfPagesProvider.applyPendingTrim();
+					break;
+				}
 				try {
 					Map<Tile,Bitmap> renderedTiles = this.pdfPagesProvider.renderTiles(tiles, bitmapCache);
 					if (renderedTiles.size() > 0)
 						this.pdfPagesProvider.publishBitmaps(renderedTiles);
+					this.bitmapCache.compressEvicted();
+					this.pdfPagesProvider.enforceMemoryBudget(!this.hasTiles());
 				} catch (RenderingException e) {
 					this.isFailed = true;
 					this.pdfPagesProvider.publishRenderingException(e);
@@ -381,22 +959,201 @@ public class PDFPagesProvider extends PagesProvider {
 		}
 	}
 
+	/**
+	 * Low priority worker that loads pages ahead of the reader.
+	 * Native side parses content and loads fonts and images of upcoming pages, so when
+	 * such page becomes visible, only rasterization is left to renderer worker.
+	 * Prefetching happens only when renderer worker is idle. Page can't be interrupted once
+	 * started, since it holds PDF lock, so idle worker is waited for before each page.
+	 */
+	private static class PrefetcherWorker implements Runnable {
+		/**
+		 * How many pages ahead of current page should be prefetched.
+		 */
+		private static final int PREFETCH_PAGES = 3;
+		
+		private PDF pdf;
+		private RendererWorker rendererWorker;
+		private int pageCount;
+		
+		/**
+		 * Last known current page, -1 if unknown.
+		 */
+		private int currentPage = -1;
+		
+		/**
+		 * Reading direction: 1 for forward, -1 for backward.
+		 */
+		private int direction = 1;
+		
+		/**
+		 * Pages waiting to be prefetched, closest first.
+		 */
+		private LinkedList<Integer> pages = new LinkedList<Integer>();
+		
+		/**
+		 * Pages already prefetched in current window.
+		 */
+		private Set<Integer> prefetchedPages = new HashSet<Integer>();
+		
+		/**
+		 * Designated prefetching thread, null if there's none.
+		 */
+		private Thread workerThread = null;
+		
+		PrefetcherWorker(PDF pdf, RendererWorker rendererWorker, int pageCount) {
+			this.pdf = pdf;
+			this.rendererWorker = rendererWorker;
+			this.pageCount = pageCount;
+		}
+		
+		/**
+		 * Called when current page changes.
+		 * Updates reading direction, recomputes prefetch window and starts thread if needed.
+		 * @param page 0-based page number of first visible page
+		 */
+		synchronized void setCurrentPage(int page) {
+			if (page == this.currentPage)
+				return;
+			if (this.currentPage >= 0)
+				this.direction = page > this.currentPage ? 1 : -1;
+			this.currentPage = page;
+			
+			Set<Integer> window = new HashSet<Integer>();
+			this.pages.clear();
+			for(int i = 1; i <= PREFETCH_PAGES; ++i) {
+				int p = page + i * this.direction;
+				if (p < 0 || p >= this.pageCount)
+					break;
+				window.add(p);
+				if (!this.prefetchedPages.contains(p))
+					this.pages.add(p);
+			}
+			this.prefetchedPages.retainAll(window);
+			
+			if (!this.pages.isEmpty() && this.workerThread == null) {
+				Thread t = new Thread(this);
+				t.setPriority(Thread.MIN_PRIORITY);
+				t.setName("PrefetcherWorkerThread");
+				this.workerThread = t;
+				t.start();
+			}
+		}
+		
+		/**
+		 * Get next page to prefetch.
+		 * Resets this.workerThread if there's nothing to do, so calling thread may finish.
+		 * @return page number or -1 if there's nothing left to prefetch
+		 */
+		synchronized int popPage() {
+			if (this.pages.isEmpty()) {
+				this.workerThread = null;
+				return -1;
+			}
+			int page = this.pages.removeFirst();
+			this.prefetchedPages.add(page);
+			return page;
+		}
+		
+		/**
+		 * Drop pages waiting to be prefetched and reset this.workerThread, when calling thread gives up.
+		 */
+		synchronized void clearPages() {
+			this.pages.clear();
+			this.workerThread = null;
+		}
+		
+		public void run() {
+			while(true) {
+				try {
+					if (!this.rendererWorker.waitIdle()) {
+						this.clearPages();
+						break;
+					}
+				} catch (InterruptedException e) {
+					this.clearPages();
+					break;
+				}
+				int page = this.popPage();
+				if (page < 0) break;
+				long t1 = SystemClock.currentThreadTimeMillis();
+				int err = this.pdf.prefetchPage(page); /* native */
+				Log.v(TAG, "Prefetched page " + page + " in " + (SystemClock.currentThreadTimeMillis()-t1) + " ms, error: " + err);
+			}
+		}
+	}
+
 	private PDF pdf = null;
+	private BitmapPool bitmapPool = null;
 	private BitmapCache bitmapCache = null;
+	private CompressedBitmapCache compressedCache = null;
+	
+	/**
+	 * Tiles rendered for this document are kept on disk, if not null.
+	 */
+	private DiskTileCache diskCache = null;
+	
+	/**
+	 * Identifies document in disk cache keys.
+	 */
+	private String documentId = null;
+	
+	/**
+	 * Pixels of last rendered tile, reused for next tile. Used only by renderer worker.
+	 */
+	private int[] renderBuffer = null;
+	
+	/**
+	 * Page sizes at zoom 1000 and rotation 0, read on first use.
+	 */
+	private int[][] pageSizes = null;
+	
+	/**
+	 * Render cost of pages, decides their tile sizes.
+	 */
+	private RenderCostStats renderCostStats;
+	
+	/**
+	 * Shared by all blank tiles, in format of current color mode.
+	 */
+	private Bitmap blankBitmap = null;
+	
+	/**
+	 * Paint that copies alpha channel when converting gray tiles to ALPHA_8.
+	 */
+	private Paint alphaCopyPaint = null;
 	private RendererWorker rendererWorker = null;
+	private PrefetcherWorker prefetcherWorker = null;
 	private OnImageRenderedListener onImageRendererListener = null;
 	
 	public float getRenderAhead() {
 		return this.renderAhead;
 	}
 	
+	@Override
+	public void onFrameDrawn() {
+		this.bitmapPool.onFrameDrawn();
+	}
+	
+	@Override
+	public float getTileSizeFactor(int page) {
+		return this.renderCostStats.getTileSizeFactor(page,
+				this.bitmapCache.hasPage(page) || this.compressedCache.hasPage(page));
+	}
+	
 	public PDFPagesProvider(Activity activity, PDF pdf, boolean gray, boolean skipImages,
 			boolean doRenderAhead) {
 		this.gray = gray;
 		this.pdf = pdf;
 		this.omitImages = skipImages;
-		this.bitmapCache = new BitmapCache();
+		this.bitmapPool = new BitmapPool();
+		this.bitmapCache = new BitmapCache(this.bitmapPool);
+		this.compressedCache = new CompressedBitmapCache();
+		this.alphaCopyPaint = new Paint();
+		this.alphaCopyPaint.setXfermode(new PorterDuffXfermode(PorterDuff.Mode.SRC));
 		this.rendererWorker = new RendererWorker(this);
+		this.prefetcherWorker = new PrefetcherWorker(pdf, this.rendererWorker, this.getPageCount());
+		this.renderCostStats = new RenderCostStats(this.getPageCount(), PagesView.MAX_TILE_PIXELS);
 		this.activity = activity;
 		this.doRenderAhead = doRenderAhead;
 		setMaxCacheSize();
@@ -433,38 +1190,86 @@ public class PDFPagesProvider extends PagesProvider {
 	 */
 	private Bitmap renderBitmap(Tile tile) throws RenderingException {
 		synchronized(tile) {
+			boolean draft = this.draftMode;
+			
 			/* last minute check to make sure some other thread hasn't rendered this tile */
-			if (this.bitmapCache.contains(tile))
+			if (this.bitmapCache.contains(tile, draft))
 				return null;
 			
+			if (this.compressCache) {
+				Bitmap b = this.compressedCache.take(tile, this.bitmapPool);
+				if (b != null) {
+					this.bitmapCache.put(tile, b, false);
+					return b;
+				}
+			}
+			
+			if (this.diskCache != null) {
+				Bitmap b = this.diskCache.get(this.getDiskCacheKey(tile), this.bitmapPool);
+				if (b != null) {
+					this.bitmapCache.put(tile, b, false);
+					return b;
+				}
+			}
+			
 			PDF.Size size = new PDF.Size(tile.getPrefXSize(), tile.getPrefYSize());
 			int[] pagebytes = null;
 			
 			long t1 =SystemClock.currentThreadTimeMillis();
 			pagebytes = pdf.renderPage(tile.getPage(), tile.getZoom(), tile.getX(), tile.getY(), 
-					tile.getRotation(), gray, omitImages, size); /* native */
-			Log.v(TAG, "Time:"+(SystemClock.currentThreadTimeMillis()-t1));
+					tile.getRotation(), gray, omitImages, draft, this.renderBuffer, size); /* native */
+			long t = SystemClock.currentThreadTimeMillis()-t1;
+			Log.v(TAG, "Time:"+t);
 			if (pagebytes == null) throw new RenderingException("Couldn't render page " + tile.getPage());
+			if (pagebytes.length == 0) {
+				/* tile doesn't intersect page content */
+				this.renderCostStats.onBlankTile(tile.getPage(), size.width * size.height);
+				Bitmap b = this.getBlankBitmap();
+				this.bitmapCache.putBlank(tile, b);
+				return b;
+			}
+			this.renderBuffer = pagebytes;
+			/* draft renders are cheaper and would make page look simpler than it is */
+			if (!draft)
+				this.renderCostStats.onTileRendered(tile.getPage(), size.width * size.height, t);
 			
-			/* create a bitmap from the 32-bit color array */			
+			/* fill a pooled bitmap from the 32-bit color array */			
 	
 			if (gray) {
-				Bitmap b = Bitmap.createBitmap(pagebytes, size.width, size.height, 
-						Bitmap.Config.ARGB_8888);
-				Bitmap b2 = b.copy(Bitmap.Config.ALPHA_8, false);
-				b.recycle();
-				this.bitmapCache.put(tile, b2);
+				Bitmap b = this.bitmapPool.get(size.width, size.height, Bitmap.Config.ARGB_8888);
+				b.setPixels(pagebytes, 0, size.width, 0, 0, size.width, size.height);
+				Bitmap b2 = this.bitmapPool.get(size.width, size.height, Bitmap.Config.ALPHA_8);
+				new Canvas(b2).drawBitmap(b, 0, 0, this.alphaCopyPaint);
+				this.bitmapPool.putUnused(b);
+				if (this.diskCache != null && !draft)
+					this.diskCache.put(this.getDiskCacheKey(tile), b2);
+				this.bitmapCache.put(tile, b2, draft);
 				return b2;
 			}
 			else {
-				Bitmap b = Bitmap.createBitmap(pagebytes, size.width, size.height, 
-						Bitmap.Config.RGB_565);
-				this.bitmapCache.put(tile, b);
+				Bitmap b = this.bitmapPool.get(size.width, size.height, Bitmap.Config.RGB_565);
+				b.setPixels(pagebytes, 0, size.width, 0, 0, size.width, size.height);
+				if (this.diskCache != null && !draft)
+					this.diskCache.put(this.getDiskCacheKey(tile), b);
+				this.bitmapCache.put(tile, b, draft);
 				return b;
 			}
 		}
 	}
 	
+	/**
+	 * Get bitmap for tiles that have nothing on them.
+	 * It's small and stretched to tile size when drawn, so blank tiles take almost no memory.
+	 */
+	private Bitmap getBlankBitmap() {
+		Bitmap.Config config = this.gray ? Bitmap.Config.ALPHA_8 : Bitmap.Config.RGB_565;
+		if (this.blankBitmap == null || this.blankBitmap.getConfig() != config) {
+			this.blankBitmap = Bitmap.createBitmap(BLANK_BITMAP_SIZE, BLANK_BITMAP_SIZE, config);
+			this.blankBitmap.eraseColor(Color.WHITE);
+		}
+		return this.blankBitmap;
+	}
+	
 	/**
 	 * Called by worker.
 	 */
@@ -503,6 +1308,14 @@ public class PDFPagesProvider extends PagesProvider {
 		if (b != null) return b;
 		return null;
 	}
+	
+	/**
+	 * Get already rendered bitmaps of other zoom levels or rotations for area of given tile.
+	 */
+	@Override
+	public Map<Tile,Bitmap> getFallbackBitmaps(Tile tile) {
+		return this.bitmapCache.getNearest(tile, this.getPageSizes()[tile.getPage()]);
+	}
 
 	/**
 	 * Get page count.
@@ -517,10 +1330,13 @@ public class PDFPagesProvider extends PagesProvider {
 	
 	/**
 	 * Get page sizes from pdf file.
+	 * Sizes are read once and remembered, callers must not modify them.
 	 * @return array of page sizes
 	 */
 	@Override
-	public int[][] getPageSizes() {
+	public synchronized int[][] getPageSizes() {
+		if (this.pageSizes != null)
+			return this.pageSizes;
 		int cnt = this.getPageCount();
 		int[][] sizes = new int[cnt][];
 		PDF.Size size = new PDF.Size();
@@ -534,9 +1350,19 @@ public class PDFPagesProvider extends PagesProvider {
 			sizes[i][0] = size.width;
 			sizes[i][1] = size.height;
 		}
+		this.pageSizes = sizes;
 		return sizes;
 	}
 	
+	/**
+	 * While view is moving fast, tiles are rendered in draft quality.
+	 * Once it stops, draft tiles are rendered again on next setVisibleTiles.
+	 */
+	@Override
+	public void setDraftMode(boolean draftMode) {
+		this.draftMode = draftMode;
+	}
+	
 	/**
 	 * View informs provider what's currently visible.
 	 * Compute what should be rendered and pass that info to renderer worker thread, possibly waking up worker.
@@ -544,8 +1370,11 @@ public class PDFPagesProvider extends PagesProvider {
 	 */
 	synchronized public void setVisibleTiles(Collection<Tile> tiles) {
 		List<Tile> newtiles = null;
+		int firstPage = -1;
 		for(Tile tile: tiles) {
-			if (!this.bitmapCache.contains(tile)) {
+			if (firstPage < 0 || tile.getPage() < firstPage)
+				firstPage = tile.getPage();
+			if (!this.bitmapCache.contains(tile, this.draftMode)) {
 				if (newtiles == null) newtiles = new LinkedList<Tile>();
 				newtiles.add(tile);
 			}
@@ -553,5 +1382,8 @@ public class PDFPagesProvider extends PagesProvider {
 		if (newtiles != null) {
 			this.rendererWorker.setTiles(newtiles, this.bitmapCache);
 		}
+		if (firstPage >= 0) {
+			this.prefetcherWorker.setCurrentPage(firstPage);
+		}
 	}	
 }